@@ -101,6 +101,31 @@ def benchmark_batch(model: str, documents: list[str], num_threads: int, document
     print(f"tinygpt \t{readable_size} / s")
 
 
+def benchmark_single_document(document: str, num_threads: int, chunk_sizes: List[int]) -> None:
+    # must run before the first use of the process-wide thread pool
+    tinygpt.configure_threads(num_threads)
+    num_bytes = len(document.encode())
+    readable_size, unit = format_byte_size(num_bytes)
+    print(f"==============")
+    print(f"num_threads: {num_threads}, single document: {readable_size}")
+
+    tinygpt_enc = tinygpt.Tokenizer()
+    tokenizer_path = hf_hub_download(MODEL_ID, "tokenizer.json")
+    tokenizer_config_path = hf_hub_download(MODEL_ID, "tokenizer_config.json")
+    tinygpt_enc.init_with_config(tokenizer_path, tokenizer_config_path)
+
+    expected = None
+    for chunk_size in chunk_sizes:
+        tinygpt_enc.parallel_chunk_size = chunk_size
+        start = time.perf_counter_ns()
+        out = tinygpt_enc.encode(document, allow_added_tokens=False)
+        end = time.perf_counter_ns()
+        expected = out if expected is None else expected
+        assert out == expected, "chunked encoding differs"
+        readable_size, unit = format_byte_size(num_bytes / (end - start) * 1e9)
+        print(f"tinygpt chunk {chunk_size} \t{readable_size} / s")
+
+
 def test(model: str, dataset: str, dataset_config: str, threads: List[int]):
     dataset_xnli = load_dataset(dataset, dataset_config)
 
@@ -132,6 +157,13 @@ def test(model: str, dataset: str, dataset_config: str, threads: List[int]):
 
             # benchmark_batch(model, documents, num_threads)
 
+    # intra-document parallelism: one large document, chunk size 0 is sequential
+    document = "".join("".join(item["premise"].values()) for item in dataset_xnli["train"].select(range(100_000)))
+    for num_threads in threads:
+        p = Process(target=benchmark_single_document, args=(document, num_threads, [0, 256 * 1024, 1024 * 1024]))
+        p.start()
+        p.join()
+
 
 def main():
 
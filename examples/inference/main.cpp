@@ -25,6 +25,10 @@ static void printUsage(const char* progName) {
   LOGI("  --max-tokens <n>      Max new tokens (default: 32)");
   LOGI("  --temperature <f>     Sampling temperature (default: 0.8)");
   LOGI("  --top-p <f>           Top-p sampling (default: 0.9)");
+  LOGI("  --layer-streaming     Stream layers from disk, for CPU models larger than RAM");
+  LOGI("  --numa                Split MLP weights and threads across NUMA nodes");
+  LOGI("  --threads <n>         Threads for CPU kernels and tokenizer (default: all cores)");
+  LOGI("  --pin-threads         Pin worker threads to CPU cores");
   LOGI("  --help                Show this help message");
 }
 
@@ -35,6 +39,10 @@ int main(int argc, char** argv) {
   int maxTokens = 32;
   float temperature = 0.8f;
   float topP = 0.9f;
+  bool layerStreaming = false;
+  bool numa = false;
+  int threads = 0;
+  bool pinThreads = false;
 
   for (int i = 1; i < argc; i++) {
     std::string arg = argv[i];
@@ -54,6 +62,14 @@ int main(int argc, char** argv) {
       temperature = std::strtof(argv[++i], nullptr);
     } else if (arg == "--top-p" && i + 1 < argc) {
       topP = std::strtof(argv[++i], nullptr);
+    } else if (arg == "--layer-streaming") {
+      layerStreaming = true;
+    } else if (arg == "--numa") {
+      numa = true;
+    } else if (arg == "--threads" && i + 1 < argc) {
+      threads = std::atoi(argv[++i]);
+    } else if (arg == "--pin-threads") {
+      pinThreads = true;
     } else {
       LOGE("Unknown argument: %s", arg.c_str());
       printUsage(argv[0]);
@@ -72,6 +88,10 @@ int main(int argc, char** argv) {
   config.samplerConfig.temperature = temperature;
   config.samplerConfig.topP = topP;
   config.maxNewTokens = maxTokens;
+  config.layerStreaming = layerStreaming;
+  config.numa = numa;
+  config.intraOpThreads = threads > 0 ? static_cast<uint32_t>(threads) : 0;
+  config.pinThreads = pinThreads;
 
   if (device == "cpu") {
     config.device = tinytorch::DeviceType::CPU;
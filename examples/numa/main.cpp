@@ -0,0 +1,148 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Utils/Logger.h"
+#include "Utils/Timer.h"
+#include "kernel/MLP.h"
+#include "util/Numa.h"
+#include "util/ThreadPool.h"
+
+using namespace tinygpt;
+using kernel::BF16;
+
+// Decode gated MLP (bf16, Llama-2-7B sizes by default) on a multi-socket host, three runs:
+//   global pool: the weights where a plain load leaves them (first touched by one thread), no node pools
+//   node pools:  the same weights, each node's pinned pool computing its rows
+//   node layout: each node reading its own slice from its own memory, as with --numa
+// On a single node machine only the first run happens.
+
+static void printUsage(const char* progName) {
+  LOGI("Usage: %s [options]", progName);
+  LOGI("Options:");
+  LOGI("  --hidden <n>          Hidden size (default: 4096)");
+  LOGI("  --intermediate <n>    Intermediate size (default: 11008)");
+  LOGI("  --tokens <n>          Tokens per call (default: 1)");
+  LOGI("  --iters <n>           Timed calls (default: 50)");
+  LOGI("  --help                Show this help message");
+}
+
+static std::vector<BF16> randomWeights(int64_t n, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> dist(-0.05f, 0.05f);
+  std::vector<BF16> ret(n);
+  for (auto& v : ret) {
+    v = kernel::fromFloat<BF16>(dist(rng));
+  }
+  return ret;
+}
+
+// ms per call, after one warm up call
+template <typename Func>
+static float timeCalls(int iters, Func&& func) {
+  func();
+  tinytorch::Timer timer;
+  timer.start();
+  for (int i = 0; i < iters; i++) {
+    func();
+  }
+  timer.mark();
+  return static_cast<float>(timer.elapseMillis()) / static_cast<float>(iters);
+}
+
+static void logResult(const char* name, float ms, int64_t weightBytes) {
+  auto gbps = ms > 0.f ? static_cast<float>(weightBytes) / (ms * 1e-3f) / 1e9f : 0.f;
+  LOGI("%-12s %.3f ms / call, weights read %.1f GB/s", name, ms, gbps);
+}
+
+int main(int argc, char** argv) {
+  int64_t hiddenSize = 4096;
+  int64_t intermediateSize = 11008;
+  int64_t numTokens = 1;
+  int iters = 50;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--help" || arg == "-h") {
+      printUsage(argv[0]);
+      return 0;
+    }
+    if (arg == "--hidden" && i + 1 < argc) {
+      hiddenSize = std::atoll(argv[++i]);
+    } else if (arg == "--intermediate" && i + 1 < argc) {
+      intermediateSize = std::atoll(argv[++i]);
+    } else if (arg == "--tokens" && i + 1 < argc) {
+      numTokens = std::atoll(argv[++i]);
+    } else if (arg == "--iters" && i + 1 < argc) {
+      iters = std::atoi(argv[++i]);
+    } else {
+      LOGE("Unknown option: %s", arg.c_str());
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+  if (hiddenSize <= 0 || intermediateSize <= 0 || numTokens <= 0 || iters <= 0) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  const int64_t H = hiddenSize;
+  const int64_t I = intermediateSize;
+  const int64_t weightBytes = 3 * H * I * static_cast<int64_t>(sizeof(BF16));
+  LOGI("gated MLP: hidden %lld, intermediate %lld, tokens %lld, weights %.1f MB, NUMA nodes %d",
+       static_cast<long long>(H), static_cast<long long>(I), static_cast<long long>(numTokens),
+       static_cast<float>(weightBytes) / (1024 * 1024), Numa::numNodes());
+
+  auto gateUp = randomWeights(2 * I * H, 1);
+  auto down = randomWeights(H * I, 2);
+  auto x = randomWeights(numTokens * H, 3);
+  std::vector<BF16> out(numTokens * H);
+
+  kernel::GatedMLPParams params;
+  params.numTokens = numTokens;
+  params.hiddenSize = H;
+  params.intermediateSize = I;
+  auto ms = timeCalls(iters, [&] { kernel::gatedMLP(x.data(), gateUp.data(), down.data(), out.data(), params); });
+  logResult("global pool", ms, weightBytes);
+
+  if (!Numa::setEnabled(true)) {
+    LOGI("single NUMA node, node layout skipped");
+    return 0;
+  }
+
+  // node layout, as GatedMLP::enableNumaLayout builds it
+  const auto& pools = Numa::nodePools();
+  const auto numNodes = static_cast<int64_t>(pools.size());
+  std::vector<std::vector<BF16>> nodeGateUp(numNodes);
+  std::vector<std::vector<BF16>> nodeDown(numNodes);
+  std::vector<const void*> nodeWeights;
+  for (int64_t node = 0; node < numNodes; node++) {
+    int64_t begin, end;
+    kernel::gatedMLPNodeRows(I, numNodes, node, begin, end);
+    const int64_t rows = end - begin;
+    nodeGateUp[node].resize(2 * rows * H);
+    nodeDown[node].resize(H * rows);
+    Numa::bindPages(nodeGateUp[node].data(), nodeGateUp[node].size() * sizeof(BF16), static_cast<int>(node));
+    Numa::bindPages(nodeDown[node].data(), nodeDown[node].size() * sizeof(BF16), static_cast<int>(node));
+    kernel::gatedMLPNodeLayout(gateUp.data(), down.data(), nodeGateUp[node].data(), nodeDown[node].data(), H, I,
+                               numNodes, node, *pools[node]);
+    nodeWeights.push_back(nodeGateUp[node].data());
+    nodeWeights.push_back(nodeDown[node].data());
+  }
+
+  params.nodePools = &pools;
+  ms = timeCalls(iters, [&] { kernel::gatedMLP(x.data(), gateUp.data(), down.data(), out.data(), params); });
+  logResult("node pools", ms, weightBytes);
+
+  params.nodeWeights = nodeWeights.data();
+  ms = timeCalls(iters, [&] { kernel::gatedMLP<BF16>(x.data(), nullptr, nullptr, out.data(), params); });
+  logResult("node layout", ms, weightBytes);
+  return 0;
+}
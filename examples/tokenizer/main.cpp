@@ -4,6 +4,7 @@
  *
  */
 
+#include <algorithm>
 #include <fstream>
 
 #include "Utils/Timer.h"
@@ -56,5 +57,32 @@ int main(int argc, char** argv) {
   auto speed = (float)(content.size() * batch) / (float)timeCost * 1000.f / (1024 * 1024);
   LOGI("encode bytes: %lld, cost: %lld ms, %.1f MB / s", content.size() * batch, timeCost, speed);
 
+  // worst case pieces: cost per byte should stay flat as the piece grows, each case is repeated to about 16 MB so
+  // the millisecond timer has enough resolution
+  constexpr size_t kWorstCaseBytes = 16 << 20;
+  std::string base64Chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  for (size_t len : {1 << 10, 1 << 14, 1 << 18}) {
+    std::string base64(len, 'A');
+    for (size_t i = 0; i < len; i++) {
+      base64[i] = base64Chars[(i * 7919 + i / 3) % base64Chars.size()];
+    }
+    std::vector<std::pair<const char*, std::string>> cases = {
+        {"spaces", std::string(len, ' ') + "x"},
+        {"repeated", std::string(len, 'a')},
+        {"base64", base64},
+    };
+    for (auto& [name, text] : cases) {
+      const size_t repeat = std::max<size_t>(kWorstCaseBytes / text.size(), 1);
+      std::vector<int32_t> caseIds;
+      timer.start();
+      for (size_t r = 0; r < repeat; r++) {
+        caseIds = tokenizer.encode(text, false);
+      }
+      timer.mark();
+      auto cost = static_cast<double>(timer.elapseMillis()) * 1e6 / static_cast<double>(text.size() * repeat);
+      LOGI("worst case %-8s bytes: %zu, tokens: %zu, %.1f ns / byte", name, text.size(), caseIds.size(), cost);
+    }
+  }
+
   return 0;
 }
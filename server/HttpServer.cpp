@@ -8,6 +8,7 @@
 
 #include "ChatTemplateUtils.h"
 #include "util/PathUtils.h"
+#include "util/ThreadPool.h"
 
 namespace tinygpt::server {
 
@@ -25,6 +26,9 @@ bool HttpServer::start(const ServerConfig& config) {
     modelName_ = modelName_.substr(pos + 1);
   }
 
+  // one pool for tokenizer and engine CPU work, set up before either uses it
+  ThreadPool::configureGlobal(config_.intraOpThreads, config_.pinThreads);
+
   // load tokenizer (for chat template)
   tokenizer_ = std::make_unique<tokenizer::Tokenizer>();
   std::string tokenizerPath = PathUtils::joinPath(config_.modelDir, "tokenizer.json");
@@ -70,6 +74,12 @@ bool HttpServer::start(const ServerConfig& config) {
   gptConfig.dtype = config_.dtype;
   gptConfig.samplerConfig = config_.samplerConfig;
   gptConfig.maxNewTokens = config_.maxNewTokens;
+  gptConfig.layerStreaming = config_.layerStreaming;
+  gptConfig.hugePages = config_.hugePages;
+  gptConfig.numa = config_.numa;
+  gptConfig.intraOpThreads = config_.intraOpThreads;
+  gptConfig.interOpThreads = config_.interOpThreads;
+  gptConfig.pinThreads = config_.pinThreads;
 
   engine_ = std::make_unique<GPTEngine>(gptConfig);
   if (!engine_->prepare()) {
@@ -83,6 +93,12 @@ bool HttpServer::start(const ServerConfig& config) {
 
   // setup HTTP server
   impl_ = std::make_unique<Impl>();
+  // connections stay on httplib's own threads: they block for a whole request (or streamed reply) and would hold
+  // workers the kernels of the engine need
+  if (gptConfig.interOpThreads > 0) {
+    size_t numThreads = gptConfig.interOpThreads;
+    impl_->svr.new_task_queue = [numThreads] { return new httplib::ThreadPool(numThreads); };
+  }
   setupRoutes();
 
   // serve static web files
@@ -36,6 +36,12 @@ static void printUsage(const char* progName) {
   LOGI("  --min-p <f>        Min-p sampling (default: 0.0)");
   LOGI("  --chat-template <s> Custom chat template (Jinja2 string or file path)");
   LOGI("  --web-dir <path>   Path to web UI directory (auto-detected if omitted)");
+  LOGI("  --layer-streaming  Stream layers from disk, for CPU models larger than RAM");
+  LOGI("  --huge-pages       Back CPU weights, KV cache and activations with huge pages");
+  LOGI("  --numa             Split MLP weights and threads across NUMA nodes");
+  LOGI("  --threads <n>      Threads for CPU kernels and tokenizer (default: all cores)");
+  LOGI("  --http-threads <n> Threads handling HTTP requests (default: httplib)");
+  LOGI("  --pin-threads      Pin worker threads to CPU cores");
   LOGI("  --help             Show this help message");
 }
 
@@ -66,6 +72,18 @@ int main(int argc, char** argv) {
       config.samplerConfig.minP = std::strtof(argv[++i], nullptr);
     } else if (arg == "--web-dir" && i + 1 < argc) {
       config.webDir = argv[++i];
+    } else if (arg == "--layer-streaming") {
+      config.layerStreaming = true;
+    } else if (arg == "--huge-pages") {
+      config.hugePages = true;
+    } else if (arg == "--numa") {
+      config.numa = true;
+    } else if (arg == "--threads" && i + 1 < argc) {
+      config.intraOpThreads = static_cast<uint32_t>(std::atoi(argv[++i]));
+    } else if (arg == "--http-threads" && i + 1 < argc) {
+      config.interOpThreads = static_cast<uint32_t>(std::atoi(argv[++i]));
+    } else if (arg == "--pin-threads") {
+      config.pinThreads = true;
     } else if (arg == "--chat-template" && i + 1 < argc) {
       std::string val = argv[++i];
       // If the value looks like a file path, read its contents
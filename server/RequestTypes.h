@@ -28,6 +28,16 @@ struct ServerConfig {
   int64_t maxNewTokens = 4096;
 
   std::string chatTemplate;
+
+  bool layerStreaming = false;
+  bool hugePages = false;
+  bool numa = false;
+
+  // threads of the shared pool running CPU kernels and tokenizer work, 0: hardware concurrency
+  uint32_t intraOpThreads = 0;
+  // threads handling HTTP requests concurrently (GPTConfig::interOpThreads), 0: httplib default
+  uint32_t interOpThreads = 0;
+  bool pinThreads = false;
 };
 
 struct InferenceRequest {
@@ -7,6 +7,7 @@
 #include "pybind11/pybind11.h"
 #include "pybind11/stl.h"
 #include "tokenizer/Tokenizer.h"
+#include "util/ThreadPool.h"
 
 namespace py = pybind11;
 using namespace tinygpt;
@@ -14,6 +15,8 @@ using namespace tinygpt;
 // clang-format off
 
 PYBIND11_MODULE(_tinygpt, m) {
+  m.def("configure_threads", &ThreadPool::configureGlobal, py::arg("num_threads"), py::arg("pin") = false);
+
   // Tokenizer
   py::class_<tokenizer::Tokenizer>(m, "Tokenizer")
       .def(py::init<>())
@@ -21,6 +24,7 @@ PYBIND11_MODULE(_tinygpt, m) {
       .def("token_to_id", &tokenizer::Tokenizer::token2Id, py::arg("token"))
       .def("id_to_token", &tokenizer::Tokenizer::id2Token, py::arg("id"))
       .def("encode", &tokenizer::Tokenizer::encode, py::arg("text"), py::arg("allow_added_tokens") = true)
+      .def_property("parallel_chunk_size", &tokenizer::Tokenizer::parallelChunkSize, &tokenizer::Tokenizer::setParallelChunkSize)
       .def("encode_batch", py::overload_cast<const std::vector<std::string>&, uint32_t, bool>(&tokenizer::Tokenizer::encodeBatch), py::arg("texts"), py::arg("num_threads") = 8, py::arg("allow_added_tokens") = true)
       .def("decode", py::overload_cast<const std::vector<int32_t>&, uint32_t>(&tokenizer::Tokenizer::decode), py::arg("ids"), py::arg("offset") = 0)
       .def("decode_batch", py::overload_cast<const std::vector<std::vector<int32_t>>&, uint32_t>(&tokenizer::Tokenizer::decodeBatch), py::arg("ids"), py::arg("num_threads") = 8)
@@ -6,7 +6,10 @@
 
 #pragma once
 
+#include <algorithm>
+
 #include "Functions.h"
+#include "util/HugePages.h"
 
 namespace tinygpt {
 
@@ -17,6 +20,9 @@ struct KVCacheStates {
 
 class KVCacheManager {
  public:
+  // initial capacity (positions) of a preallocated layer cache
+  static constexpr int64_t kMinSlotCapacity = 256;
+
   void create(size_t numLayers) { cache_.resize(numLayers); }
 
   void reset() { cache_.clear(); }
@@ -24,34 +30,75 @@ class KVCacheManager {
   KVCacheStates append(size_t layerIdx, const tinytorch::TensorPair &kv, int64_t seqLenDim = 2) {
     ASSERT(layerIdx < cache_.size());
     auto &cached = cache_[layerIdx];
-    int64_t pastLength = 0;
+    int64_t pastLength = cached.length;
 
-    if (cached.first.defined()) {
-      ASSERT(cached.second.defined());
-
-      // pastLength
-      pastLength = cached.first.size(seqLenDim);
+    if (cached.kv.first.defined()) {
+      ASSERT(cached.kv.second.defined());
 
       // concat kv
-      cached.first = tinytorch::function::concat({cached.first, kv.first}, seqLenDim);
-      cached.second = tinytorch::function::concat({cached.second, kv.second}, seqLenDim);
+      cached.kv.first = tinytorch::function::concat({cached.kv.first, kv.first}, seqLenDim);
+      cached.kv.second = tinytorch::function::concat({cached.kv.second, kv.second}, seqLenDim);
     } else {
-      cached = kv;
+      cached.kv = kv;
     }
-    return {cached, pastLength};
+    cached.length = cached.kv.first.size(seqLenDim);
+    return {cached.kv, pastLength};
   }
 
-  int64_t pastLength(size_t layerIdx, int64_t seqLenDim = 2) const {
+  // Preallocated BSHD cache [B, capacity, Hkv, D], capacity grows geometrically.
+  // Reserves positions [pastLength, pastLength + numTokens) and returns the whole cache buffers,
+  // the caller writes K/V of the new tokens into these slots.
+  KVCacheStates reserve(size_t layerIdx, int64_t batch, int64_t numTokens, int64_t numKvHeads, int64_t headDim,
+                        const tinytorch::Options &options) {
     ASSERT(layerIdx < cache_.size());
-    auto &kv = cache_[layerIdx];
-    if (kv.first.defined()) {
-      return kv.first.size(seqLenDim);
+    auto &cached = cache_[layerIdx];
+    int64_t pastLength = cached.length;
+    int64_t required = pastLength + numTokens;
+
+    int64_t capacity = cached.kv.first.defined() ? cached.kv.first.size(1) : 0;
+    if (required > capacity) {
+      int64_t newCapacity = std::max({required, capacity * 2, kMinSlotCapacity});
+      tinytorch::TensorPair grown = {
+          tinytorch::Tensor::empty({batch, newCapacity, numKvHeads, headDim}, options),
+          tinytorch::Tensor::empty({batch, newCapacity, numKvHeads, headDim}, options),
+      };
+      tinygpt::HugePages::advise(grown.first);
+      tinygpt::HugePages::advise(grown.second);
+      if (pastLength > 0) {
+        ASSERT(cached.kv.first.size(0) == batch);
+        copySlots(grown.first, cached.kv.first, pastLength);
+        copySlots(grown.second, cached.kv.second, pastLength);
+      }
+      cached.kv = std::move(grown);
     }
-    return 0;
+
+    cached.length = required;
+    return {cached.kv, pastLength};
+  }
+
+  int64_t pastLength(size_t layerIdx) const {
+    ASSERT(layerIdx < cache_.size());
+    return cache_[layerIdx].length;
   }
 
  private:
-  std::vector<tinytorch::TensorPair> cache_;
+  struct LayerCache {
+    tinytorch::TensorPair kv;
+    int64_t length = 0;
+  };
+
+  // copy positions [0, length) of every batch between caches of different capacity
+  static void copySlots(tinytorch::Tensor &dst, tinytorch::Tensor &src, int64_t length) {
+    int64_t rowBytes = src.size(2) * src.size(3) * static_cast<int64_t>(tinytorch::dtypeSize(src.dtype()));
+    auto *dstPtr = static_cast<uint8_t *>(dst.dataPtr<>());
+    auto *srcPtr = static_cast<uint8_t *>(src.dataPtr<>());
+    for (int64_t b = 0; b < src.size(0); b++) {
+      tinytorch::Storage::copyOnDevice(dstPtr + b * dst.size(1) * rowBytes, dst.device(),
+                                       srcPtr + b * src.size(1) * rowBytes, src.device(), length * rowBytes);
+    }
+  }
+
+  std::vector<LayerCache> cache_;
 };
 
 }  // namespace tinygpt
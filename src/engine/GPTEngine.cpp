@@ -9,6 +9,9 @@
 #include <utility>
 
 #include "Functions.h"
+#include "util/HugePages.h"
+#include "util/Numa.h"
+#include "util/ThreadPool.h"
 
 namespace tt = tinytorch;
 
@@ -39,6 +42,19 @@ GPTEngine::GPTEngine(GPTConfig config) : config_(std::move(config)), sampler_(co
 GPTEngine::~GPTEngine() = default;
 
 bool GPTEngine::prepare() {
+  ThreadPool::configureGlobal(config_.intraOpThreads, config_.pinThreads);
+  if (config_.hugePages && config_.device.isCpu()) {
+    HugePages::setEnabled(true);
+  }
+  if (config_.numa && config_.device.isCpu()) {
+    if (config_.layerStreaming) {
+      // the node copies of the MLP weights are not in the checkpoint the streamer reads from
+      LOGE("Prepare failed: NUMA mode cannot be combined with layer streaming");
+      return false;
+    }
+    Numa::setEnabled(true);
+  }
+
   huggingface::ModelLoader loader;
   bool success = loader.load(config_.modelDir, config_.device, config_.dtype);
   if (!success) {
@@ -47,6 +63,15 @@ bool GPTEngine::prepare() {
   }
   context_ = loader.getContext();
 
+  if (config_.layerStreaming && !context_.model->enableLayerStreaming()) {
+    LOGE("Prepare failed: layer streaming not available");
+    return false;
+  }
+  if (Numa::enabled() && !context_.model->enableNumaLayout()) {
+    LOGE("Prepare failed: NUMA layout not available");
+    return false;
+  }
+
   if (context_.generationConfig) {
     for (auto id : context_.generationConfig->eosTokenIds) {
       baseEosTokenIds_.push_back(static_cast<int32_t>(id));
@@ -61,6 +86,9 @@ bool GPTEngine::prepare() {
   eosTokenIds_ = baseEosTokenIds_;
 
   tokenPipeline_ = createTokenPipeline(config_.device);
+  if (HugePages::enabled()) {
+    HugePages::logStats();
+  }
   return true;
 }
 
@@ -167,6 +195,13 @@ GPTOutput GPTEngine::generateSync(tt::ArrayView<std::string> texts) {
     tokens = tt::function::concat({tokens, nextToken}, 1);
   }
 
+  if (auto* streamer = context_.model->layerStreamer()) {
+    streamer->logStats();
+  }
+  if (HugePages::enabled()) {
+    HugePages::logStats();
+  }
+
   // skip eos check
   auto output = decodeTokens(tokens, inputTokenCnt);
   output.finishReason = FinishReason::Length;
@@ -29,6 +29,25 @@ struct GPTConfig {
 
   SamplerConfig samplerConfig;
   int64_t maxNewTokens = 16;
+
+  // CPU only, stream decoder layers from the mapped checkpoint for models larger than RAM (large batch prefill)
+  bool layerStreaming = false;
+
+  // CPU only, back weights, KV cache and activations with transparent huge pages
+  bool hugePages = false;
+
+  // CPU only, split the decoder MLP weights (gate/up/down) across NUMA nodes, each node keeping only its slice and
+  // running it on a pool pinned to its CPUs. Attention, QKV, o_proj, embeddings and lm_head stay node-agnostic.
+  // Not combinable with layerStreaming, no-op on a single node
+  bool numa = false;
+
+  // threads of the process-wide pool shared by CPU kernels and tokenizer, 0: hardware concurrency
+  uint32_t intraOpThreads = 0;
+  // requests accepted concurrently by a front end (the server's HTTP threads), 0: its default. They only queue work,
+  // generation runs one request at a time on the intra-op pool
+  uint32_t interOpThreads = 0;
+  // pin pool workers to CPUs
+  bool pinThreads = false;
 };
 
 struct GPTOutput {
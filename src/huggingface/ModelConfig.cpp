@@ -40,6 +40,29 @@ static std::string readFileToString(const std::string& filePath) {
   return buffer.str();
 }
 
+// keys not in `rope_scaling` keep the defaults of RopeScalingConfig
+static void parseRopeScaling(const rapidjson::Document& doc, RopeScalingConfig& cfg) {
+  cfg = RopeScalingConfig();
+  if (!doc.HasMember("rope_scaling") || !doc["rope_scaling"].IsObject()) {
+    return;
+  }
+  const auto& rope = doc["rope_scaling"];
+  cfg.factor = getJsonValue<float>(rope, "factor", cfg.factor);
+  cfg.highFreqFactor = getJsonValue<float>(rope, "high_freq_factor", cfg.highFreqFactor);
+  cfg.lowFreqFactor = getJsonValue<float>(rope, "low_freq_factor", cfg.lowFreqFactor);
+  cfg.originalMaxPositionEmbeddings =
+      getJsonValue<int64_t>(rope, "original_max_position_embeddings", cfg.originalMaxPositionEmbeddings);
+  // older configs use "type"
+  cfg.ropeType = getJsonValue<std::string>(rope, "rope_type", getJsonValue<std::string>(rope, "type", ""));
+
+  cfg.betaFast = getJsonValue<float>(rope, "beta_fast", cfg.betaFast);
+  cfg.betaSlow = getJsonValue<float>(rope, "beta_slow", cfg.betaSlow);
+  cfg.attentionFactor = getJsonValue<float>(rope, "attention_factor", cfg.attentionFactor);
+  cfg.mscale = getJsonValue<float>(rope, "mscale", cfg.mscale);
+  cfg.mscaleAllDim = getJsonValue<float>(rope, "mscale_all_dim", cfg.mscaleAllDim);
+  cfg.truncate = getJsonValue<bool>(rope, "truncate", cfg.truncate);
+}
+
 std::unique_ptr<ModelConfig> loadModelConfig(const std::string& cfgPath) {
   std::string jsonStr = readFileToString(cfgPath);
   if (jsonStr.empty()) {
@@ -76,20 +99,13 @@ std::unique_ptr<ModelConfig> loadModelConfig(const std::string& cfgPath) {
     cfg->headDim = getJsonValue<int64_t>(doc, "head_dim", -1);
 
     // rope
-    if (doc.HasMember("rope_scaling") && doc["rope_scaling"].IsObject()) {
-      const auto& rope = doc["rope_scaling"];
-      cfg->ropeScaling.factor = getJsonValue<float>(rope, "factor", 1.f);
-      cfg->ropeScaling.highFreqFactor = getJsonValue<float>(rope, "high_freq_factor", 1.f);
-      cfg->ropeScaling.lowFreqFactor = getJsonValue<float>(rope, "low_freq_factor", 1.f);
-      cfg->ropeScaling.originalMaxPositionEmbeddings =
-          getJsonValue<int64_t>(rope, "original_max_position_embeddings", -1);
-      cfg->ropeScaling.ropeType = getJsonValue<std::string>(rope, "rope_type", "");
-    }
+    parseRopeScaling(doc, cfg->ropeScaling);
     cfg->ropeTheta = getJsonValue<float>(doc, "rope_theta", 1.f);
     config = std::move(cfg);
   } else if (modelType == MODEL_TYPE_QWEN2 || modelType == MODEL_TYPE_QWEN3) {
     auto cfg = std::make_unique<QwenConfig>();
     cfg->ropeTheta = getJsonValue<float>(doc, "rope_theta", 10000.f);
+    parseRopeScaling(doc, cfg->ropeScaling);
     cfg->headDim = getJsonValue<int64_t>(doc, "head_dim", -1);
     cfg->slidingWindow = getJsonValue<int64_t>(doc, "sliding_window", -1);
     cfg->useSlidingWindow = getJsonValue<bool>(doc, "use_sliding_window", false);
@@ -98,6 +114,7 @@ std::unique_ptr<ModelConfig> loadModelConfig(const std::string& cfgPath) {
   } else if (modelType == MODEL_TYPE_MISTRAL) {
     auto cfg = std::make_unique<MistralConfig>();
     cfg->ropeTheta = getJsonValue<float>(doc, "rope_theta", 10000.0f);
+    parseRopeScaling(doc, cfg->ropeScaling);
     cfg->slidingWindow = getJsonValue<int64_t>(doc, "sliding_window", -1);
     cfg->useSlidingWindow = cfg->slidingWindow > 0;
     config = std::move(cfg);
@@ -50,23 +50,36 @@ struct GPT2Config : ModelConfig {
   int64_t nPositions;
 };
 
+// `rope_scaling` entry, ropeType empty when not set
+struct RopeScalingConfig {
+  float factor = 1.f;
+  float highFreqFactor = 1.f;
+  float lowFreqFactor = 1.f;
+  int64_t originalMaxPositionEmbeddings = -1;
+  std::string ropeType;
+
+  // yarn, betaFast/betaSlow default to 32/1, the others are <= 0 when not set
+  float betaFast = 32.f;
+  float betaSlow = 1.f;
+  float attentionFactor = -1.f;
+  float mscale = -1.f;
+  float mscaleAllDim = -1.f;
+  bool truncate = true;
+};
+
 struct LlamaConfig : ModelConfig {
   bool attentionBias;
   int64_t headDim;
 
-  struct RopeScalingConfig {
-    float factor;
-    float highFreqFactor;
-    float lowFreqFactor;
-    int64_t originalMaxPositionEmbeddings;
-    std::string ropeType;
-  } ropeScaling;
+  using RopeScalingConfig = model::RopeScalingConfig;
+  RopeScalingConfig ropeScaling;
 
   float ropeTheta;
 };
 
 struct QwenConfig : ModelConfig {
   float ropeTheta;
+  RopeScalingConfig ropeScaling;
   int64_t headDim;
   int64_t slidingWindow;
   bool useSlidingWindow;
@@ -75,6 +88,7 @@ struct QwenConfig : ModelConfig {
 
 struct MistralConfig : ModelConfig {
   float ropeTheta;
+  RopeScalingConfig ropeScaling;
   int64_t slidingWindow;
   bool useSlidingWindow;
 };
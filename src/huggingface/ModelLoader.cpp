@@ -6,11 +6,20 @@
 
 #include "ModelLoader.h"
 
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "JsonHelper.h"
+#include "Utils/Timer.h"
 #include "model/ModelGPT2.h"
 #include "model/ModelLlama.h"
 #include "model/ModelMistral.h"
 #include "model/ModelQwen2.h"
 #include "model/ModelQwen3.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#include "util/HugePages.h"
 #include "util/PathUtils.h"
 
 namespace tinygpt::huggingface {
@@ -21,8 +30,56 @@ constexpr const char* kTokenizerPath = "tokenizer.json";
 constexpr const char* kTokenizerConfigPath = "tokenizer_config.json";
 constexpr const char* kModelPath = "model.safetensors";
 constexpr const char* kModelIndexPath = "model.safetensors.index.json";
+constexpr const char* kArtifactManifestPath = "tinygpt.json";
+constexpr int32_t kArtifactVersion = 1;
+
+static bool copyFile(const std::string& src, const std::string& dst) {
+  std::ifstream ifs(src, std::ios::binary);
+  if (!ifs.is_open()) {
+    return false;
+  }
+  std::ofstream ofs(dst, std::ios::binary);
+  if (!ofs.is_open()) {
+    LOGE("Error open file: %s", dst.c_str());
+    return false;
+  }
+  ofs << ifs.rdbuf();
+  return ofs.good();
+}
+
+// artifact written by `saveArtifact`, warn when it is loaded in another dtype (weights are then converted)
+static void checkArtifact(const std::string& dir, tinytorch::DType dtype) {
+  std::ifstream ifs(PathUtils::joinPath(dir, kArtifactManifestPath), std::ios::binary);
+  if (!ifs.is_open()) {
+    return;
+  }
+  std::stringstream buffer;
+  buffer << ifs.rdbuf();
+  rapidjson::Document doc;
+  doc.Parse(buffer.str().c_str());
+  if (doc.HasParseError()) {
+    LOGW("Invalid artifact manifest: %s", kArtifactManifestPath);
+    return;
+  }
+  auto version = json::getJsonValue<int32_t>(doc, "version", 0);
+  auto artifactDtype = json::getJsonValue<std::string>(doc, "dtype", "");
+  LOGI("TinyGPT artifact, version: %d, dtype: %s", version, artifactDtype.c_str());
+  if (version != kArtifactVersion) {
+    LOGW("Artifact version %d, expected %d", version, kArtifactVersion);
+  }
+  if (artifactDtype != tinytorch::dtypeToString(dtype)) {
+    LOGW("Artifact dtype %s, requested %s, weights are converted while loading", artifactDtype.c_str(),
+         tinytorch::dtypeToString(dtype));
+  }
+}
 
 bool ModelLoader::load(const std::string& dir, tinytorch::Device device, tinytorch::DType dtype) {
+  tinytorch::Timer totalTimer;
+  totalTimer.start();
+  dir_ = dir;
+  dtype_ = dtype;
+  checkArtifact(dir, dtype);
+
   // model config
   context_.modelConfig = model::loadModelConfig(PathUtils::joinPath(dir, kModelConfigPath));
   if (!context_.modelConfig) {
@@ -37,55 +94,123 @@ bool ModelLoader::load(const std::string& dir, tinytorch::Device device, tinytor
     return false;
   }
 
-  // tokenizer
+  // tokenizer, parsed on its own thread while the model is built and its weights are loaded
   context_.tokenizer = std::make_unique<tokenizer::Tokenizer>();
-  bool success = context_.tokenizer->initWithConfig(PathUtils::joinPath(dir, kTokenizerPath),
-                                                    PathUtils::joinPath(dir, kTokenizerConfigPath));
-  if (!success) {
+  bool tokenizerLoaded = false;
+  std::thread tokenizerThread([&] {
+    tinytorch::Timer timer;
+    timer.start();
+    tokenizerLoaded = context_.tokenizer->initWithConfig(PathUtils::joinPath(dir, kTokenizerPath),
+                                                         PathUtils::joinPath(dir, kTokenizerConfigPath));
+    timer.mark();
+    LOGI("Load tokenizer cost: %lld ms", timer.elapseMillis());
+  });
+
+  bool modelLoaded = loadModel(dir, device, dtype);
+  tokenizerThread.join();
+  if (!tokenizerLoaded) {
     LOGE("Failed to load tokenizer");
     return false;
   }
+  if (!modelLoaded) {
+    return false;
+  }
 
-  // model
+  totalTimer.mark();
+  LOGI("Load done, total cost: %lld ms", totalTimer.elapseMillis());
+  return true;
+}
+
+bool ModelLoader::loadModel(const std::string& dir, tinytorch::Device device, tinytorch::DType dtype) {
+  tinytorch::Timer timer;
+  timer.start();
+
+  // model, built in the target dtype, weights are converted while copied from the checkpoint
   if (context_.modelConfig->modelType == model::MODEL_TYPE_GPT2) {
     auto* config = dynamic_cast<model::GPT2Config*>(context_.modelConfig.get());
-    context_.model = std::make_unique<ModelGPT2>(*config, device);
+    context_.model = std::make_unique<ModelGPT2>(*config, device, dtype);
   } else if (context_.modelConfig->modelType == model::MODEL_TYPE_LLAMA) {
     auto* config = dynamic_cast<model::LlamaConfig*>(context_.modelConfig.get());
-    context_.model = std::make_unique<ModelLlama>(*config, device);
+    context_.model = std::make_unique<ModelLlama>(*config, device, dtype);
   } else if (context_.modelConfig->modelType == model::MODEL_TYPE_QWEN2) {
     auto* config = dynamic_cast<model::QwenConfig*>(context_.modelConfig.get());
-    context_.model = std::make_unique<ModelQwen2>(*config, device);
+    context_.model = std::make_unique<ModelQwen2>(*config, device, dtype);
   } else if (context_.modelConfig->modelType == model::MODEL_TYPE_QWEN3) {
     auto* config = dynamic_cast<model::QwenConfig*>(context_.modelConfig.get());
-    context_.model = std::make_unique<ModelQwen3>(*config, device);
+    context_.model = std::make_unique<ModelQwen3>(*config, device, dtype);
   } else if (context_.modelConfig->modelType == model::MODEL_TYPE_MISTRAL) {
     auto* config = dynamic_cast<model::MistralConfig*>(context_.modelConfig.get());
-    context_.model = std::make_unique<ModelMistral>(*config, device);
+    context_.model = std::make_unique<ModelMistral>(*config, device, dtype);
   } else {
     LOGE("model type not support: %s", context_.modelConfig->modelType.c_str());
     return false;
   }
+  timer.mark();
+  LOGI("Build model cost: %lld ms", timer.elapseMillis());
 
-  // load model from file
+  // advised before the weights are copied in, states aliased to the checkpoint release this memory
+  if (HugePages::enabled() && device.isCpu()) {
+    for (const auto& [name, tensor] : context_.model->model().namedStates()) {
+      HugePages::advise(*tensor);
+    }
+  }
+
+  // load model from file, shards and large tensors are loaded in parallel
   LOGI("Load model ...");
+  timer.start();
   auto modelPath = PathUtils::joinPath(dir, kModelPath);
   if (!PathUtils::fileExists(modelPath)) {
     modelPath = PathUtils::joinPath(dir, kModelIndexPath);
   }
-  success = context_.model->load(modelPath);
-  if (!success) {
+  if (!context_.model->load(modelPath)) {
     LOGE("Load model failed: %s", modelPath.c_str());
     return false;
   }
-  LOGI("Load model done.");
-
-  // convert dtype
-  context_.model->model().to(dtype);
+  timer.mark();
+  LOGI("Load model weights cost: %lld ms", timer.elapseMillis());
 
   // set model eval
   context_.model->model().eval();
   return true;
 }
 
+bool ModelLoader::saveArtifact(const std::string& outDir) {
+  if (!context_.model) {
+    LOGE("No model loaded");
+    return false;
+  }
+
+  // configs and tokenizer files are kept as is, they are cheap to parse compared to the weights
+  for (const char* file : {kModelConfigPath, kGenerationConfigPath, kTokenizerPath, kTokenizerConfigPath}) {
+    if (!copyFile(PathUtils::joinPath(dir_, file), PathUtils::joinPath(outDir, file))) {
+      LOGE("Copy file failed: %s", file);
+      return false;
+    }
+  }
+
+  // single file in the model dtype, the parts of merged weights (QKV, gate-up) are stored one after another,
+  // so the merged weight aliases them as a whole
+  auto modelPath = PathUtils::joinPath(outDir, kModelPath);
+  if (!context_.model->save(modelPath)) {
+    LOGE("Save model failed: %s", modelPath.c_str());
+    return false;
+  }
+
+  rapidjson::Document doc(rapidjson::kObjectType);
+  auto& allocator = doc.GetAllocator();
+  doc.AddMember("version", kArtifactVersion, allocator);
+  doc.AddMember("dtype", rapidjson::Value(tinytorch::dtypeToString(dtype_), allocator), allocator);
+  rapidjson::StringBuffer sb;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
+  doc.Accept(writer);
+
+  std::ofstream ofs(PathUtils::joinPath(outDir, kArtifactManifestPath), std::ios::binary);
+  if (!ofs.is_open()) {
+    LOGE("Error open file: %s", kArtifactManifestPath);
+    return false;
+  }
+  ofs << sb.GetString();
+  return ofs.good();
+}
+
 }  // namespace tinygpt::huggingface
\ No newline at end of file
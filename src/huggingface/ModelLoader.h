@@ -24,10 +24,19 @@ class ModelLoader {
  public:
   bool load(const std::string &dir, tinytorch::Device device, tinytorch::DType dtype);
 
+  // Write the loaded model as a TinyGPT artifact directory: configs, tokenizer files and all weights in the model
+  // dtype as one safetensors file. Loading it needs no conversion and CPU weights, merged QKV / gate-up included,
+  // alias the mapped pages.
+  bool saveArtifact(const std::string &outDir);
+
   GPTContext &&getContext() { return std::move(context_); }
 
  private:
+  bool loadModel(const std::string &dir, tinytorch::Device device, tinytorch::DType dtype);
+
   GPTContext context_;
+  std::string dir_;
+  tinytorch::DType dtype_ = tinytorch::DType::Float32;
 };
 
 }  // namespace tinygpt::huggingface
@@ -277,6 +277,42 @@ static std::unique_ptr<Config> parseConfig(const rapidjson::Value& j, const std:
   return nullptr;
 }
 
+// BPE after a ByteLevel pre-tokenizer works on raw bytes directly: the vocab is converted once at load,
+// and the pre-tokenizer keeps the original text instead of remapping every byte
+static void linkByteLevel(TokenizerConfig& cfg) {
+  if (!cfg.preTokenizer || !cfg.model || cfg.model->type != ComponentType::BPE) {
+    return;
+  }
+
+  // ByteLevel must be the last pre-tokenizer step, and the only one
+  Config* last = cfg.preTokenizer.get();
+  if (last->type == ComponentType::SEQUENCE) {
+    auto* seq = dynamic_cast<ConfigSequence*>(last);
+    if (seq->configs.empty()) {
+      return;
+    }
+    for (size_t i = 0; i + 1 < seq->configs.size(); i++) {
+      if (seq->configs[i] && seq->configs[i]->type == ComponentType::BYTE_LEVEL) {
+        return;
+      }
+    }
+    last = seq->configs.back().get();
+  }
+  if (!last || last->type != ComponentType::BYTE_LEVEL) {
+    return;
+  }
+
+  auto* bpe = dynamic_cast<ConfigBPE*>(cfg.model.get());
+  std::string raw;
+  for (auto& [token, id] : bpe->vocab) {
+    if (!ByteLevel::remappedToBytes(token, raw)) {
+      return;
+    }
+  }
+  bpe->byteLevel = true;
+  dynamic_cast<ConfigByteLevel*>(last)->rawBytes = true;
+}
+
 static bool loadTokenizer(TokenizerConfig& cfg, const std::string& tokenizerPath) {
   std::ifstream in(tokenizerPath, std::ios::binary);
   if (!in) {
@@ -330,6 +366,7 @@ static bool loadTokenizer(TokenizerConfig& cfg, const std::string& tokenizerPath
     cfg.decoder = parseConfig(j["decoder"]);
   }
 
+  linkByteLevel(cfg);
   return true;
 }
 
@@ -385,7 +422,9 @@ static std::unique_ptr<Component> createSplit(const std::unique_ptr<Config>& cfg
     return nullptr;
   }
   auto* config = dynamic_cast<ConfigSplit*>(cfg.get());
-  auto split = std::make_unique<Split>(config->pattern, config->behavior, config->invert);
+  // known HuggingFace patterns run on the hand-written matcher instead of pcre2
+  auto builtin = SplitMatcher::recognize(config->pattern);
+  auto split = std::make_unique<Split>(config->pattern, config->behavior, config->invert, builtin);
   return std::move(split);
 }
 
@@ -394,7 +433,8 @@ static std::unique_ptr<Component> createByteLevel(const std::unique_ptr<Config>&
     return nullptr;
   }
   auto* config = dynamic_cast<ConfigByteLevel*>(cfg.get());
-  auto byteLevel = std::make_unique<ByteLevel>(config->addPrefixSpace, config->useRegex);  // ignore 'trimOffsets'
+  // ignore 'trimOffsets'
+  auto byteLevel = std::make_unique<ByteLevel>(config->addPrefixSpace, config->useRegex, config->rawBytes);
   return std::move(byteLevel);
 }
 
@@ -403,7 +443,7 @@ static std::unique_ptr<Component> createBPE(const std::unique_ptr<Config>& cfg)
     return nullptr;
   }
   auto* config = dynamic_cast<ConfigBPE*>(cfg.get());
-  auto bpe = std::make_unique<BPE>(config->vocab, config->merges, config->ignoreMerges);
+  auto bpe = std::make_unique<BPE>(config->vocab, config->merges, config->ignoreMerges, true, config->byteLevel);
   return std::move(bpe);
 }
 
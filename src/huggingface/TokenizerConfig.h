@@ -35,6 +35,7 @@ struct ConfigByteLevel : Config {
   bool addPrefixSpace;
   bool trimOffsets;
   bool useRegex;
+  bool rawBytes = false;  // pre-tokenizer of a raw-byte BPE, skip the unicode remap
 };
 
 struct ConfigSplit : Config {
@@ -45,6 +46,7 @@ struct ConfigSplit : Config {
 
 struct ConfigBPE : Config {
   bool ignoreMerges;
+  bool byteLevel = false;  // vocab in byte-level remap form, converted to raw bytes at load
   ankerl::unordered_dense::map<std::string, int32_t> vocab;
   ankerl::unordered_dense::map<tinygpt::tokenizer::StringPair, int32_t, tinygpt::tokenizer::StringPairHash> merges;
 };
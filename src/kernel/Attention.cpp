@@ -0,0 +1,350 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#include "Attention.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "Vec.h"
+#include "util/ThreadPool.h"
+
+namespace tinygpt::kernel {
+
+constexpr int64_t kDecodeBlockSize = 32;
+constexpr int64_t kDecodeMinSplitLen = 256;
+
+// online softmax state of one query head over a KV slice
+struct SoftmaxPartial {
+  float *acc;  // [headDim]
+  float max;
+  float sum;
+};
+
+template <typename T>
+static void attendSlice(const float *q, const T *key, const T *value, int64_t kvBegin, int64_t kvEnd, int64_t groupSize,
+                        const DecodeAttentionParams &p, SoftmaxPartial *partials, float *scores) {
+  const int64_t D = p.headDim;
+  for (int64_t g = 0; g < groupSize; g++) {
+    std::fill(partials[g].acc, partials[g].acc + D, 0.f);
+    partials[g].max = -std::numeric_limits<float>::infinity();
+    partials[g].sum = 0.f;
+  }
+
+  for (int64_t blockBegin = kvBegin; blockBegin < kvEnd; blockBegin += kDecodeBlockSize) {
+    int64_t blockLen = std::min(kDecodeBlockSize, kvEnd - blockBegin);
+
+    // scores [groupSize, blockLen], K and V rows are read in the cache dtype, converted in registers
+    for (int64_t j = 0; j < blockLen; j++) {
+      const T *k = key + (blockBegin + j) * p.kvSeqStride;
+      for (int64_t g = 0; g < groupSize; g++) {
+        scores[g * kDecodeBlockSize + j] = vecDot(q + g * D, k, D);
+      }
+    }
+
+    // rescale accumulators once per block
+    for (int64_t g = 0; g < groupSize; g++) {
+      float *s = scores + g * kDecodeBlockSize;
+      float blockMax = *std::max_element(s, s + blockLen);
+      float newMax = std::max(partials[g].max, blockMax);
+      if (newMax > partials[g].max) {
+        float factor = std::exp(partials[g].max - newMax);
+        vecScale(partials[g].acc, factor, D);
+        partials[g].sum *= factor;
+        partials[g].max = newMax;
+      }
+      for (int64_t j = 0; j < blockLen; j++) {
+        s[j] = std::exp(s[j] - newMax);
+        partials[g].sum += s[j];
+      }
+    }
+
+    for (int64_t j = 0; j < blockLen; j++) {
+      const T *v = value + (blockBegin + j) * p.kvSeqStride;
+      for (int64_t g = 0; g < groupSize; g++) {
+        vecAxpy(partials[g].acc, v, scores[g * kDecodeBlockSize + j], D);
+      }
+    }
+  }
+}
+
+template <typename T>
+void decodeAttention(const T *query, const T *key, const T *value, T *out, const DecodeAttentionParams &p) {
+  const int64_t D = p.headDim;
+  const int64_t groupSize = p.numHeads / p.numKvHeads;
+  const int64_t numGroups = p.batch * p.numKvHeads;
+  if (numGroups == 0 || D == 0) {
+    return;
+  }
+
+  auto &pool = ThreadPool::global();
+
+  // split the KV range only when there are not enough groups to keep all threads busy
+  int64_t numSplits = 1;
+  if (p.numSplits > 0) {
+    numSplits = std::min(p.numSplits, std::max<int64_t>(p.kvLen, 1));
+  } else if (numGroups < pool.numThreads() && p.kvLen >= 2 * kDecodeMinSplitLen) {
+    numSplits = std::min<int64_t>((pool.numThreads() + numGroups - 1) / numGroups, p.kvLen / kDecodeMinSplitLen);
+  }
+  const int64_t splitLen = (p.kvLen + numSplits - 1) / numSplits;
+
+  // partial results: [numGroups, numSplits, groupSize] x (acc[D], max, sum)
+  const int64_t numPartials = numGroups * numSplits * groupSize;
+  std::vector<float> partialAcc(numSplits > 1 ? numPartials * D : 0);
+  std::vector<float> partialMax(numSplits > 1 ? numPartials : 0);
+  std::vector<float> partialSum(numSplits > 1 ? numPartials : 0);
+
+  pool.parallelFor(numGroups * numSplits, 1, [&](int64_t begin, int64_t end) {
+    std::vector<float> qBuf(groupSize * D);
+    std::vector<float> scores(groupSize * kDecodeBlockSize);
+    std::vector<float> accBuf(numSplits > 1 ? 0 : groupSize * D);
+    std::vector<SoftmaxPartial> partials(groupSize);
+
+    for (int64_t task = begin; task < end; task++) {
+      int64_t group = task / numSplits;
+      int64_t split = task % numSplits;
+      int64_t b = group / p.numKvHeads;
+      int64_t kvh = group % p.numKvHeads;
+      int64_t kvBegin = split * splitLen;
+      int64_t kvEnd = std::min(p.kvLen, kvBegin + splitLen);
+
+      // query heads [kvh * groupSize, (kvh + 1) * groupSize) are contiguous in [B, H, D]
+      const T *q = query + (b * p.numHeads + kvh * groupSize) * D;
+      for (int64_t i = 0; i < groupSize * D; i++) {
+        qBuf[i] = toFloat(q[i]) * p.scale;
+      }
+
+      for (int64_t g = 0; g < groupSize; g++) {
+        partials[g].acc = numSplits > 1 ? &partialAcc[(task * groupSize + g) * D] : &accBuf[g * D];
+      }
+
+      const int64_t kvOffset = b * p.kvBatchStride + kvh * D;
+      attendSlice(qBuf.data(), key + kvOffset, value + kvOffset, kvBegin, kvEnd, groupSize, p, partials.data(),
+                  scores.data());
+
+      if (numSplits > 1) {
+        for (int64_t g = 0; g < groupSize; g++) {
+          partialMax[task * groupSize + g] = partials[g].max;
+          partialSum[task * groupSize + g] = partials[g].sum;
+        }
+        continue;
+      }
+
+      T *o = out + (b * p.numHeads + kvh * groupSize) * D;
+      for (int64_t g = 0; g < groupSize; g++) {
+        float inv = partials[g].sum > 0.f ? 1.f / partials[g].sum : 0.f;
+        vecScale(partials[g].acc, inv, D);
+        storeRow(partials[g].acc, o + g * D, D);
+      }
+    }
+  });
+
+  if (numSplits == 1) {
+    return;
+  }
+
+  // merge splits with log-sum-exp
+  pool.parallelFor(numGroups * groupSize, 1, [&](int64_t begin, int64_t end) {
+    std::vector<float> acc(D);
+    for (int64_t idx = begin; idx < end; idx++) {
+      int64_t group = idx / groupSize;
+      int64_t g = idx % groupSize;
+      int64_t b = group / p.numKvHeads;
+      int64_t kvh = group % p.numKvHeads;
+
+      float globalMax = -std::numeric_limits<float>::infinity();
+      for (int64_t s = 0; s < numSplits; s++) {
+        globalMax = std::max(globalMax, partialMax[(group * numSplits + s) * groupSize + g]);
+      }
+      std::fill(acc.begin(), acc.end(), 0.f);
+      float sum = 0.f;
+      for (int64_t s = 0; s < numSplits; s++) {
+        int64_t pIdx = (group * numSplits + s) * groupSize + g;
+        if (partialSum[pIdx] == 0.f) {
+          continue;
+        }
+        float factor = std::exp(partialMax[pIdx] - globalMax);
+        sum += partialSum[pIdx] * factor;
+        vecAxpy(acc.data(), &partialAcc[pIdx * D], factor, D);
+      }
+      vecScale(acc.data(), sum > 0.f ? 1.f / sum : 0.f, D);
+      storeRow(acc.data(), out + (b * p.numHeads + kvh * groupSize + g) * D, D);
+    }
+  });
+}
+
+constexpr int64_t kPrefillKvTile = 64;
+constexpr int64_t kPrefillQueryVectors = 64;
+
+// head dim sized vector ops, unrolled at compile time for HeadDim > 0, otherwise of length d
+template <int64_t HeadDim>
+static inline float headDot(const float *a, const float *b, int64_t d) {
+  if constexpr (HeadDim > 0) {
+    return vecDotFixed<HeadDim>(a, b);
+  } else {
+    return vecDot(a, b, d);
+  }
+}
+
+template <int64_t HeadDim>
+static inline void headAxpy(float *y, const float *x, float alpha, int64_t d) {
+  if constexpr (HeadDim > 0) {
+    vecAxpyFixed<HeadDim>(y, x, alpha);
+  } else {
+    vecAxpy(y, x, alpha, d);
+  }
+}
+
+template <int64_t HeadDim>
+static inline void headScale(float *y, float alpha, int64_t d) {
+  if constexpr (HeadDim > 0) {
+    vecScaleFixed<HeadDim>(y, alpha);
+  } else {
+    vecScale(y, alpha, d);
+  }
+}
+
+// HeadDim > 0 fixes the head dim at compile time, 0 reads it from params
+template <int64_t HeadDim, typename T>
+static void prefillAttentionImpl(const T *query, const T *key, const T *value, T *out,
+                                 const PrefillAttentionParams &p) {
+  const int64_t D = HeadDim > 0 ? HeadDim : p.headDim;
+  const int64_t groupSize = p.numHeads / p.numKvHeads;
+  const int64_t numGroups = p.batch * p.numKvHeads;
+
+  // one task = a tile of query rows for all heads of a KV group, so a K/V tile is converted once per group
+  const int64_t tileRows = std::max<int64_t>(4, kPrefillQueryVectors / groupSize);
+  const int64_t numRowTiles = (p.qLen + tileRows - 1) / tileRows;
+  const int64_t causalOffset = p.kvLen - p.qLen;
+
+  ThreadPool::global().parallelFor(numGroups * numRowTiles, 1, [&](int64_t begin, int64_t end) {
+    const int64_t maxVectors = tileRows * groupSize;
+    std::vector<float> qBuf(maxVectors * D);
+    std::vector<float> acc(maxVectors * D);
+    std::vector<float> rowMax(maxVectors);
+    std::vector<float> rowSum(maxVectors);
+    std::vector<float> kBuf(kPrefillKvTile * D);
+    std::vector<float> vBuf(kPrefillKvTile * D);
+    float scores[kPrefillKvTile];
+
+    for (int64_t task = begin; task < end; task++) {
+      int64_t group = task / numRowTiles;
+      int64_t rowBegin = (task % numRowTiles) * tileRows;
+      int64_t rowEnd = std::min(p.qLen, rowBegin + tileRows);
+      int64_t b = group / p.numKvHeads;
+      int64_t kvh = group % p.numKvHeads;
+      int64_t numVectors = (rowEnd - rowBegin) * groupSize;
+
+      // query vector index: (row - rowBegin) * groupSize + g
+      for (int64_t i = rowBegin; i < rowEnd; i++) {
+        const T *q = query + b * p.qBatchStride + i * p.qSeqStride + kvh * groupSize * D;
+        float *dst = &qBuf[(i - rowBegin) * groupSize * D];
+        for (int64_t j = 0; j < groupSize * D; j++) {
+          dst[j] = toFloat(q[j]) * p.scale;
+        }
+      }
+      std::fill(acc.begin(), acc.begin() + numVectors * D, 0.f);
+      std::fill(rowMax.begin(), rowMax.begin() + numVectors, -std::numeric_limits<float>::infinity());
+      std::fill(rowSum.begin(), rowSum.begin() + numVectors, 0.f);
+
+      const T *kBase = key + b * p.kvBatchStride + kvh * D;
+      const T *vBase = value + b * p.kvBatchStride + kvh * D;
+      int64_t kvEnd = p.causal ? std::min(p.kvLen, rowEnd + causalOffset) : p.kvLen;
+
+      for (int64_t c0 = 0; c0 < kvEnd; c0 += kPrefillKvTile) {
+        int64_t c1 = std::min(kvEnd, c0 + kPrefillKvTile);
+        for (int64_t j = c0; j < c1; j++) {
+          float *kDst = &kBuf[(j - c0) * D];
+          float *vDst = &vBuf[(j - c0) * D];
+          const T *kRow = kBase + j * p.kvSeqStride;
+          const T *vRow = vBase + j * p.kvSeqStride;
+          for (int64_t d = 0; d < D; d++) {
+            kDst[d] = toFloat(kRow[d]);
+            vDst[d] = toFloat(vRow[d]);
+          }
+        }
+
+        for (int64_t i = rowBegin; i < rowEnd; i++) {
+          int64_t limit = p.causal ? std::min(c1, i + causalOffset + 1) : c1;
+          int64_t n = limit - c0;
+          if (n <= 0) {
+            continue;
+          }
+          for (int64_t g = 0; g < groupSize; g++) {
+            int64_t vecIdx = (i - rowBegin) * groupSize + g;
+            const float *q = &qBuf[vecIdx * D];
+            float *a = &acc[vecIdx * D];
+
+            float tileMax = -std::numeric_limits<float>::infinity();
+            for (int64_t j = 0; j < n; j++) {
+              scores[j] = headDot<HeadDim>(q, &kBuf[j * D], D);
+              tileMax = std::max(tileMax, scores[j]);
+            }
+            if (tileMax > rowMax[vecIdx]) {
+              float factor = std::exp(rowMax[vecIdx] - tileMax);
+              headScale<HeadDim>(a, factor, D);
+              rowSum[vecIdx] *= factor;
+              rowMax[vecIdx] = tileMax;
+            }
+            for (int64_t j = 0; j < n; j++) {
+              float prob = std::exp(scores[j] - rowMax[vecIdx]);
+              rowSum[vecIdx] += prob;
+              headAxpy<HeadDim>(a, &vBuf[j * D], prob, D);
+            }
+          }
+        }
+      }
+
+      for (int64_t i = rowBegin; i < rowEnd; i++) {
+        T *o = out + b * p.qBatchStride + i * p.qSeqStride + kvh * groupSize * D;
+        for (int64_t g = 0; g < groupSize; g++) {
+          int64_t vecIdx = (i - rowBegin) * groupSize + g;
+          float *a = &acc[vecIdx * D];
+          headScale<HeadDim>(a, rowSum[vecIdx] > 0.f ? 1.f / rowSum[vecIdx] : 0.f, D);
+          storeRow(a, o + g * D, D);
+        }
+      }
+    }
+  });
+}
+
+template <typename T>
+void prefillAttention(const T *query, const T *key, const T *value, T *out, const PrefillAttentionParams &p) {
+  if (p.batch * p.numKvHeads == 0 || p.qLen == 0 || p.headDim == 0) {
+    return;
+  }
+  switch (p.headDim) {
+    case 64:
+      prefillAttentionImpl<64>(query, key, value, out, p);
+      break;
+    case 96:
+      prefillAttentionImpl<96>(query, key, value, out, p);
+      break;
+    case 128:
+      prefillAttentionImpl<128>(query, key, value, out, p);
+      break;
+    case 256:
+      prefillAttentionImpl<256>(query, key, value, out, p);
+      break;
+    default:
+      prefillAttentionImpl<0>(query, key, value, out, p);
+      break;
+  }
+}
+
+template void decodeAttention<float>(const float *, const float *, const float *, float *,
+                                     const DecodeAttentionParams &);
+template void decodeAttention<BF16>(const BF16 *, const BF16 *, const BF16 *, BF16 *, const DecodeAttentionParams &);
+template void decodeAttention<FP16>(const FP16 *, const FP16 *, const FP16 *, FP16 *, const DecodeAttentionParams &);
+
+template void prefillAttention<float>(const float *, const float *, const float *, float *,
+                                      const PrefillAttentionParams &);
+template void prefillAttention<BF16>(const BF16 *, const BF16 *, const BF16 *, BF16 *, const PrefillAttentionParams &);
+template void prefillAttention<FP16>(const FP16 *, const FP16 *, const FP16 *, FP16 *, const PrefillAttentionParams &);
+
+}  // namespace tinygpt::kernel
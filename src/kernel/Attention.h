@@ -0,0 +1,54 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "Numeric.h"
+
+namespace tinygpt::kernel {
+
+struct DecodeAttentionParams {
+  int64_t batch = 0;
+  int64_t numHeads = 0;
+  int64_t numKvHeads = 0;
+  int64_t headDim = 0;
+  int64_t kvLen = 0;
+  int64_t kvBatchStride = 0;  // elements between two batches of the K/V cache
+  int64_t kvSeqStride = 0;    // elements between two positions of the K/V cache
+  float scale = 1.f;
+  int64_t numSplits = 0;  // KV range splits per head group, 0: decided by thread count
+};
+
+// Single token attention against a [B, kvLen, Hkv, D] cache.
+// query/out: [B, H, D], all query heads sharing a KV head are processed together so each K/V row is read once,
+// long KV ranges are split across threads and merged with a log-sum-exp reduction.
+template <typename T>
+void decodeAttention(const T *query, const T *key, const T *value, T *out, const DecodeAttentionParams &p);
+
+struct PrefillAttentionParams {
+  int64_t batch = 0;
+  int64_t numHeads = 0;
+  int64_t numKvHeads = 0;
+  int64_t headDim = 0;
+  int64_t qLen = 0;
+  int64_t kvLen = 0;
+  int64_t qBatchStride = 0;   // elements between two batches of query/out
+  int64_t qSeqStride = 0;     // elements between two positions of query/out
+  int64_t kvBatchStride = 0;  // elements between two batches of the K/V cache
+  int64_t kvSeqStride = 0;    // elements between two positions of the K/V cache
+  float scale = 1.f;
+  bool causal = true;  // bottom-right aligned: query i sees keys [0, i + kvLen - qLen]
+};
+
+// Tiled flash attention for prompt processing, query/out: [B, qLen, H, D], key/value: [B, kvLen, Hkv, D].
+// Scores are never materialized beyond one [qTile, kvTile] block, so memory stays O(seq).
+// Head dims 64/96/128/256 are compiled with a fixed inner loop length, others use the generic path.
+template <typename T>
+void prefillAttention(const T *query, const T *key, const T *value, T *out, const PrefillAttentionParams &p);
+
+}  // namespace tinygpt::kernel
@@ -0,0 +1,125 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#include "Convert.h"
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+#include "Vec.h"
+#include "util/ThreadPool.h"
+
+namespace tinygpt::kernel {
+
+// elements per parallel chunk, large enough to amortize scheduling
+constexpr int64_t kConvertGrain = 1 << 16;
+// float staging block for conversions between the two 16-bit types
+constexpr int64_t kConvertBlock = 1024;
+
+static void convertRange(const float *src, BF16 *dst, int64_t n) {
+  int64_t i = 0;
+#if defined(TINYGPT_VEC_AVX2)
+  const __m256i roundBias = _mm256_set1_epi32(0x7fff);
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i absMask = _mm256_set1_epi32(0x7fffffff);
+  const __m256i infBits = _mm256_set1_epi32(0x7f800000);
+  const __m256i quietBit = _mm256_set1_epi32(0x400000);
+  auto roundBf16 = [&](__m256 x) {
+    __m256i u = _mm256_castps_si256(x);
+    __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(u, 16), one);
+    __m256i rounded = _mm256_add_epi32(u, _mm256_add_epi32(roundBias, lsb));
+    __m256i isNan = _mm256_cmpgt_epi32(_mm256_and_si256(u, absMask), infBits);
+    return _mm256_srli_epi32(_mm256_blendv_epi8(rounded, _mm256_or_si256(u, quietBit), isNan), 16);
+  };
+  for (const int64_t nVec = n - n % 16; i < nVec; i += 16) {
+    __m256i lo = roundBf16(_mm256_loadu_ps(src + i));
+    __m256i hi = roundBf16(_mm256_loadu_ps(src + i + 8));
+    // packus interleaves the 128-bit lanes, permute restores element order
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xd8);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), packed);
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i].bits = floatToBf16(src[i]);
+  }
+}
+
+static void convertRange(const BF16 *src, float *dst, int64_t n) {
+  int64_t i = 0;
+#if defined(TINYGPT_VEC_AVX2)
+  for (const int64_t nVec = n - n % 8; i < nVec; i += 8) {
+    __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    _mm256_storeu_ps(dst + i, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(raw), 16)));
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = bf16ToFloat(src[i].bits);
+  }
+}
+
+static void convertRange(const float *src, FP16 *dst, int64_t n) {
+  int64_t i = 0;
+#if defined(TINYGPT_VEC_AVX2) && defined(__F16C__)
+  for (const int64_t nVec = n - n % 8; i < nVec; i += 8) {
+    __m128i half = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), half);
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i].bits = floatToFp16(src[i]);
+  }
+}
+
+static void convertRange(const FP16 *src, float *dst, int64_t n) {
+  int64_t i = 0;
+#if defined(TINYGPT_VEC_AVX2) && defined(__F16C__)
+  for (const int64_t nVec = n - n % 8; i < nVec; i += 8) {
+    _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i))));
+  }
+#endif
+  for (; i < n; i++) {
+    dst[i] = fp16ToFloat(src[i].bits);
+  }
+}
+
+// between the 16-bit types through a float block
+template <typename Src, typename Dst>
+static void convertRange(const Src *src, Dst *dst, int64_t n) {
+  float buf[kConvertBlock];
+  for (int64_t i = 0; i < n; i += kConvertBlock) {
+    int64_t len = std::min(kConvertBlock, n - i);
+    convertRange(src + i, buf, len);
+    convertRange(buf, dst + i, len);
+  }
+}
+
+template <typename Src, typename Dst>
+void convert(const Src *src, Dst *dst, int64_t n) {
+  if constexpr (std::is_same_v<Src, Dst>) {
+    std::memcpy(dst, src, n * sizeof(Src));
+  } else {
+    if (n <= kConvertGrain) {
+      convertRange(src, dst, n);
+      return;
+    }
+    ThreadPool::global().parallelFor(n, kConvertGrain, [&](int64_t begin, int64_t end) {
+      convertRange(src + begin, dst + begin, end - begin);
+    });
+  }
+}
+
+template void convert<float, float>(const float *, float *, int64_t);
+template void convert<float, BF16>(const float *, BF16 *, int64_t);
+template void convert<float, FP16>(const float *, FP16 *, int64_t);
+template void convert<BF16, float>(const BF16 *, float *, int64_t);
+template void convert<BF16, BF16>(const BF16 *, BF16 *, int64_t);
+template void convert<BF16, FP16>(const BF16 *, FP16 *, int64_t);
+template void convert<FP16, float>(const FP16 *, float *, int64_t);
+template void convert<FP16, BF16>(const FP16 *, BF16 *, int64_t);
+template void convert<FP16, FP16>(const FP16 *, FP16 *, int64_t);
+
+}  // namespace tinygpt::kernel
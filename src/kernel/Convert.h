@@ -0,0 +1,20 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "Numeric.h"
+
+namespace tinygpt::kernel {
+
+// dst[i] = Dst(src[i]) for float / BF16 / FP16, rounding to nearest even.
+// Large buffers are split across the thread pool.
+template <typename Src, typename Dst>
+void convert(const Src *src, Dst *dst, int64_t n);
+
+}  // namespace tinygpt::kernel
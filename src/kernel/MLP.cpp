@@ -0,0 +1,203 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#include "MLP.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "Vec.h"
+#include "util/ThreadPool.h"
+
+namespace tinygpt::kernel {
+
+constexpr int64_t kMLPTileSize = 64;
+
+static int64_t numMLPTiles(int64_t intermediateSize) { return (intermediateSize + kMLPTileSize - 1) / kMLPTileSize; }
+
+void gatedMLPNodeRows(int64_t intermediateSize, int64_t numNodes, int64_t node, int64_t &begin, int64_t &end) {
+  const int64_t numTiles = numMLPTiles(intermediateSize);
+  begin = std::min(intermediateSize, numTiles * node / numNodes * kMLPTileSize);
+  end = std::min(intermediateSize, numTiles * (node + 1) / numNodes * kMLPTileSize);
+}
+
+template <typename T>
+void gatedMLPNodeLayout(const T *gateUpWeight, const T *downWeight, T *gateUpDst, T *downDst, int64_t hiddenSize,
+                        int64_t intermediateSize, int64_t numNodes, int64_t node, ThreadPool &pool) {
+  const int64_t H = hiddenSize;
+  const int64_t I = intermediateSize;
+  int64_t begin, end;
+  gatedMLPNodeRows(I, numNodes, node, begin, end);
+  const int64_t rows = end - begin;
+
+  // gate rows, up rows, then the H rows of the down block
+  ThreadPool::RangeFunc copyRows = [&](int64_t rowBegin, int64_t rowEnd) {
+    for (int64_t r = rowBegin; r < rowEnd; r++) {
+      if (r < 2 * rows) {
+        const int64_t src = r < rows ? begin + r : I + begin + r - rows;
+        std::copy_n(gateUpWeight + src * H, H, gateUpDst + r * H);
+      } else {
+        const int64_t h = r - 2 * rows;
+        std::copy_n(downWeight + h * I + begin, rows, downDst + h * rows);
+      }
+    }
+  };
+  pool.wait(pool.submit(2 * rows + H, 16, copyRows));
+}
+
+// weights of the intermediate rows from `rowOffset` on, gate/up: [rows, H], down: [H, rows] with a row stride
+template <typename T>
+struct GatedMLPWeights {
+  const T *gate;
+  const T *up;
+  const T *down;
+  int64_t downStride;
+  int64_t rowOffset;
+};
+
+// gate/up + silu mul + down projection of tiles [tileBegin, tileEnd), accumulated into acc [N, H]
+template <typename T>
+static void gatedMLPTiles(const float *input, const GatedMLPWeights<T> &w, float *acc, int64_t tileBegin,
+                          int64_t tileEnd, const GatedMLPParams &p, float *act) {
+  const int64_t N = p.numTokens;
+  const int64_t H = p.hiddenSize;
+  const int64_t I = p.intermediateSize;
+
+  for (int64_t tile = tileBegin; tile < tileEnd; tile++) {
+    int64_t j0 = tile * kMLPTileSize;
+    int64_t len = std::min(kMLPTileSize, I - j0);
+    int64_t row0 = j0 - w.rowOffset;
+
+    // gate/up tile + silu mul, act: [N, len]
+    for (int64_t j = 0; j < len; j++) {
+      const T *gateRow = w.gate + (row0 + j) * H;
+      const T *upRow = w.up + (row0 + j) * H;
+      for (int64_t t = 0; t < N; t++) {
+        float g = vecDot(&input[t * H], gateRow, H);
+        float u = vecDot(&input[t * H], upRow, H);
+        act[t * kMLPTileSize + j] = g / (1.f + std::exp(-g)) * u;
+      }
+    }
+
+    // down projection of this tile: acc[t, h] += act[t, :] . down[h, j0:j0+len]
+    for (int64_t h = 0; h < H; h++) {
+      const T *downSeg = w.down + h * w.downStride + row0;
+      for (int64_t t = 0; t < N; t++) {
+        acc[t * H + h] += vecDot(&act[t * kMLPTileSize], downSeg, len);
+      }
+    }
+  }
+}
+
+template <typename T>
+void gatedMLP(const T *x, const T *gateUpWeight, const T *downWeight, T *out, const GatedMLPParams &p) {
+  const int64_t N = p.numTokens;
+  const int64_t H = p.hiddenSize;
+  const int64_t I = p.intermediateSize;
+  if (N == 0 || H == 0) {
+    return;
+  }
+
+  auto &pool = ThreadPool::global();
+  const int64_t numTiles = numMLPTiles(I);
+  const bool numa = p.nodePools && p.nodePools->size() > 1;
+
+  // tile boundaries of the partitions, partitions of a node are contiguous
+  std::vector<int64_t> partTiles = {0};
+  std::vector<int64_t> nodeParts;
+  if (numa) {
+    const auto numNodes = static_cast<int64_t>(p.nodePools->size());
+    for (int64_t node = 0; node < numNodes; node++) {
+      int64_t nodeBegin = numTiles * node / numNodes;
+      int64_t nodeEnd = numTiles * (node + 1) / numNodes;
+      int64_t workers = std::max<int64_t>(static_cast<int64_t>((*p.nodePools)[node]->numThreads()) - 1, 1);
+      int64_t parts = std::min(workers, std::max<int64_t>(nodeEnd - nodeBegin, 1));
+      for (int64_t k = 1; k <= parts; k++) {
+        partTiles.push_back(nodeBegin + (nodeEnd - nodeBegin) * k / parts);
+      }
+      nodeParts.push_back(parts);
+    }
+  } else {
+    const int64_t numPartitions =
+        std::min<int64_t>(p.numPartitions > 0 ? p.numPartitions : pool.numThreads(), std::max<int64_t>(numTiles, 1));
+    for (int64_t part = 1; part <= numPartitions; part++) {
+      partTiles.push_back(numTiles * part / numPartitions);
+    }
+  }
+  const auto numPartitions = static_cast<int64_t>(partTiles.size()) - 1;
+
+  std::vector<float> input(N * H);
+  for (int64_t i = 0; i < N * H; i++) {
+    input[i] = toFloat(x[i]);
+  }
+
+  // per partition down projection accumulators [numPartitions, N, H]
+  std::vector<float> partials(numPartitions * N * H, 0.f);
+
+  const T *upWeight = gateUpWeight ? gateUpWeight + I * H : nullptr;
+  const GatedMLPWeights<T> fullWeights = {gateUpWeight, upWeight, downWeight, I, 0};
+  auto runParts = [&](int64_t begin, int64_t end, const GatedMLPWeights<T> &w) {
+    std::vector<float> act(N * kMLPTileSize);
+    for (int64_t part = begin; part < end; part++) {
+      gatedMLPTiles(input.data(), w, &partials[part * N * H], partTiles[part], partTiles[part + 1], p, act.data());
+    }
+  };
+
+  if (numa) {
+    // every node reads its own weight slice, the node results are reduced below
+    const auto numNodes = static_cast<int64_t>(nodeParts.size());
+    std::vector<GatedMLPWeights<T>> nodeWeights(numNodes, fullWeights);
+    for (int64_t node = 0; p.nodeWeights && node < numNodes; node++) {
+      int64_t begin, end;
+      gatedMLPNodeRows(I, numNodes, node, begin, end);
+      const auto *gateUp = static_cast<const T *>(p.nodeWeights[2 * node]);
+      const auto *down = static_cast<const T *>(p.nodeWeights[2 * node + 1]);
+      nodeWeights[node] = {gateUp, gateUp + (end - begin) * H, down, end - begin, begin};
+    }
+    std::vector<ThreadPool::RangeFunc> nodeFuncs;
+    nodeFuncs.reserve(nodeParts.size());
+    int64_t offset = 0;
+    for (int64_t node = 0; node < numNodes; node++) {
+      const auto &w = nodeWeights[node];
+      nodeFuncs.emplace_back(
+          [&runParts, &w, offset](int64_t begin, int64_t end) { runParts(offset + begin, offset + end, w); });
+      offset += nodeParts[node];
+    }
+    std::vector<ThreadPool::TaskHandle> tasks;
+    for (size_t node = 0; node < nodeParts.size(); node++) {
+      tasks.push_back((*p.nodePools)[node]->submit(nodeParts[node], 1, nodeFuncs[node]));
+    }
+    for (size_t node = 0; node < nodeParts.size(); node++) {
+      (*p.nodePools)[node]->wait(tasks[node]);
+    }
+  } else {
+    pool.parallelFor(numPartitions, 1, [&](int64_t begin, int64_t end) { runParts(begin, end, fullWeights); });
+  }
+
+  pool.parallelFor(N * H, 1024, [&](int64_t begin, int64_t end) {
+    for (int64_t i = begin; i < end; i++) {
+      float sum = 0.f;
+      for (int64_t part = 0; part < numPartitions; part++) {
+        sum += partials[part * N * H + i];
+      }
+      out[i] = fromFloat<T>(sum);
+    }
+  });
+}
+
+template void gatedMLP<float>(const float *, const float *, const float *, float *, const GatedMLPParams &);
+template void gatedMLP<BF16>(const BF16 *, const BF16 *, const BF16 *, BF16 *, const GatedMLPParams &);
+template void gatedMLP<FP16>(const FP16 *, const FP16 *, const FP16 *, FP16 *, const GatedMLPParams &);
+
+template void gatedMLPNodeLayout<float>(const float *, const float *, float *, float *, int64_t, int64_t, int64_t,
+                                        int64_t, ThreadPool &);
+template void gatedMLPNodeLayout<BF16>(const BF16 *, const BF16 *, BF16 *, BF16 *, int64_t, int64_t, int64_t,
+                                       int64_t, ThreadPool &);
+template void gatedMLPNodeLayout<FP16>(const FP16 *, const FP16 *, FP16 *, FP16 *, int64_t, int64_t, int64_t,
+                                       int64_t, ThreadPool &);
+
+}  // namespace tinygpt::kernel
@@ -0,0 +1,50 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Numeric.h"
+
+namespace tinygpt {
+class ThreadPool;
+}
+
+namespace tinygpt::kernel {
+
+struct GatedMLPParams {
+  int64_t numTokens = 0;
+  int64_t hiddenSize = 0;
+  int64_t intermediateSize = 0;
+  int64_t numPartitions = 0;  // intermediate dim partitions (one per thread), 0: decided by thread count
+  // NUMA: one pinned pool per node, node i runs the intermediate rows of gatedMLPNodeRows(i), nullptr: global pool
+  const std::vector<ThreadPool *> *nodePools = nullptr;
+  // NUMA: weights in the node layout (see gatedMLPNodeLayout), [2 * node] gate/up and [2 * node + 1] down of each
+  // node, the full weights are not read then. nullptr: the nodes read the full weights
+  const void *const *nodeWeights = nullptr;
+};
+
+// intermediate rows [begin, end) computed by a node, its gate/up rows and down columns are only read there
+void gatedMLPNodeRows(int64_t intermediateSize, int64_t numNodes, int64_t node, int64_t &begin, int64_t &end);
+
+// Copy the weights read by a node: its gate rows then its up rows into gateUpDst [2 * rows, hiddenSize], its columns
+// of the down weight into downDst [hiddenSize, rows]. The copy runs on the node's pool, so the pages are first touched
+// there.
+template <typename T>
+void gatedMLPNodeLayout(const T *gateUpWeight, const T *downWeight, T *gateUpDst, T *downDst, int64_t hiddenSize,
+                        int64_t intermediateSize, int64_t numNodes, int64_t node, ThreadPool &pool);
+
+// out = down(silu(gate(x)) * up(x)) for a few tokens, x/out: [numTokens, hiddenSize]
+// gateUpWeight: [2 * intermediateSize, hiddenSize] (gate rows first), downWeight: [hiddenSize, intermediateSize],
+// both may be nullptr with node weights.
+// The intermediate dim is walked in tiles, the activated tile stays in registers/L1 and is accumulated straight into
+// a per-partition down projection output, partitions are summed at the end.
+template <typename T>
+void gatedMLP(const T *x, const T *gateUpWeight, const T *downWeight, T *out, const GatedMLPParams &p);
+
+}  // namespace tinygpt::kernel
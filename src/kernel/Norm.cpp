@@ -0,0 +1,94 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#include "Norm.h"
+
+#include <cmath>
+#include <vector>
+
+#include "util/ThreadPool.h"
+
+namespace tinygpt::kernel {
+
+// rows per task, keeps small decode batches on one thread
+constexpr int64_t kNormRowGrain = 4;
+
+// residual += delta in one pass, returns the updated row as float in buf
+template <typename T>
+static void addResidualRow(T *residual, const T *delta, float *buf, int64_t dim) {
+  if (delta) {
+    for (int64_t i = 0; i < dim; i++) {
+      // rounded to T, the residual stream keeps the model dtype
+      residual[i] = fromFloat<T>(toFloat(residual[i]) + toFloat(delta[i]));
+      buf[i] = toFloat(residual[i]);
+    }
+  } else {
+    for (int64_t i = 0; i < dim; i++) {
+      buf[i] = toFloat(residual[i]);
+    }
+  }
+}
+
+template <typename T>
+void addRMSNorm(T *residual, const T *delta, const T *weight, T *out, int64_t rows, int64_t dim, float eps) {
+  ThreadPool::global().parallelFor(rows, kNormRowGrain, [&](int64_t begin, int64_t end) {
+    std::vector<float> buf(dim);
+    for (int64_t r = begin; r < end; r++) {
+      addResidualRow(residual + r * dim, delta ? delta + r * dim : nullptr, buf.data(), dim);
+
+      float sumSq = 0.f;
+      for (int64_t i = 0; i < dim; i++) {
+        sumSq += buf[i] * buf[i];
+      }
+      float invRms = 1.f / std::sqrt(sumSq / static_cast<float>(dim) + eps);
+
+      T *o = out + r * dim;
+      for (int64_t i = 0; i < dim; i++) {
+        o[i] = fromFloat<T>(toFloat(fromFloat<T>(buf[i] * invRms)) * toFloat(weight[i]));
+      }
+    }
+  });
+}
+
+template <typename T>
+void addLayerNorm(T *residual, const T *delta, const T *weight, const T *bias, T *out, int64_t rows, int64_t dim,
+                  float eps) {
+  ThreadPool::global().parallelFor(rows, kNormRowGrain, [&](int64_t begin, int64_t end) {
+    std::vector<float> buf(dim);
+    for (int64_t r = begin; r < end; r++) {
+      addResidualRow(residual + r * dim, delta ? delta + r * dim : nullptr, buf.data(), dim);
+
+      float mean = 0.f;
+      for (int64_t i = 0; i < dim; i++) {
+        mean += buf[i];
+      }
+      mean /= static_cast<float>(dim);
+      float var = 0.f;
+      for (int64_t i = 0; i < dim; i++) {
+        float d = buf[i] - mean;
+        var += d * d;
+      }
+      float invStd = 1.f / std::sqrt(var / static_cast<float>(dim) + eps);
+
+      T *o = out + r * dim;
+      for (int64_t i = 0; i < dim; i++) {
+        float v = (buf[i] - mean) * invStd * toFloat(weight[i]);
+        o[i] = fromFloat<T>(bias ? v + toFloat(bias[i]) : v);
+      }
+    }
+  });
+}
+
+template void addRMSNorm<float>(float *, const float *, const float *, float *, int64_t, int64_t, float);
+template void addRMSNorm<BF16>(BF16 *, const BF16 *, const BF16 *, BF16 *, int64_t, int64_t, float);
+template void addRMSNorm<FP16>(FP16 *, const FP16 *, const FP16 *, FP16 *, int64_t, int64_t, float);
+
+template void addLayerNorm<float>(float *, const float *, const float *, const float *, float *, int64_t, int64_t,
+                                  float);
+template void addLayerNorm<BF16>(BF16 *, const BF16 *, const BF16 *, const BF16 *, BF16 *, int64_t, int64_t, float);
+template void addLayerNorm<FP16>(FP16 *, const FP16 *, const FP16 *, const FP16 *, FP16 *, int64_t, int64_t, float);
+
+}  // namespace tinygpt::kernel
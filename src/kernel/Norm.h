@@ -0,0 +1,25 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "Numeric.h"
+
+namespace tinygpt::kernel {
+
+// residual += delta (skipped when delta is nullptr), out = rmsnorm(residual) * weight
+// residual/delta/out: [rows, dim], rows are processed in parallel
+template <typename T>
+void addRMSNorm(T *residual, const T *delta, const T *weight, T *out, int64_t rows, int64_t dim, float eps);
+
+// residual += delta (skipped when delta is nullptr), out = layernorm(residual) * weight + bias
+template <typename T>
+void addLayerNorm(T *residual, const T *delta, const T *weight, const T *bias, T *out, int64_t rows, int64_t dim,
+                  float eps);
+
+}  // namespace tinygpt::kernel
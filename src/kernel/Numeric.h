@@ -0,0 +1,142 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace tinygpt::kernel {
+
+// raw 16-bit storage types, matching the memory layout of tinytorch BFloat16 / Float16 tensors
+struct BF16 {
+  uint16_t bits;
+};
+
+struct FP16 {
+  uint16_t bits;
+};
+
+inline float bf16ToFloat(uint16_t h) {
+  uint32_t u = static_cast<uint32_t>(h) << 16;
+  float f;
+  std::memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+inline uint16_t floatToBf16(float f) {
+  uint32_t u;
+  std::memcpy(&u, &f, sizeof(u));
+  if ((u & 0x7fffffffu) > 0x7f800000u) {
+    return static_cast<uint16_t>((u >> 16) | 0x40u);  // quiet NaN
+  }
+  u += 0x7fffu + ((u >> 16) & 1u);  // round to nearest even
+  return static_cast<uint16_t>(u >> 16);
+}
+
+inline float fp16ToFloat(uint16_t h) {
+  uint32_t sign = static_cast<uint32_t>(h & 0x8000u) << 16;
+  uint32_t exp = (h >> 10) & 0x1fu;
+  uint32_t mant = h & 0x3ffu;
+  uint32_t u;
+  if (exp == 0) {
+    if (mant == 0) {
+      u = sign;
+    } else {
+      // subnormal
+      exp = 127 - 15 + 1;
+      while ((mant & 0x400u) == 0) {
+        mant <<= 1;
+        exp--;
+      }
+      mant &= 0x3ffu;
+      u = sign | (exp << 23) | (mant << 13);
+    }
+  } else if (exp == 0x1fu) {
+    u = sign | 0x7f800000u | (mant << 13);
+  } else {
+    u = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+  }
+  float f;
+  std::memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+inline uint16_t floatToFp16(float f) {
+  uint32_t u;
+  std::memcpy(&u, &f, sizeof(u));
+  uint32_t sign = (u >> 16) & 0x8000u;
+  uint32_t absU = u & 0x7fffffffu;
+  if (absU >= 0x7f800000u) {
+    return static_cast<uint16_t>(sign | 0x7c00u | (absU > 0x7f800000u ? 0x200u : 0u));
+  }
+  if (absU >= 0x477ff000u) {
+    return static_cast<uint16_t>(sign | 0x7c00u);  // overflow to inf
+  }
+  if (absU < 0x38800000u) {
+    // subnormal or zero, round to nearest even
+    if (absU < 0x33000000u) {
+      return static_cast<uint16_t>(sign);
+    }
+    uint32_t exp = absU >> 23;
+    uint32_t mant = (absU & 0x7fffffu) | 0x800000u;
+    uint32_t shift = 126 - exp;
+    uint32_t half = mant >> shift;
+    uint32_t rem = mant & ((1u << shift) - 1);
+    uint32_t mid = 1u << (shift - 1);
+    if (rem > mid || (rem == mid && (half & 1u))) {
+      half++;
+    }
+    return static_cast<uint16_t>(sign | half);
+  }
+  absU += 0xfffu + ((absU >> 13) & 1u);
+  return static_cast<uint16_t>(sign | ((absU - 0x38000000u) >> 13));
+}
+
+inline float toFloat(float v) { return v; }
+inline float toFloat(BF16 v) { return bf16ToFloat(v.bits); }
+inline float toFloat(FP16 v) { return fp16ToFloat(v.bits); }
+
+template <typename T>
+inline T fromFloat(float v);
+
+template <>
+inline float fromFloat<float>(float v) {
+  return v;
+}
+
+template <>
+inline BF16 fromFloat<BF16>(float v) {
+  return {floatToBf16(v)};
+}
+
+template <>
+inline FP16 fromFloat<FP16>(float v) {
+  return {floatToFp16(v)};
+}
+
+// returns a float view of `src`, converting into `buf` when T is not float
+template <typename T>
+inline const float *loadRow(const T *src, float *buf, int64_t n) {
+  for (int64_t i = 0; i < n; i++) {
+    buf[i] = toFloat(src[i]);
+  }
+  return buf;
+}
+
+template <>
+inline const float *loadRow<float>(const float *src, float * /*buf*/, int64_t /*n*/) {
+  return src;
+}
+
+template <typename T>
+inline void storeRow(const float *src, T *dst, int64_t n) {
+  for (int64_t i = 0; i < n; i++) {
+    dst[i] = fromFloat<T>(src[i]);
+  }
+}
+
+}  // namespace tinygpt::kernel
@@ -0,0 +1,200 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#include "Rope.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "util/ThreadPool.h"
+
+namespace tinygpt::kernel {
+
+constexpr double kPi = 3.14159265358979323846;
+
+static void yarnInvFreq(float *invFreq, int64_t headDim, float theta, const RopeScaling &scaling) {
+  // same as transformers `_compute_yarn_parameters`
+  const int64_t half = headDim / 2;
+  const auto dim = static_cast<double>(headDim);
+  const double base = theta;
+  auto correctionDim = [&](double numRotations) {
+    return dim * std::log(static_cast<double>(scaling.originalMaxPositionEmbeddings) / (numRotations * 2.0 * kPi)) /
+           (2.0 * std::log(base));
+  };
+  double low = correctionDim(scaling.betaFast);
+  double high = correctionDim(scaling.betaSlow);
+  if (scaling.truncate) {
+    low = std::floor(low);
+    high = std::ceil(high);
+  }
+  low = std::max(low, 0.0);
+  high = std::min(high, dim - 1.0);
+  if (low == high) {
+    high += 0.001;
+  }
+
+  for (int64_t i = 0; i < half; i++) {
+    double ramp = std::clamp((static_cast<double>(i) - low) / (high - low), 0.0, 1.0);
+    double extrapolationFactor = 1.0 - ramp;
+    double extrapolation = invFreq[i];
+    double interpolation = extrapolation / scaling.factor;
+    invFreq[i] = static_cast<float>(interpolation * (1.0 - extrapolationFactor) + extrapolation * extrapolationFactor);
+  }
+}
+
+static float yarnMScale(float scale, float mscale = 1.f) {
+  if (scale <= 1.f) {
+    return 1.f;
+  }
+  return 0.1f * mscale * std::log(scale) + 1.f;
+}
+
+float ropeInvFreq(float *invFreq, int64_t headDim, float theta, const RopeScaling *scaling, int64_t seqLen) {
+  const int64_t half = headDim / 2;
+  double base = theta;
+  if (scaling && scaling->type == RopeType::DYNAMIC && scaling->originalMaxPositionEmbeddings > 0 &&
+      seqLen > scaling->originalMaxPositionEmbeddings) {
+    // same as transformers `_compute_dynamic_ntk_parameters`
+    double ratio = static_cast<double>(seqLen) / static_cast<double>(scaling->originalMaxPositionEmbeddings);
+    base *= std::pow(scaling->factor * ratio - (scaling->factor - 1.0),
+                     static_cast<double>(headDim) / static_cast<double>(headDim - 2));
+  }
+  for (int64_t i = 0; i < half; i++) {
+    invFreq[i] = static_cast<float>(1.0 / std::pow(base, 2.0 * i / headDim));
+  }
+  if (!scaling) {
+    return 1.f;
+  }
+
+  if (scaling->type == RopeType::LINEAR) {
+    for (int64_t i = 0; i < half; i++) {
+      invFreq[i] /= scaling->factor;
+    }
+    return 1.f;
+  }
+
+  if (scaling->type == RopeType::YARN) {
+    if (scaling->originalMaxPositionEmbeddings > 0) {
+      yarnInvFreq(invFreq, headDim, theta, *scaling);
+    }
+    if (scaling->attentionFactor > 0.f) {
+      return scaling->attentionFactor;
+    }
+    if (scaling->mscale > 0.f && scaling->mscaleAllDim > 0.f) {
+      return yarnMScale(scaling->factor, scaling->mscale) / yarnMScale(scaling->factor, scaling->mscaleAllDim);
+    }
+    return yarnMScale(scaling->factor);
+  }
+
+  if (scaling->type != RopeType::LLAMA3 || scaling->originalMaxPositionEmbeddings <= 0) {
+    return 1.f;
+  }
+
+  // same as transformers `_compute_llama3_parameters`
+  const auto oldContextLen = static_cast<float>(scaling->originalMaxPositionEmbeddings);
+  const float lowFreqWavelen = oldContextLen / scaling->lowFreqFactor;
+  const float highFreqWavelen = oldContextLen / scaling->highFreqFactor;
+  for (int64_t i = 0; i < half; i++) {
+    float wavelen = static_cast<float>(2.0 * kPi) / invFreq[i];
+    if (wavelen > lowFreqWavelen) {
+      invFreq[i] /= scaling->factor;
+    } else if (wavelen >= highFreqWavelen) {
+      float smooth = (oldContextLen / wavelen - scaling->lowFreqFactor) /
+                     (scaling->highFreqFactor - scaling->lowFreqFactor);
+      invFreq[i] = (1.f - smooth) * invFreq[i] / scaling->factor + smooth * invFreq[i];
+    }
+  }
+  return 1.f;
+}
+
+void ropeCosSin(float *cosOut, float *sinOut, const float *invFreq, int64_t headDim, int64_t start, int64_t len,
+                float attnScaling) {
+  const int64_t half = headDim / 2;
+  for (int64_t r = 0; r < len; r++) {
+    auto pos = static_cast<float>(start + r);
+    for (int64_t i = 0; i < half; i++) {
+      float freq = pos * invFreq[i];
+      cosOut[r * half + i] = std::cos(freq) * attnScaling;
+      sinOut[r * half + i] = std::sin(freq) * attnScaling;
+    }
+  }
+}
+
+// RMSNorm (optional) + rotate_half rotary embedding of one head
+template <typename T>
+static void normRopeHead(const T *src, const T *normWeight, const float *cosPos, const float *sinPos, float *buf,
+                         T *dst, const QKVRopeParams &p) {
+  const int64_t D = p.headDim;
+  const int64_t half = D / 2;
+  for (int64_t i = 0; i < D; i++) {
+    buf[i] = toFloat(src[i]);
+  }
+
+  if (normWeight) {
+    float sumSq = 0.f;
+    for (int64_t i = 0; i < D; i++) {
+      sumSq += buf[i] * buf[i];
+    }
+    float invRms = 1.f / std::sqrt(sumSq / static_cast<float>(D) + p.normEps);
+    for (int64_t i = 0; i < D; i++) {
+      // normalized value is rounded to T before the weight, as the unfused RMSNorm does
+      buf[i] = toFloat(fromFloat<T>(buf[i] * invRms)) * toFloat(normWeight[i]);
+    }
+  }
+
+  for (int64_t i = 0; i < half; i++) {
+    float x1 = buf[i];
+    float x2 = buf[i + half];
+    dst[i] = fromFloat<T>(x1 * cosPos[i] - x2 * sinPos[i]);
+    dst[i + half] = fromFloat<T>(x2 * cosPos[i] + x1 * sinPos[i]);
+  }
+}
+
+template <typename T>
+void qkvNormRope(const T *qkv, const T *qNormWeight, const T *kNormWeight, T *queryOut, T *keyCache, T *valueCache,
+                 const QKVRopeParams &p) {
+  const int64_t D = p.headDim;
+  const int64_t half = D / 2;
+  const int64_t qDim = p.numHeads * D;
+  const int64_t kvDim = p.numKvHeads * D;
+  const int64_t rowStride = qDim + 2 * kvDim;
+
+  ThreadPool::global().parallelFor(p.batch * p.seqLen, 1, [&](int64_t begin, int64_t end) {
+    std::vector<float> buf(D);
+
+    for (int64_t token = begin; token < end; token++) {
+      int64_t b = token / p.seqLen;
+      int64_t s = token % p.seqLen;
+      int64_t pos = p.pastLength + s;
+      const float *cosPos = p.cos + s * half;
+      const float *sinPos = p.sin + s * half;
+
+      const T *row = qkv + token * rowStride;
+      T *qDst = queryOut + token * qDim;
+      for (int64_t h = 0; h < p.numHeads; h++) {
+        normRopeHead(row + h * D, qNormWeight, cosPos, sinPos, buf.data(), qDst + h * D, p);
+      }
+
+      const int64_t slot = b * p.kvBatchStride + pos * p.kvSeqStride;
+      const T *kSrc = row + qDim;
+      const T *vSrc = row + qDim + kvDim;
+      for (int64_t h = 0; h < p.numKvHeads; h++) {
+        normRopeHead(kSrc + h * D, kNormWeight, cosPos, sinPos, buf.data(), keyCache + slot + h * D, p);
+      }
+      std::copy(vSrc, vSrc + kvDim, valueCache + slot);
+    }
+  });
+}
+
+template void qkvNormRope<float>(const float *, const float *, const float *, float *, float *, float *,
+                                 const QKVRopeParams &);
+template void qkvNormRope<BF16>(const BF16 *, const BF16 *, const BF16 *, BF16 *, BF16 *, BF16 *,
+                                const QKVRopeParams &);
+template void qkvNormRope<FP16>(const FP16 *, const FP16 *, const FP16 *, FP16 *, FP16 *, FP16 *,
+                                const QKVRopeParams &);
+
+}  // namespace tinygpt::kernel
@@ -0,0 +1,73 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "Numeric.h"
+
+namespace tinygpt::kernel {
+
+enum class RopeType {
+  DEFAULT = 0,
+  LINEAR,   // positions divided by factor
+  LLAMA3,   // wavelength dependent interpolation
+  YARN,     // NTK-by-parts interpolation + attention temperature
+  DYNAMIC,  // NTK-aware base rescaled once positions exceed the original context
+};
+
+// same fields as the `rope_scaling` entry of transformers configs
+struct RopeScaling {
+  RopeType type = RopeType::DEFAULT;
+  float factor = 1.f;
+  int64_t originalMaxPositionEmbeddings = 0;
+
+  // llama3
+  float lowFreqFactor = 1.f;
+  float highFreqFactor = 4.f;
+
+  // yarn, attentionFactor/mscale/mscaleAllDim <= 0 means not set
+  float betaFast = 32.f;
+  float betaSlow = 1.f;
+  float attentionFactor = 0.f;
+  float mscale = 0.f;
+  float mscaleAllDim = 0.f;
+  bool truncate = true;
+};
+
+// invFreq[i] = 1 / theta^(2i / headDim), i in [0, headDim / 2), adjusted by scaling.
+// seqLen only matters for DYNAMIC: frequencies for sequences of that length (<= original context: unscaled).
+// Returns the attention scaling that cos/sin are multiplied with (1 except for YARN).
+float ropeInvFreq(float *invFreq, int64_t headDim, float theta, const RopeScaling *scaling = nullptr,
+                  int64_t seqLen = 0);
+
+// cos/sin rows of positions [start, start + len), each row [headDim / 2]
+void ropeCosSin(float *cosOut, float *sinOut, const float *invFreq, int64_t headDim, int64_t start, int64_t len,
+                float attnScaling = 1.f);
+
+struct QKVRopeParams {
+  int64_t batch = 0;
+  int64_t seqLen = 0;
+  int64_t numHeads = 0;
+  int64_t numKvHeads = 0;
+  int64_t headDim = 0;
+  int64_t pastLength = 0;     // position of the first token, also its slot in the K/V cache
+  int64_t kvBatchStride = 0;  // elements between two batches of the K/V cache
+  int64_t kvSeqStride = 0;    // elements between two positions of the K/V cache
+  const float *cos = nullptr;  // [seqLen, headDim / 2], row i for position pastLength + i
+  const float *sin = nullptr;
+  float normEps = 1e-6f;
+};
+
+// Attention input stage after the QKV projection, qkv: [B, S, (H + 2 * Hkv) * D].
+// Applies optional per-head RMSNorm (qNormWeight/kNormWeight, nullptr to skip) and rotary embedding (rotate_half)
+// in one pass, writes queries to queryOut [B, S, H, D] and K/V directly into cache slots [pastLength, pastLength + S).
+template <typename T>
+void qkvNormRope(const T *qkv, const T *qNormWeight, const T *kNormWeight, T *queryOut, T *keyCache, T *valueCache,
+                 const QKVRopeParams &p);
+
+}  // namespace tinygpt::kernel
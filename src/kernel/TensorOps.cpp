@@ -0,0 +1,306 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#include "TensorOps.h"
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+#include "Attention.h"
+#include "Convert.h"
+#include "MLP.h"
+#include "Norm.h"
+#include "Rope.h"
+#include "Utils/Logger.h"
+#include "util/ActivationArena.h"
+#include "util/Numa.h"
+
+namespace tinygpt::kernel {
+
+namespace tt = tinytorch;
+
+// calls func with a value of the raw element type matching dtype
+template <typename Func>
+static void dispatchFloatType(tt::DType dtype, const char *name, Func &&func) {
+  switch (dtype) {
+    case tt::DType::Float32:
+      func(float{});
+      break;
+    case tt::DType::Float16:
+      func(FP16{});
+      break;
+    case tt::DType::BFloat16:
+      func(BF16{});
+      break;
+    default:
+      LOGE("%s: dtype not supported: %s", name, tt::dtypeToString(dtype));
+      ASSERT(false);
+      break;
+  }
+}
+
+template <typename Params>
+static tt::Tensor runAttention(const tt::Tensor &query, const tt::Tensor &key, const tt::Tensor &value,
+                               const Params &params) {
+  // reshape keeps contiguous tensors as-is and compacts strided ones
+  auto q = query.reshape(query.shape());
+  auto k = key.reshape(key.shape());
+  auto v = value.reshape(value.shape());
+  auto out = ActivationArena::empty(query.shape(), query);
+
+  dispatchFloatType(query.dtype(), "attention", [&](auto tag) {
+    using T = decltype(tag);
+    auto *qPtr = static_cast<const T *>(q.dataPtr<>());
+    auto *kPtr = static_cast<const T *>(k.dataPtr<>());
+    auto *vPtr = static_cast<const T *>(v.dataPtr<>());
+    auto *oPtr = static_cast<T *>(out.dataPtr<>());
+    if constexpr (std::is_same_v<Params, DecodeAttentionParams>) {
+      decodeAttention(qPtr, kPtr, vPtr, oPtr, params);
+    } else {
+      prefillAttention(qPtr, kPtr, vPtr, oPtr, params);
+    }
+  });
+  return out;
+}
+
+static void checkAttentionInputs(const tt::Tensor &query, const tt::Tensor &key, const tt::Tensor &value) {
+  ASSERT(query.device().isCpu());
+  ASSERT(query.dim() == 4 && key.dim() == 4 && value.dim() == 4);
+  ASSERT(query.dtype() == key.dtype() && query.dtype() == value.dtype());
+  ASSERT(key.size(0) == query.size(0) && key.size(3) == query.size(3));
+  for (int64_t d = 0; d < 4; d++) {
+    ASSERT(key.size(d) == value.size(d));
+  }
+  ASSERT(query.size(2) % key.size(2) == 0);
+}
+
+tt::Tensor decodeAttention(const tt::Tensor &query, const tt::Tensor &key, const tt::Tensor &value, int64_t kvLen) {
+  checkAttentionInputs(query, key, value);
+  ASSERT(kvLen <= key.size(1));
+  ASSERT(query.size(1) == 1);
+
+  DecodeAttentionParams params;
+  params.batch = query.size(0);
+  params.numHeads = query.size(2);
+  params.headDim = query.size(3);
+  params.numKvHeads = key.size(2);
+  params.kvLen = kvLen < 0 ? key.size(1) : kvLen;
+  params.kvSeqStride = params.numKvHeads * params.headDim;
+  params.kvBatchStride = key.size(1) * params.kvSeqStride;
+  params.scale = 1.f / std::sqrt(static_cast<float>(params.headDim));
+  return runAttention(query, key, value, params);
+}
+
+tt::Tensor prefillAttention(const tt::Tensor &query, const tt::Tensor &key, const tt::Tensor &value, bool causal,
+                            int64_t kvLen) {
+  checkAttentionInputs(query, key, value);
+  ASSERT(kvLen <= key.size(1));
+
+  PrefillAttentionParams params;
+  params.batch = query.size(0);
+  params.qLen = query.size(1);
+  params.numHeads = query.size(2);
+  params.headDim = query.size(3);
+  params.numKvHeads = key.size(2);
+  params.kvLen = kvLen < 0 ? key.size(1) : kvLen;
+  params.qSeqStride = params.numHeads * params.headDim;
+  params.qBatchStride = params.qLen * params.qSeqStride;
+  params.kvSeqStride = params.numKvHeads * params.headDim;
+  params.kvBatchStride = key.size(1) * params.kvSeqStride;
+  params.scale = 1.f / std::sqrt(static_cast<float>(params.headDim));
+  params.causal = causal;
+  return runAttention(query, key, value, params);
+}
+
+tt::Tensor qkvNormRope(const tt::Tensor &qkv, tt::Tensor &keyCache, tt::Tensor &valueCache, int64_t pastLength,
+                       int64_t numHeads, const float *cos, const float *sin, const tt::Tensor *qNormWeight,
+                       const tt::Tensor *kNormWeight, float normEps) {
+  ASSERT(qkv.device().isCpu());
+  ASSERT(qkv.dim() == 3 && keyCache.dim() == 4 && valueCache.dim() == 4);
+  ASSERT(qkv.dtype() == keyCache.dtype() && qkv.dtype() == valueCache.dtype());
+
+  QKVRopeParams params;
+  params.batch = qkv.size(0);
+  params.seqLen = qkv.size(1);
+  params.numHeads = numHeads;
+  params.numKvHeads = keyCache.size(2);
+  params.headDim = keyCache.size(3);
+  params.pastLength = pastLength;
+  params.kvSeqStride = params.numKvHeads * params.headDim;
+  params.kvBatchStride = keyCache.size(1) * params.kvSeqStride;
+  params.cos = cos;
+  params.sin = sin;
+  params.normEps = normEps;
+  ASSERT(qkv.size(2) == (numHeads + 2 * params.numKvHeads) * params.headDim);
+  ASSERT(keyCache.size(0) == params.batch && pastLength + params.seqLen <= keyCache.size(1));
+
+  auto input = qkv.reshape(qkv.shape());
+  auto queries = ActivationArena::empty({params.batch, params.seqLen, numHeads, params.headDim}, qkv);
+
+  dispatchFloatType(qkv.dtype(), "qkvNormRope", [&](auto tag) {
+    using T = decltype(tag);
+    auto *qWeight = qNormWeight ? static_cast<const T *>(qNormWeight->dataPtr<>()) : nullptr;
+    auto *kWeight = kNormWeight ? static_cast<const T *>(kNormWeight->dataPtr<>()) : nullptr;
+    qkvNormRope(static_cast<const T *>(input.dataPtr<>()), qWeight, kWeight, static_cast<T *>(queries.dataPtr<>()),
+                static_cast<T *>(keyCache.dataPtr<>()), static_cast<T *>(valueCache.dataPtr<>()), params);
+  });
+  return queries;
+}
+
+static void checkNormInputs(const tt::Tensor &residual, const tt::Tensor &delta, const tt::Tensor &weight) {
+  ASSERT(residual.device().isCpu());
+  ASSERT(weight.dim() == 1 && weight.numel() == residual.size(residual.dim() - 1));
+  ASSERT(weight.dtype() == residual.dtype());
+  if (delta.defined()) {
+    ASSERT(delta.numel() == residual.numel() && delta.dtype() == residual.dtype());
+  }
+}
+
+tt::Tensor addRMSNorm(tt::Tensor &residual, const tt::Tensor &delta, const tt::Tensor &weight, float eps) {
+  checkNormInputs(residual, delta, weight);
+  int64_t dim = residual.size(residual.dim() - 1);
+  int64_t rows = residual.numel() / dim;
+  auto deltaIn = delta.defined() ? delta.reshape(residual.shape()) : tt::Tensor();
+  auto out = ActivationArena::empty(residual.shape(), residual);
+
+  dispatchFloatType(residual.dtype(), "addRMSNorm", [&](auto tag) {
+    using T = decltype(tag);
+    auto *d = deltaIn.defined() ? static_cast<const T *>(deltaIn.dataPtr<>()) : nullptr;
+    addRMSNorm(static_cast<T *>(residual.dataPtr<>()), d, static_cast<const T *>(weight.dataPtr<>()),
+               static_cast<T *>(out.dataPtr<>()), rows, dim, eps);
+  });
+  return out;
+}
+
+tt::Tensor addLayerNorm(tt::Tensor &residual, const tt::Tensor &delta, const tt::Tensor &weight, const tt::Tensor *bias,
+                        float eps) {
+  checkNormInputs(residual, delta, weight);
+  int64_t dim = residual.size(residual.dim() - 1);
+  int64_t rows = residual.numel() / dim;
+  auto deltaIn = delta.defined() ? delta.reshape(residual.shape()) : tt::Tensor();
+  auto out = ActivationArena::empty(residual.shape(), residual);
+
+  dispatchFloatType(residual.dtype(), "addLayerNorm", [&](auto tag) {
+    using T = decltype(tag);
+    auto *d = deltaIn.defined() ? static_cast<const T *>(deltaIn.dataPtr<>()) : nullptr;
+    auto *b = bias ? static_cast<const T *>(bias->dataPtr<>()) : nullptr;
+    addLayerNorm(static_cast<T *>(residual.dataPtr<>()), d, static_cast<const T *>(weight.dataPtr<>()), b,
+                 static_cast<T *>(out.dataPtr<>()), rows, dim, eps);
+  });
+  return out;
+}
+
+bool buildGatedMLPNodeWeights(const tt::Tensor &gateUpWeight, const tt::Tensor &downWeight,
+                              GatedMLPNodeWeights &nodeWeights) {
+  ASSERT(gateUpWeight.device().isCpu());
+  ASSERT(gateUpWeight.dim() == 2 && downWeight.dim() == 2);
+  ASSERT(gateUpWeight.dtype() == downWeight.dtype());
+  const int64_t H = downWeight.size(0);
+  const int64_t I = downWeight.size(1);
+  ASSERT(gateUpWeight.size(0) == 2 * I && gateUpWeight.size(1) == H);
+  if (!Numa::enabled()) {
+    return false;
+  }
+
+  const auto &pools = Numa::nodePools();
+  const auto numNodes = static_cast<int64_t>(pools.size());
+  for (int64_t node = 0; node < numNodes; node++) {
+    int64_t begin, end;
+    gatedMLPNodeRows(I, numNodes, node, begin, end);
+    if (end <= begin) {
+      LOGE("NUMA: intermediate size %lld too small for %lld nodes", static_cast<long long>(I),
+           static_cast<long long>(numNodes));
+      return false;
+    }
+  }
+
+  // each buffer is bound to its node before it is written
+  nodeWeights = {};
+  bool success = true;
+  for (int64_t node = 0; node < numNodes; node++) {
+    int64_t begin, end;
+    gatedMLPNodeRows(I, numNodes, node, begin, end);
+    const int64_t rows = end - begin;
+    auto gateUp = tt::Tensor::empty({2 * rows, H}, gateUpWeight.options());
+    auto down = tt::Tensor::empty({H, rows}, downWeight.options());
+    const auto nbytes = static_cast<size_t>(2 * rows * H) * tt::dtypeSize(gateUp.dtype());
+    success &= Numa::bindPages(gateUp.dataPtr<>(), nbytes, static_cast<int>(node));
+    success &= Numa::bindPages(down.dataPtr<>(), nbytes / 2, static_cast<int>(node));
+    dispatchFloatType(gateUpWeight.dtype(), "gatedMLPNodeLayout", [&](auto tag) {
+      using T = decltype(tag);
+      gatedMLPNodeLayout(static_cast<const T *>(gateUpWeight.dataPtr<>()),
+                         static_cast<const T *>(downWeight.dataPtr<>()), static_cast<T *>(gateUp.dataPtr<>()),
+                         static_cast<T *>(down.dataPtr<>()), H, I, numNodes, node, *pools[node]);
+    });
+    nodeWeights.ptrs.push_back(gateUp.dataPtr<>());
+    nodeWeights.ptrs.push_back(down.dataPtr<>());
+    nodeWeights.gateUp.push_back(std::move(gateUp));
+    nodeWeights.down.push_back(std::move(down));
+  }
+  nodeWeights.hiddenSize = H;
+  nodeWeights.intermediateSize = I;
+  if (!success) {
+    LOGW("NUMA: MLP weight buffers not bound, placed by first touch");
+  }
+  return true;
+}
+
+// gateUpWeight / downWeight: nullptr with node weights in params
+static tt::Tensor runGatedMLP(const tt::Tensor &input, const void *gateUpWeight, const void *downWeight,
+                              GatedMLPParams &params) {
+  ASSERT(input.device().isCpu());
+  ASSERT(input.size(input.dim() - 1) == params.hiddenSize);
+  params.numTokens = input.numel() / params.hiddenSize;
+
+  auto x = input.reshape(input.shape());
+  auto out = ActivationArena::empty(input.shape(), input);
+  dispatchFloatType(input.dtype(), "gatedMLP", [&](auto tag) {
+    using T = decltype(tag);
+    gatedMLP(static_cast<const T *>(x.dataPtr<>()), static_cast<const T *>(gateUpWeight),
+             static_cast<const T *>(downWeight), static_cast<T *>(out.dataPtr<>()), params);
+  });
+  return out;
+}
+
+tt::Tensor gatedMLP(const tt::Tensor &input, const tt::Tensor &gateUpWeight, const tt::Tensor &downWeight) {
+  ASSERT(gateUpWeight.dim() == 2 && downWeight.dim() == 2);
+  ASSERT(input.dtype() == gateUpWeight.dtype() && input.dtype() == downWeight.dtype());
+
+  GatedMLPParams params;
+  params.hiddenSize = downWeight.size(0);
+  params.intermediateSize = downWeight.size(1);
+  ASSERT(gateUpWeight.size(0) == 2 * params.intermediateSize && gateUpWeight.size(1) == params.hiddenSize);
+  return runGatedMLP(input, gateUpWeight.dataPtr<>(), downWeight.dataPtr<>(), params);
+}
+
+tt::Tensor gatedMLP(const tt::Tensor &input, const GatedMLPNodeWeights &nodeWeights) {
+  ASSERT(!nodeWeights.empty() && nodeWeights.gateUp.size() == Numa::nodePools().size());
+  ASSERT(input.dtype() == nodeWeights.gateUp[0].dtype());
+
+  GatedMLPParams params;
+  params.hiddenSize = nodeWeights.hiddenSize;
+  params.intermediateSize = nodeWeights.intermediateSize;
+  params.nodePools = &Numa::nodePools();
+  params.nodeWeights = nodeWeights.ptrs.data();
+  return runGatedMLP(input, nullptr, nullptr, params);
+}
+
+bool isConvertible(tt::DType dtype) {
+  return dtype == tt::DType::Float32 || dtype == tt::DType::Float16 || dtype == tt::DType::BFloat16;
+}
+
+void convert(const void *src, tt::DType srcType, void *dst, tt::DType dstType, int64_t numel) {
+  dispatchFloatType(srcType, "convert", [&](auto srcTag) {
+    using Src = decltype(srcTag);
+    dispatchFloatType(dstType, "convert", [&](auto dstTag) {
+      using Dst = decltype(dstTag);
+      convert(static_cast<const Src *>(src), static_cast<Dst *>(dst), numel);
+    });
+  });
+}
+
+}  // namespace tinygpt::kernel
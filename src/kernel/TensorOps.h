@@ -0,0 +1,69 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "Functions.h"
+
+namespace tinygpt::kernel {
+
+// CPU decode attention, query: [B, 1, H, D], key/value: [B, capacity, Hkv, D] (BSHD), returns [B, 1, H, D]
+// only the first kvLen positions of key/value are used, -1 for all
+tinytorch::Tensor decodeAttention(const tinytorch::Tensor &query, const tinytorch::Tensor &key,
+                                  const tinytorch::Tensor &value, int64_t kvLen = -1);
+
+// CPU prefill attention, query: [B, S, H, D], key/value: [B, capacity, Hkv, D] (BSHD), returns [B, S, H, D]
+// causal mask is bottom-right aligned, so it also holds when the cache already has past tokens
+tinytorch::Tensor prefillAttention(const tinytorch::Tensor &query, const tinytorch::Tensor &key,
+                                   const tinytorch::Tensor &value, bool causal, int64_t kvLen = -1);
+
+// CPU attention input stage, qkv: [B, S, (H + 2 * Hkv) * D] from the merged QKV projection.
+// Applies QK RMSNorm (optional) and RoPE (cos/sin: [S, D / 2] rows of the new positions), writes K/V into
+// keyCache/valueCache [B, capacity, Hkv, D] at positions [pastLength, pastLength + S) and returns queries [B, S, H, D]
+tinytorch::Tensor qkvNormRope(const tinytorch::Tensor &qkv, tinytorch::Tensor &keyCache, tinytorch::Tensor &valueCache,
+                              int64_t pastLength, int64_t numHeads, const float *cos, const float *sin,
+                              const tinytorch::Tensor *qNormWeight = nullptr,
+                              const tinytorch::Tensor *kNormWeight = nullptr, float normEps = 1e-6f);
+
+// CPU fused residual add + norm over the last dim: residual += delta (skipped when delta is undefined),
+// residual is updated in place and the normalized result is returned
+tinytorch::Tensor addRMSNorm(tinytorch::Tensor &residual, const tinytorch::Tensor &delta,
+                             const tinytorch::Tensor &weight, float eps);
+tinytorch::Tensor addLayerNorm(tinytorch::Tensor &residual, const tinytorch::Tensor &delta,
+                               const tinytorch::Tensor &weight, const tinytorch::Tensor *bias, float eps);
+
+// weights of a gated MLP split across the NUMA nodes (see gatedMLPNodeLayout), each buffer bound to its node's memory
+struct GatedMLPNodeWeights {
+  std::vector<tinytorch::Tensor> gateUp;  // [2 * rows, hiddenSize]: the node's gate rows, then its up rows
+  std::vector<tinytorch::Tensor> down;    // [hiddenSize, rows]
+  std::vector<const void *> ptrs;         // gate/up and down data of each node, see GatedMLPParams::nodeWeights
+  int64_t hiddenSize = 0;
+  int64_t intermediateSize = 0;
+
+  bool empty() const { return gateUp.empty(); }
+};
+
+// copy the weights to the node layout on the pools of Numa::nodePools(),
+// false if NUMA is not enabled or a node would get no rows
+bool buildGatedMLPNodeWeights(const tinytorch::Tensor &gateUpWeight, const tinytorch::Tensor &downWeight,
+                              GatedMLPNodeWeights &nodeWeights);
+
+// CPU fused gated MLP for small token counts (decode), input: [..., hiddenSize],
+// gateUpWeight: [2 * intermediateSize, hiddenSize], downWeight: [hiddenSize, intermediateSize]
+tinytorch::Tensor gatedMLP(const tinytorch::Tensor &input, const tinytorch::Tensor &gateUpWeight,
+                           const tinytorch::Tensor &downWeight);
+// same with the weights in the node layout, every node runs its rows on its own pool
+tinytorch::Tensor gatedMLP(const tinytorch::Tensor &input, const GatedMLPNodeWeights &nodeWeights);
+
+// Float32 / Float16 / BFloat16
+bool isConvertible(tinytorch::DType dtype);
+
+// CPU dtype conversion of numel elements between host buffers, both dtypes must be convertible
+void convert(const void *src, tinytorch::DType srcType, void *dst, tinytorch::DType dstType, int64_t numel);
+
+}  // namespace tinygpt::kernel
@@ -0,0 +1,238 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "Numeric.h"
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#define TINYGPT_VEC_AVX2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define TINYGPT_VEC_NEON
+#endif
+
+namespace tinygpt::kernel {
+
+#if defined(TINYGPT_VEC_AVX2)
+inline float hsum(__m256 v) {
+  __m128 lo = _mm256_castps256_ps128(v);
+  __m128 hi = _mm256_extractf128_ps(v, 1);
+  lo = _mm_add_ps(lo, hi);
+  __m128 shuf = _mm_movehdup_ps(lo);
+  __m128 sums = _mm_add_ps(lo, shuf);
+  shuf = _mm_movehl_ps(shuf, sums);
+  sums = _mm_add_ss(sums, shuf);
+  return _mm_cvtss_f32(sums);
+}
+#endif
+
+// sum(a[i] * b[i])
+inline float vecDot(const float *a, const float *b, int64_t n) {
+  int64_t i = 0;
+  float sum = 0.f;
+#if defined(TINYGPT_VEC_AVX2)
+  __m256 acc0 = _mm256_setzero_ps();
+  __m256 acc1 = _mm256_setzero_ps();
+  for (; i + 16 <= n; i += 16) {
+    acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+  }
+  for (; i + 8 <= n; i += 8) {
+    acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+  }
+  sum = hsum(_mm256_add_ps(acc0, acc1));
+#elif defined(TINYGPT_VEC_NEON)
+  float32x4_t acc0 = vdupq_n_f32(0.f);
+  float32x4_t acc1 = vdupq_n_f32(0.f);
+  for (; i + 8 <= n; i += 8) {
+    acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+    acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+  }
+  for (; i + 4 <= n; i += 4) {
+    acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+  }
+  sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+#endif
+  for (; i < n; i++) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+// sum(a[i] * b[i]) with 16-bit b converted on the fly, used for weight rows kept in the model dtype
+inline float vecDot(const float *a, const BF16 *b, int64_t n) {
+  int64_t i = 0;
+  float sum = 0.f;
+#if defined(TINYGPT_VEC_AVX2)
+  __m256 acc = _mm256_setzero_ps();
+  for (const int64_t nVec = n - n % 8; i < nVec; i += 8) {
+    __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+    __m256 bf = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(raw), 16));
+    acc = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), bf, acc);
+  }
+  sum = hsum(acc);
+#endif
+  for (; i < n; i++) {
+    sum += a[i] * toFloat(b[i]);
+  }
+  return sum;
+}
+
+inline float vecDot(const float *a, const FP16 *b, int64_t n) {
+  int64_t i = 0;
+  float sum = 0.f;
+#if defined(TINYGPT_VEC_AVX2) && defined(__F16C__)
+  __m256 acc = _mm256_setzero_ps();
+  for (const int64_t nVec = n - n % 8; i < nVec; i += 8) {
+    __m256 hf = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+    acc = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), hf, acc);
+  }
+  sum = hsum(acc);
+#endif
+  for (; i < n; i++) {
+    sum += a[i] * toFloat(b[i]);
+  }
+  return sum;
+}
+
+// y[i] += alpha * x[i]
+inline void vecAxpy(float *y, const float *x, float alpha, int64_t n) {
+  int64_t i = 0;
+#if defined(TINYGPT_VEC_AVX2)
+  __m256 va = _mm256_set1_ps(alpha);
+  for (const int64_t nVec = n - n % 8; i < nVec; i += 8) {
+    _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+  }
+#elif defined(TINYGPT_VEC_NEON)
+  float32x4_t va = vdupq_n_f32(alpha);
+  for (; i + 4 <= n; i += 4) {
+    vst1q_f32(y + i, vfmaq_f32(vld1q_f32(y + i), va, vld1q_f32(x + i)));
+  }
+#endif
+  for (; i < n; i++) {
+    y[i] += alpha * x[i];
+  }
+}
+
+// y[i] += alpha * x[i] with 16-bit x converted on the fly, used for value rows of a half KV cache
+inline void vecAxpy(float *y, const BF16 *x, float alpha, int64_t n) {
+  int64_t i = 0;
+#if defined(TINYGPT_VEC_AVX2)
+  __m256 va = _mm256_set1_ps(alpha);
+  for (const int64_t nVec = n - n % 8; i < nVec; i += 8) {
+    __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i));
+    __m256 xf = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(raw), 16));
+    _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, xf, _mm256_loadu_ps(y + i)));
+  }
+#endif
+  for (; i < n; i++) {
+    y[i] += alpha * toFloat(x[i]);
+  }
+}
+
+inline void vecAxpy(float *y, const FP16 *x, float alpha, int64_t n) {
+  int64_t i = 0;
+#if defined(TINYGPT_VEC_AVX2) && defined(__F16C__)
+  __m256 va = _mm256_set1_ps(alpha);
+  for (const int64_t nVec = n - n % 8; i < nVec; i += 8) {
+    __m256 xf = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i)));
+    _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, xf, _mm256_loadu_ps(y + i)));
+  }
+#endif
+  for (; i < n; i++) {
+    y[i] += alpha * toFloat(x[i]);
+  }
+}
+
+// y[i] *= alpha
+inline void vecScale(float *y, float alpha, int64_t n) {
+  int64_t i = 0;
+#if defined(TINYGPT_VEC_AVX2)
+  __m256 va = _mm256_set1_ps(alpha);
+  for (const int64_t nVec = n - n % 8; i < nVec; i += 8) {
+    _mm256_storeu_ps(y + i, _mm256_mul_ps(va, _mm256_loadu_ps(y + i)));
+  }
+#elif defined(TINYGPT_VEC_NEON)
+  float32x4_t va = vdupq_n_f32(alpha);
+  for (; i + 4 <= n; i += 4) {
+    vst1q_f32(y + i, vmulq_f32(va, vld1q_f32(y + i)));
+  }
+#endif
+  for (; i < n; i++) {
+    y[i] *= alpha;
+  }
+}
+
+// Fixed length variants for head dims, N a multiple of 8: the trip count is a compile time constant, so the loops
+// are fully unrolled and have no tail.
+template <int64_t N>
+inline float vecDotFixed(const float *a, const float *b) {
+  static_assert(N > 0 && N % 8 == 0, "fixed length must be a multiple of 8");
+#if defined(TINYGPT_VEC_AVX2)
+  __m256 acc0 = _mm256_setzero_ps();
+  __m256 acc1 = _mm256_setzero_ps();
+  for (int64_t i = 0; i + 16 <= N; i += 16) {
+    acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+  }
+  if constexpr (N % 16 != 0) {
+    acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + N - 8), _mm256_loadu_ps(b + N - 8), acc0);
+  }
+  return hsum(_mm256_add_ps(acc0, acc1));
+#elif defined(TINYGPT_VEC_NEON)
+  float32x4_t acc0 = vdupq_n_f32(0.f);
+  float32x4_t acc1 = vdupq_n_f32(0.f);
+  for (int64_t i = 0; i < N; i += 8) {
+    acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+    acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+  }
+  return vaddvq_f32(vaddq_f32(acc0, acc1));
+#else
+  return vecDot(a, b, N);
+#endif
+}
+
+template <int64_t N>
+inline void vecAxpyFixed(float *y, const float *x, float alpha) {
+  static_assert(N > 0 && N % 8 == 0, "fixed length must be a multiple of 8");
+#if defined(TINYGPT_VEC_AVX2)
+  const __m256 va = _mm256_set1_ps(alpha);
+  for (int64_t i = 0; i < N; i += 8) {
+    _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+  }
+#elif defined(TINYGPT_VEC_NEON)
+  const float32x4_t va = vdupq_n_f32(alpha);
+  for (int64_t i = 0; i < N; i += 4) {
+    vst1q_f32(y + i, vfmaq_f32(vld1q_f32(y + i), va, vld1q_f32(x + i)));
+  }
+#else
+  vecAxpy(y, x, alpha, N);
+#endif
+}
+
+template <int64_t N>
+inline void vecScaleFixed(float *y, float alpha) {
+  static_assert(N > 0 && N % 8 == 0, "fixed length must be a multiple of 8");
+#if defined(TINYGPT_VEC_AVX2)
+  const __m256 va = _mm256_set1_ps(alpha);
+  for (int64_t i = 0; i < N; i += 8) {
+    _mm256_storeu_ps(y + i, _mm256_mul_ps(va, _mm256_loadu_ps(y + i)));
+  }
+#elif defined(TINYGPT_VEC_NEON)
+  const float32x4_t va = vdupq_n_f32(alpha);
+  for (int64_t i = 0; i < N; i += 4) {
+    vst1q_f32(y + i, vmulq_f32(va, vld1q_f32(y + i)));
+  }
+#else
+  vecScale(y, alpha, N);
+#endif
+}
+
+}  // namespace tinygpt::kernel
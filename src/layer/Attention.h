@@ -6,9 +6,14 @@
 
 #pragma once
 
+#include <memory>
+
 #include "Functions.h"
 #include "Modules.h"
+#include "kernel/TensorOps.h"
 #include "layer/Linear.h"
+#include "layer/ModuleUtils.h"
+#include "layer/RotaryEmbedding.h"
 
 namespace tinytorch::nn {
 
@@ -23,8 +28,8 @@ struct AttentionConfig {
 
 class Attention : public Module {
  public:
-  Attention(tinygpt::KVCacheManager *kvCache, size_t layerIdx, const AttentionConfig &config, RoPE &&rope,
-            Options options = {})
+  Attention(tinygpt::KVCacheManager *kvCache, size_t layerIdx, const AttentionConfig &config,
+            std::shared_ptr<RotaryEmbedding> rope, Options options = {})
       : kvCache_(kvCache),
         layerIdx_(layerIdx),
         numHeads_(config.numHeads),
@@ -36,6 +41,7 @@ class Attention : public Module {
         oProj_(Linear(qDim_, config.hiddenSize, config.oBias, options)),
         rope_(std::move(rope)) {
     ASSERT(config.numHeads % config.numKvHeads == 0);
+    ASSERT(rope_ && rope_->headDim() == config.headDim);
     registerSubModules();
   }
 
@@ -57,6 +63,8 @@ class Attention : public Module {
   Attention(const Attention &) = delete;
   Attention &operator=(const Attention &) = delete;
 
+  MergedLinear &qkvProj() { return qkvProj_; }
+
  protected:
   void registerSubModules() {
     registerModules({
@@ -69,18 +77,20 @@ class Attention : public Module {
 
  public:
   Tensor forward(const Tensor &input) override {
-    rope_.to(input.device());
-
     auto batchSize = input.shape(0);
     auto seqLen = input.shape(1);
 
+    if (input.device().isCpu()) {
+      return oProj_(computeAttentionFused(input, batchSize, seqLen));
+    }
+
     // qkv project
     auto [queries, keys, values] = projectQKV(input, batchSize, seqLen);
 
     // rope
-    int64_t pastLength = kvCache_->pastLength(layerIdx_, 1);
-    queries = rope_(queries, pastLength, QKVLayout::BSHD);
-    keys = rope_(keys, pastLength, QKVLayout::BSHD);
+    int64_t pastLength = kvCache_->pastLength(layerIdx_);
+    queries = rope_->apply(queries, pastLength);
+    keys = rope_->apply(keys, pastLength);
 
     // attn
     auto attnOutput = computeAttention(queries, keys, values, batchSize, seqLen);
@@ -111,6 +121,30 @@ class Attention : public Module {
     return attnOutput.reshape({batchSize, seqLen, qDim_});
   }
 
+  // CPU: qkv project, then (qk norm) + rope + kv cache write in one pass over the qkv output
+  Tensor computeAttentionFused(const Tensor &input, int64_t batchSize, int64_t seqLen) {
+    auto qkv = qkvProj_(input);
+    auto kvStates = kvCache_->reserve(layerIdx_, batchSize, seqLen, numKvHeads_, headDim_, qkv.options());
+    auto [cos, sin] = rope_->cosSin(kvStates.pastLength, seqLen);
+    auto [qNormWeight, kNormWeight] = qkNormWeights();
+    auto queries = tinygpt::kernel::qkvNormRope(qkv, kvStates.kv.first, kvStates.kv.second, kvStates.pastLength,
+                                                numHeads_, cos, sin, qNormWeight, kNormWeight, qkNormEps());
+
+    Tensor attnOutput;
+    int64_t kvLen = kvStates.pastLength + seqLen;
+    if (seqLen == 1) {
+      // decode: one pass over the KV cache per KV head
+      attnOutput = tinygpt::kernel::decodeAttention(queries, kvStates.kv.first, kvStates.kv.second, kvLen);
+    } else {
+      // prefill: tiled, causal mask aligned to the end of the cache
+      attnOutput = tinygpt::kernel::prefillAttention(queries, kvStates.kv.first, kvStates.kv.second, true, kvLen);
+    }
+    return attnOutput.reshape({batchSize, seqLen, qDim_});
+  }
+
+  virtual std::pair<const Tensor *, const Tensor *> qkNormWeights() { return {nullptr, nullptr}; }
+  virtual float qkNormEps() const { return 0.f; }
+
   tinygpt::KVCacheManager *kvCache_;
   size_t layerIdx_;
   int64_t numHeads_;
@@ -122,21 +156,26 @@ class Attention : public Module {
   MergedLinear qkvProj_;
   Linear oProj_;
 
-  RoPE rope_;
+  // shared by all layers of the model
+  std::shared_ptr<RotaryEmbedding> rope_;
 };
 
 class AttentionWithQKNorm : public Attention {
  public:
-  AttentionWithQKNorm(tinygpt::KVCacheManager *kvCache, size_t layerIdx, const AttentionConfig &config, RoPE &&rope,
-                      float rmsNormEps, Options options = {})
+  AttentionWithQKNorm(tinygpt::KVCacheManager *kvCache, size_t layerIdx, const AttentionConfig &config,
+                      std::shared_ptr<RotaryEmbedding> rope, float rmsNormEps, Options options = {})
       : Attention(kvCache, layerIdx, config, std::move(rope), options),
         qNorm_(RMSNorm({config.headDim}, rmsNormEps, options)),
-        kNorm_(RMSNorm({config.headDim}, rmsNormEps, options)) {
+        kNorm_(RMSNorm({config.headDim}, rmsNormEps, options)),
+        rmsNormEps_(rmsNormEps) {
     registerQkNorm_Modules();
   }
 
   AttentionWithQKNorm(AttentionWithQKNorm &&other) noexcept
-      : Attention(std::move(other)), qNorm_(std::move(other.qNorm_)), kNorm_(std::move(other.kNorm_)) {
+      : Attention(std::move(other)),
+        qNorm_(std::move(other.qNorm_)),
+        kNorm_(std::move(other.kNorm_)),
+        rmsNormEps_(other.rmsNormEps_) {
     registerQkNorm_Modules();
   }
 
@@ -162,8 +201,15 @@ class AttentionWithQKNorm : public Attention {
     return {queries, keys, values};
   }
 
+  std::pair<const Tensor *, const Tensor *> qkNormWeights() override {
+    return {findState(qNorm_, "weight"), findState(kNorm_, "weight")};
+  }
+
+  float qkNormEps() const override { return rmsNormEps_; }
+
   RMSNorm qNorm_;
   RMSNorm kNorm_;
+  float rmsNormEps_;
 };
 
 }  // namespace tinytorch::nn
@@ -7,6 +7,8 @@
 #pragma once
 
 #include "Modules.h"
+#include "kernel/TensorOps.h"
+#include "layer/ModuleUtils.h"
 
 namespace tinytorch::nn {
 
@@ -35,6 +37,9 @@ class DecoderLayer : public Module {
   DecoderLayer &operator=(const DecoderLayer &) = delete;
   DecoderLayer &operator=(DecoderLayer &&) = delete;
 
+  AttentionType &selfAttn() { return selfAttn_; }
+  MLPType &mlp() { return mlp_; }
+
   Tensor forward(const Tensor &input) override {
     auto x = input;
     x = x + selfAttn_(inputLayerNorm_(x));
@@ -42,6 +47,15 @@ class DecoderLayer : public Module {
     return x;
   }
 
+  // CPU: `residual` is the hidden state before `delta` (output of the previous sublayer) is added, both residual adds
+  // are fused with the following RMSNorm and done in place. Returns the MLP output, to be added by the next step.
+  Tensor forwardResidual(Tensor &residual, const Tensor &delta, float rmsNormEps) {
+    auto h = tinygpt::kernel::addRMSNorm(residual, delta, *findState(inputLayerNorm_, "weight"), rmsNormEps);
+    auto attnOut = selfAttn_(h);
+    h = tinygpt::kernel::addRMSNorm(residual, attnOut, *findState(postAttnLayerNorm_, "weight"), rmsNormEps);
+    return mlp_(h);
+  }
+
  private:
   void registerSubModules() {
     registerModules({
@@ -7,6 +7,7 @@
 #pragma once
 
 #include "Modules.h"
+#include "kernel/TensorOps.h"
 #include "layer/Activation.h"
 #include "layer/Linear.h"
 
@@ -14,6 +15,9 @@ namespace tinytorch::nn {
 
 class GatedMLP : public Module {
  public:
+  // CPU inputs with at most this many tokens use the fused kernel
+  static constexpr int64_t kFusedMaxTokens = 4;
+
   GatedMLP(int64_t inputSize, int64_t outputSize, Options options = {})
       : gateUpProj_(MergedLinear(inputSize, {outputSize, outputSize}, false, options)),
         downProj_(Linear(outputSize, inputSize, false, options)),
@@ -25,7 +29,10 @@ class GatedMLP : public Module {
       : Module(std::move(other)),
         gateUpProj_(std::move(other.gateUpProj_)),
         downProj_(std::move(other.downProj_)),
-        actFn_(std::move(other.actFn_)) {
+        actFn_(std::move(other.actFn_)),
+        nodeWeights_(std::move(other.nodeWeights_)),
+        nodeGateUp_(std::move(other.nodeGateUp_)),
+        nodeDown_(std::move(other.nodeDown_)) {
     subModules_.clear();
     registerSubModules();
   }
@@ -34,13 +41,55 @@ class GatedMLP : public Module {
   GatedMLP &operator=(const GatedMLP &) = delete;
   GatedMLP &operator=(GatedMLP &&) = delete;
 
+  MergedLinear &gateUpProj() { return gateUpProj_; }
+
+  // NUMA (CPU): move the weights to the node layout, each node keeping its intermediate rows in its own memory.
+  // The original weights are released, both the fused and the unfused path read the node slices afterwards.
+  bool enableNumaLayout() {
+    if (!tinygpt::kernel::buildGatedMLPNodeWeights(gateUpProj_.weight(), downProj_.weight(), nodeWeights_)) {
+      return false;
+    }
+    // unregistered modules viewing the node slices, their own initial weights are replaced at once
+    const auto options = gateUpProj_.weight().options();
+    const int64_t hiddenSize = nodeWeights_.hiddenSize;
+    for (size_t node = 0; node < nodeWeights_.gateUp.size(); node++) {
+      const int64_t rows = nodeWeights_.down[node].size(1);
+      nodeGateUp_.emplace_back(Linear(hiddenSize, 2 * rows, false, options));
+      nodeGateUp_.back().weight() = nodeWeights_.gateUp[node];
+      nodeDown_.emplace_back(Linear(rows, hiddenSize, false, options));
+      nodeDown_.back().weight() = nodeWeights_.down[node];
+    }
+    gateUpProj_.releaseWeight();
+    downProj_.weight() = Tensor();
+    return true;
+  }
+
   Tensor forward(const Tensor &input) override {
+    const bool fused = input.device().isCpu() && input.numel() / input.size(input.dim() - 1) <= kFusedMaxTokens;
+    if (!nodeWeights_.empty()) {
+      return fused ? tinygpt::kernel::gatedMLP(input, nodeWeights_) : forwardNodes(input);
+    }
+    if (fused) {
+      // decode: gate/up activations stay in cache, never written out
+      return tinygpt::kernel::gatedMLP(input, gateUpProj_.weight(), downProj_.weight());
+    }
     auto x = gateUpProj_(input);
     x = actFn_(x);
     return downProj_(x);
   }
 
  private:
+  // unfused path over the node slices: the intermediate dim is split by node, the down projections are summed
+  Tensor forwardNodes(const Tensor &input) {
+    Tensor out;
+    for (size_t node = 0; node < nodeGateUp_.size(); node++) {
+      auto x = actFn_(nodeGateUp_[node](input));
+      x = nodeDown_[node](x);
+      out = out.defined() ? out + x : x;
+    }
+    return out;
+  }
+
   void registerSubModules() {
     registerModules({
         {"gate_proj", gateUpProj_.moduleRefs(0)},
@@ -52,6 +101,10 @@ class GatedMLP : public Module {
   MergedLinear gateUpProj_;
   Linear downProj_;
   SiLUMul actFn_;
+  // NUMA: node layout of the weights, empty until enableNumaLayout
+  tinygpt::kernel::GatedMLPNodeWeights nodeWeights_;
+  std::vector<Linear> nodeGateUp_;
+  std::vector<Linear> nodeDown_;
 };
 
 }  // namespace tinytorch::nn
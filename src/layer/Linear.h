@@ -57,6 +57,30 @@ class MergedLinear : public Linear {
 
   LinearRef &moduleRefs(int64_t idx) { return moduleRefs_[idx]; }
 
+  // drop the weight and the views of its parts, e.g. once it is copied to another layout
+  void releaseWeight() {
+    weight_ = Tensor();
+    for (auto &ref : weightRefs_) {
+      ref = Tensor();
+    }
+  }
+
+  // merged weight (and bias) with the views of its parts along dim 0
+  std::vector<std::pair<TensorPtr, std::vector<TensorPtr>>> mergedStates() {
+    std::vector<std::pair<TensorPtr, std::vector<TensorPtr>>> ret;
+    ret.emplace_back(&weight_, std::vector<TensorPtr>());
+    for (auto &ref : weightRefs_) {
+      ret.back().second.push_back(&ref);
+    }
+    if (useBias_) {
+      ret.emplace_back(&bias_, std::vector<TensorPtr>());
+      for (auto &ref : biasRefs_) {
+        ret.back().second.push_back(&ref);
+      }
+    }
+    return ret;
+  }
+
  protected:
   std::vector<std::pair<std::string, TensorPtr>> namedParameters_() override { return {}; }
 
@@ -0,0 +1,25 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#pragma once
+
+#include <string>
+
+#include "Modules.h"
+
+namespace tinytorch::nn {
+
+// find a state tensor of the module by name (e.g. "weight"), nullptr if not exist
+inline TensorPtr findState(Module &module, const std::string &name) {
+  for (const auto &[stateName, tensor] : module.namedStates()) {
+    if (stateName == name) {
+      return tensor;
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace tinytorch::nn
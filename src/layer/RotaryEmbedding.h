@@ -0,0 +1,176 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "Functions.h"
+#include "Modules.h"
+#include "kernel/Rope.h"
+
+namespace tinytorch::nn {
+
+// Rotary embedding shared by all attention layers of a model.
+// cos/sin rows are computed on demand, the cached table grows geometrically with the positions actually used
+// instead of every layer holding a table of maxPositionEmbeddings rows. Other devices use the tinytorch RoPE kernel
+// when it supports the scaling, or a device copy of the table otherwise, both kept across calls.
+class RotaryEmbedding {
+ public:
+  // initial rows of the cos/sin table
+  static constexpr int64_t kMinCachedPositions = 256;
+
+  explicit RotaryEmbedding(int64_t headDim, float theta = 10000.f,
+                           const std::optional<tinygpt::kernel::RopeScaling> &scaling = std::nullopt)
+      : headDim_(headDim), theta_(theta), scaling_(scaling), invFreq_(headDim / 2) {
+    ASSERT(headDim % 2 == 0);
+    attnScaling_ = tinygpt::kernel::ropeInvFreq(invFreq_.data(), headDim_, theta_, scalingPtr());
+  }
+
+  RotaryEmbedding(const RotaryEmbedding &) = delete;
+  RotaryEmbedding &operator=(const RotaryEmbedding &) = delete;
+
+  int64_t headDim() const { return headDim_; }
+
+  // host cos/sin rows [len, headDim / 2] of positions [start, start + len), valid until the next call
+  std::pair<const float *, const float *> cosSin(int64_t start, int64_t len) {
+    const int64_t half = headDim_ / 2;
+    const int64_t end = start + len;
+    if (!dynamicScaled(end)) {
+      extendTable(end);
+      return {cos_.data() + start * half, sin_.data() + start * half};
+    }
+
+    // dynamic NTK beyond the original context: frequencies depend on the total length,
+    // rows are only shared by the layers of the same forward
+    if (start != scratchStart_ || len != scratchLen_) {
+      std::vector<float> invFreq(half);
+      tinygpt::kernel::ropeInvFreq(invFreq.data(), headDim_, theta_, scalingPtr(), end);
+      scratchCos_.resize(len * half);
+      scratchSin_.resize(len * half);
+      tinygpt::kernel::ropeCosSin(scratchCos_.data(), scratchSin_.data(), invFreq.data(), headDim_, start, len,
+                                  attnScaling_);
+      scratchStart_ = start;
+      scratchLen_ = len;
+    }
+    return {scratchCos_.data(), scratchSin_.data()};
+  }
+
+  // x: [B, S, H, D] (BSHD) on any device
+  Tensor apply(const Tensor &x, int64_t start) {
+    const int64_t len = x.size(1);
+    const int64_t end = start + len;
+    ASSERT(x.size(3) == headDim_);
+
+    // unscaled and llama3 frequencies are what the tinytorch RoPE kernel computes, its table grows like the host one
+    if (!scaling_ || scaling_->type == tinygpt::kernel::RopeType::LLAMA3) {
+      if (!kernelRope_ || end > kernelPositions_ || kernelDtype_ != x.dtype()) {
+        kernelPositions_ = std::max({end, kernelPositions_ * 2, kMinCachedPositions});
+        std::optional<RopeScalingConfig> config;
+        if (scaling_) {
+          config = RopeScalingConfig{scaling_->factor, scaling_->highFreqFactor, scaling_->lowFreqFactor,
+                                     scaling_->originalMaxPositionEmbeddings};
+        }
+        kernelRope_ = std::make_unique<RoPE>(headDim_, kernelPositions_, theta_, config, x.options());
+        kernelDtype_ = x.dtype();
+      }
+      kernelRope_->to(x.device());
+      return (*kernelRope_)(x, start, QKVLayout::BSHD);
+    }
+
+    // other scalings, rotate_half style: x * cos + swapHalves(x) * [-sin, sin].
+    // The expanded table is uploaded when the host table grows, every call takes a view of its rows
+    Tensor cos, sin;
+    if (dynamicScaled(end)) {
+      auto [hostCos, hostSin] = cosSin(start, len);
+      uploadRows(hostCos, hostSin, len, x, cos, sin);
+    } else {
+      extendTable(end);
+      if (!cosDevice_.defined() || devicePositions_ != cachedPositions_ || cosDevice_.dtype() != x.dtype() ||
+          cosDevice_.device() != x.device()) {
+        uploadRows(cos_.data(), sin_.data(), cachedPositions_, x, cosDevice_, sinDevice_);
+        devicePositions_ = cachedPositions_;
+      }
+      cos = function::narrow(cosDevice_, 1, start, len);
+      sin = function::narrow(sinDevice_, 1, start, len);
+    }
+
+    const int64_t half = headDim_ / 2;
+    auto swapped = function::concat({function::narrow(x, 3, half, half), function::narrow(x, 3, 0, half)}, 3);
+    return x * cos + swapped * sin;
+  }
+
+ private:
+  const tinygpt::kernel::RopeScaling *scalingPtr() const { return scaling_ ? &*scaling_ : nullptr; }
+
+  // expanded rows [1, len, 1, headDim] on the device and in the dtype of x
+  void uploadRows(const float *cos, const float *sin, int64_t len, const Tensor &x, Tensor &cosOut, Tensor &sinOut) {
+    const int64_t half = headDim_ / 2;
+    std::vector<float> cosFull(len * headDim_);
+    std::vector<float> sinSigned(len * headDim_);
+    for (int64_t r = 0; r < len; r++) {
+      for (int64_t i = 0; i < half; i++) {
+        cosFull[r * headDim_ + i] = cos[r * half + i];
+        cosFull[r * headDim_ + half + i] = cos[r * half + i];
+        sinSigned[r * headDim_ + i] = -sin[r * half + i];
+        sinSigned[r * headDim_ + half + i] = sin[r * half + i];
+      }
+    }
+    Options options(x.device(), DType::Float32);
+    cosOut = Tensor(cosFull, options).to(x.dtype()).view({1, len, 1, headDim_});
+    sinOut = Tensor(sinSigned, options).to(x.dtype()).view({1, len, 1, headDim_});
+  }
+
+  bool dynamicScaled(int64_t end) const {
+    return scaling_ && scaling_->type == tinygpt::kernel::RopeType::DYNAMIC &&
+           scaling_->originalMaxPositionEmbeddings > 0 && end > scaling_->originalMaxPositionEmbeddings;
+  }
+
+  void extendTable(int64_t end) {
+    if (end <= cachedPositions_) {
+      return;
+    }
+    const int64_t half = headDim_ / 2;
+    int64_t capacity = std::max({end, cachedPositions_ * 2, kMinCachedPositions});
+    cos_.resize(capacity * half);
+    sin_.resize(capacity * half);
+    tinygpt::kernel::ropeCosSin(cos_.data() + cachedPositions_ * half, sin_.data() + cachedPositions_ * half,
+                                invFreq_.data(), headDim_, cachedPositions_, capacity - cachedPositions_,
+                                attnScaling_);
+    cachedPositions_ = capacity;
+  }
+
+  int64_t headDim_;
+  float theta_;
+  std::optional<tinygpt::kernel::RopeScaling> scaling_;
+  std::vector<float> invFreq_;
+  float attnScaling_ = 1.f;
+
+  // host table [cachedPositions_, headDim / 2]
+  std::vector<float> cos_;
+  std::vector<float> sin_;
+  int64_t cachedPositions_ = 0;
+
+  std::vector<float> scratchCos_;
+  std::vector<float> scratchSin_;
+  int64_t scratchStart_ = -1;
+  int64_t scratchLen_ = 0;
+
+  // tinytorch RoPE kernel with its own device table of kernelPositions_ rows
+  std::unique_ptr<RoPE> kernelRope_;
+  int64_t kernelPositions_ = 0;
+  DType kernelDtype_ = DType::Float32;
+
+  // expanded device table of devicePositions_ rows, [1, rows, 1, headDim]
+  Tensor cosDevice_;
+  Tensor sinDevice_;
+  int64_t devicePositions_ = 0;
+};
+
+}  // namespace tinytorch::nn
@@ -6,11 +6,21 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cctype>
+#include <memory>
+
 #include "Modules.h"
+#include "Utils/Logger.h"
 #include "engine/CacheManager.h"
+#include "huggingface/ModelConfig.h"
 #include "layer/Attention.h"
 #include "layer/DecoderLayer.h"
 #include "layer/GatedMLP.h"
+#include "layer/RotaryEmbedding.h"
+#include "util/ActivationArena.h"
+#include "util/LayerStreamer.h"
+#include "util/Numa.h"
 #include "util/SafeTensors.h"
 
 namespace tinytorch::nn {
@@ -26,7 +36,8 @@ class CausalLM : public Module {
       : embedTokens_(Embedding(vocabSize, hiddenSize, options)),
         layers_(ModuleList()),
         norm_(RMSNorm({hiddenSize}, rmsNormEps, options)),
-        lmHead_(Linear(hiddenSize, vocabSize, false, options)) {
+        lmHead_(Linear(hiddenSize, vocabSize, false, options)),
+        rmsNormEps_(rmsNormEps) {
     for (int i = 0; i < numLayers; i++) {
       auto attn = attnFactory(i);
       auto mlp = mlpFactory(i);
@@ -50,6 +61,9 @@ class CausalLM : public Module {
 
   Tensor forward(const Tensor &inputIds) override {
     auto x = embedTokens_(inputIds);
+    if (x.device().isCpu()) {
+      return forwardResidual(x);
+    }
     for (auto &layer : layers_) {
       x = layer->forward(x);
     }
@@ -57,11 +71,46 @@ class CausalLM : public Module {
     return lmHead_(x);
   }
 
+  // merged projections of the layers, loaded as one state when their parts are contiguous in the checkpoint
+  std::vector<tinygpt::SafeTensors::MergedState> mergedStates() {
+    std::vector<tinygpt::SafeTensors::MergedState> ret;
+    for (auto &layer : layers_) {
+      auto &decoder = static_cast<DecoderLayerType &>(*layer);
+      for (auto *proj : {&decoder.selfAttn().qkvProj(), &decoder.mlp().gateUpProj()}) {
+        for (auto &[merged, parts] : proj->mergedStates()) {
+          ret.push_back({merged, std::move(parts)});
+        }
+      }
+    }
+    return ret;
+  }
+
+  std::vector<MLPType *> mlps() {
+    std::vector<MLPType *> ret;
+    for (auto &layer : layers_) {
+      ret.push_back(&static_cast<DecoderLayerType &>(*layer).mlp());
+    }
+    return ret;
+  }
+
  protected:
+  // residual stream updated in place, every residual add is fused with the norm that follows it
+  Tensor forwardResidual(Tensor &residual) {
+    Tensor delta;
+    for (auto &layer : layers_) {
+      delta = static_cast<DecoderLayerType &>(*layer).forwardResidual(residual, delta, rmsNormEps_);
+      tinygpt::ActivationArena::nextStep();
+      tinygpt::LayerStreamer::nextLayer();
+    }
+    auto x = tinygpt::kernel::addRMSNorm(residual, delta, *findState(norm_, "weight"), rmsNormEps_);
+    return lmHead_(x);
+  }
+
   Embedding embedTokens_;
   ModuleList layers_;
   RMSNorm norm_;
   Linear lmHead_;
+  float rmsNormEps_;
 };
 
 }  // namespace tinytorch::nn
@@ -77,13 +126,52 @@ enum class GPTModelType : int8_t {
   MISTRAL,
 };
 
+// one rotary embedding for all layers, from the `rope_theta` / `rope_scaling` config entries
+inline std::shared_ptr<tinytorch::nn::RotaryEmbedding> createRotaryEmbedding(
+    int64_t headDim, float ropeTheta, const huggingface::model::RopeScalingConfig &config,
+    int64_t maxPositionEmbeddings) {
+  kernel::RopeScaling scaling;
+  if (config.ropeType == "llama3") {
+    scaling.type = kernel::RopeType::LLAMA3;
+  } else if (config.ropeType == "yarn") {
+    scaling.type = kernel::RopeType::YARN;
+  } else if (config.ropeType == "dynamic") {
+    scaling.type = kernel::RopeType::DYNAMIC;
+  } else if (config.ropeType == "linear") {
+    scaling.type = kernel::RopeType::LINEAR;
+  } else {
+    if (!config.ropeType.empty() && config.ropeType != "default") {
+      LOGE("Unsupported rope type: %s, rope scaling ignored", config.ropeType.c_str());
+    }
+    return std::make_shared<tinytorch::nn::RotaryEmbedding>(headDim, ropeTheta);
+  }
+
+  scaling.factor = config.factor;
+  scaling.originalMaxPositionEmbeddings = config.originalMaxPositionEmbeddings > 0
+                                              ? config.originalMaxPositionEmbeddings
+                                              : maxPositionEmbeddings;
+  scaling.lowFreqFactor = config.lowFreqFactor;
+  scaling.highFreqFactor = config.highFreqFactor;
+  scaling.betaFast = config.betaFast;
+  scaling.betaSlow = config.betaSlow;
+  scaling.attentionFactor = config.attentionFactor;
+  scaling.mscale = config.mscale;
+  scaling.mscaleAllDim = config.mscaleAllDim;
+  scaling.truncate = config.truncate;
+  return std::make_shared<tinytorch::nn::RotaryEmbedding>(headDim, ropeTheta, scaling);
+}
+
 class GPTModel {
  public:
   virtual ~GPTModel() = default;
 
   virtual GPTModelType type() { return GPTModelType::UNKNOWN; }
 
-  tinytorch::Tensor forward(const tinytorch::Tensor &inputIds) { return model()(inputIds); }
+  tinytorch::Tensor forward(const tinytorch::Tensor &inputIds) {
+    ActivationArena::Scope arenaScope(arena_, inputIds.size(0), inputIds.size(1));
+    LayerStreamer::Scope streamScope(streamer_.get(), inputIds.numel());
+    return model()(inputIds);
+  }
 
   KVCacheManager &kvCache() { return kvCache_; }
   const KVCacheManager &kvCache() const { return kvCache_; }
@@ -93,7 +181,97 @@ class GPTModel {
     kvCache_.create(numLayers());
   }
 
-  virtual bool load(const std::string &path) { return SafeTensors::load(model(), path, false); }
+  virtual bool load(const std::string &path) {
+    return SafeTensors::load(stateModule(), path, false, mappedFiles(), mergedStates());
+  }
+  // states in the model dtype, under the same names `load` reads
+  bool save(const std::string &path) { return SafeTensors::save(stateModule(), path); }
+
+  // Out-of-core mode for models larger than RAM (CPU only), see LayerStreamer.
+  // Decoder layer states are streamed from the checkpoint mapped by `load`, the other states stay resident.
+  bool enableLayerStreaming() {
+    if (!device().isCpu() || mappedFiles_.empty()) {
+      LOGE("Layer streaming needs a CPU model loaded from safetensors");
+      return false;
+    }
+    if (numaLayout_) {
+      LOGE("Layer streaming cannot be combined with the NUMA layout");
+      return false;
+    }
+
+    ankerl::unordered_dense::map<std::string, SafeTensors::Entry> entries;
+    if (!mappedEntries(entries)) {
+      return false;
+    }
+
+    std::vector<std::vector<LayerStreamer::Range>> layers(numLayers());
+    for (const auto &[name, tensor] : stateModule().namedStates()) {
+      int64_t layerIdx = layerIndex(name);
+      auto it = entries.find(name);
+      if (layerIdx < 0 || layerIdx >= numLayers() || it == entries.end()) {
+        continue;
+      }
+      LayerStreamer::Range range;
+      range.data = tensor->dataPtr<>();
+      range.nbytes = tensor->numel() * tinytorch::dtypeSize(tensor->dtype());
+      range.dtype = tensor->dtype();
+      if (range.data != it->second.data) {
+        // copied out of the checkpoint (merged or converted)
+        range.src = it->second.data;
+        range.srcType = it->second.dtype;
+      }
+      layers[layerIdx].push_back(range);
+    }
+    streamer_ = std::make_unique<LayerStreamer>(std::move(layers));
+    return true;
+  }
+
+  // NUMA mode (CPU only, Numa::enabled()): the MLP weights of the decoder layers move to the node layout, see
+  // GatedMLP::enableNumaLayout. Attention, QKV / o_proj, embeddings and lm_head stay node-agnostic.
+  // The original MLP weights are released, pages of the mapped checkpoint they viewed are dropped too.
+  bool enableNumaLayout() {
+    if (!device().isCpu() || !Numa::enabled()) {
+      LOGE("NUMA layout needs a CPU model and more than one NUMA node");
+      return false;
+    }
+    if (streamer_) {
+      LOGE("NUMA layout cannot be combined with layer streaming");
+      return false;
+    }
+    auto mlps = gatedMLPs();
+    if (mlps.empty()) {
+      LOGE("NUMA layout not supported by this model");
+      return false;
+    }
+
+    // MLP states viewing the checkpoint pages
+    std::vector<std::pair<const void *, size_t>> mappedRanges;
+    ankerl::unordered_dense::map<std::string, SafeTensors::Entry> entries;
+    if (!mappedFiles_.empty() && !mappedEntries(entries)) {
+      return false;
+    }
+    for (const auto &[name, tensor] : stateModule().namedStates()) {
+      auto it = entries.find(name);
+      if (layerIndex(name) >= 0 && name.find(".mlp.") != std::string::npos && it != entries.end() &&
+          tensor->dataPtr<>() == it->second.data) {
+        mappedRanges.emplace_back(it->second.data, tensor->numel() * tinytorch::dtypeSize(tensor->dtype()));
+      }
+    }
+
+    for (auto *mlp : mlps) {
+      if (!mlp->enableNumaLayout()) {
+        LOGE("NUMA layout failed");
+        return false;
+      }
+    }
+    for (auto &[ptr, nbytes] : mappedRanges) {
+      MappedFile::dontNeed(ptr, nbytes);
+    }
+    numaLayout_ = true;
+    return true;
+  }
+
+  LayerStreamer *layerStreamer() { return streamer_.get(); }
   virtual int64_t numLayers() = 0;
   virtual int64_t contextSize() = 0;
   virtual tinytorch::nn::Module &model() = 0;
@@ -102,7 +280,53 @@ class GPTModel {
  protected:
   void init() { kvCache_.create(numLayers()); }
 
+  // module whose state names match the checkpoint
+  virtual tinytorch::nn::Module &stateModule() { return model(); }
+  // states of stateModule() merged from several checkpoint states
+  virtual std::vector<SafeTensors::MergedState> mergedStates() { return {}; }
+  // MLPs of the decoder layers, for the NUMA layout
+  virtual std::vector<tinytorch::nn::GatedMLP *> gatedMLPs() { return {}; }
+
+  // safetensors entries of the mapped checkpoint by name
+  bool mappedEntries(ankerl::unordered_dense::map<std::string, SafeTensors::Entry> &entries) {
+    for (auto &file : mappedFiles_) {
+      std::vector<std::pair<std::string, SafeTensors::Entry>> fileEntries;
+      if (!SafeTensors::readIndex(*file, fileEntries)) {
+        LOGE("Invalid safetensors header: %s", file->path().c_str());
+        return false;
+      }
+      for (auto &[name, entry] : fileEntries) {
+        entries[name] = std::move(entry);
+      }
+    }
+    return true;
+  }
+
+  // decoder layer of a state name, the first numeric component (e.g. "model.layers.3.mlp.up_proj.weight"), -1 if none
+  static int64_t layerIndex(const std::string &name) {
+    size_t begin = 0;
+    while (begin < name.size()) {
+      size_t end = name.find('.', begin);
+      if (end == std::string::npos) {
+        end = name.size();
+      }
+      if (end > begin && std::all_of(name.begin() + begin, name.begin() + end, ::isdigit)) {
+        return std::stoll(name.substr(begin, end - begin));
+      }
+      begin = end + 1;
+    }
+    return -1;
+  }
+
+  // CPU weights alias the checkpoint pages instead of being copied
+  std::vector<std::shared_ptr<MappedFile>> *mappedFiles() { return device().isCpu() ? &mappedFiles_ : nullptr; }
+
+  // mappings of the checkpoint, viewed by the weights, as a base class member it is released after the derived model
+  std::vector<std::shared_ptr<MappedFile>> mappedFiles_;
   KVCacheManager kvCache_;
+  ActivationArena arena_;
+  std::unique_ptr<LayerStreamer> streamer_;  // released before the mappings it reads
+  bool numaLayout_ = false;
 };
 
 }  // namespace tinygpt
@@ -10,6 +10,8 @@
 #include "GPTModel.h"
 #include "Modules.h"
 #include "huggingface/ModelConfig.h"
+#include "kernel/TensorOps.h"
+#include "layer/ModuleUtils.h"
 #include "util/SafeTensors.h"
 
 namespace tinygpt {
@@ -120,7 +122,8 @@ class GPT2Block : public tt::nn::Module {
       : ln1(tt::nn::LayerNorm({config.nEmbd}, config.layerNormEpsilon, true, options)),
         attn(GPT2Attention(config, kvCache, layerIndex, options)),
         ln2(tt::nn::LayerNorm({config.nEmbd}, config.layerNormEpsilon, true, options)),
-        mlp(GPT2MLP(config, options)) {
+        mlp(GPT2MLP(config, options)),
+        layerNormEps(config.layerNormEpsilon) {
     registerModules({
         {"ln_1", ln1},
         {"attn", attn},
@@ -136,10 +139,23 @@ class GPT2Block : public tt::nn::Module {
     return x;
   }
 
+  // CPU: residual adds fused with the following LayerNorm, returns the MLP output to be added by the next step
+  tt::Tensor forwardResidual(tt::Tensor &residual, const tt::Tensor &delta) {
+    auto h = addLayerNorm(ln1, residual, delta, layerNormEps);
+    auto attnOut = attn(h);
+    h = addLayerNorm(ln2, residual, attnOut, layerNormEps);
+    return mlp(h);
+  }
+
+  static tt::Tensor addLayerNorm(tt::nn::LayerNorm &ln, tt::Tensor &residual, const tt::Tensor &delta, float eps) {
+    return kernel::addLayerNorm(residual, delta, *tt::nn::findState(ln, "weight"), tt::nn::findState(ln, "bias"), eps);
+  }
+
   tt::nn::LayerNorm ln1;
   GPT2Attention attn;
   tt::nn::LayerNorm ln2;
   GPT2MLP mlp;
+  float layerNormEps;
 };
 
 class GPT2Model : public tt::nn::Module {
@@ -149,7 +165,8 @@ class GPT2Model : public tt::nn::Module {
         wte(tt::nn::Embedding(config.vocabSize, config.nEmbd, options)),
         wpe(tt::nn::Embedding(config.nPositions, config.nEmbd, options)),
         h(tt::nn::ModuleList()),
-        lnF(tt::nn::LayerNorm({config.nEmbd}, config.layerNormEpsilon, true, options)) {
+        lnF(tt::nn::LayerNorm({config.nEmbd}, config.layerNormEpsilon, true, options)),
+        layerNormEps(config.layerNormEpsilon) {
     for (auto i = 0; i < config.nLayer; i++) {
       h.emplaceBack<GPT2Block>(config, kvCache, i, options);
     }
@@ -167,6 +184,15 @@ class GPT2Model : public tt::nn::Module {
     auto pos = tt::Tensor::arange<int64_t>(pastLength, pastLength + seqLen, 1, inputIds.options()).unsqueeze(0);
 
     auto x = wte(inputIds) + wpe(pos);
+    if (x.device().isCpu()) {
+      tt::Tensor delta;
+      for (auto &layer : h) {
+        delta = static_cast<GPT2Block &>(*layer).forwardResidual(x, delta);
+        ActivationArena::nextStep();
+        LayerStreamer::nextLayer();
+      }
+      return GPT2Block::addLayerNorm(lnF, x, delta, layerNormEps);
+    }
     for (auto &layer : h) {
       x = layer->forward(x);
     }
@@ -180,6 +206,7 @@ class GPT2Model : public tt::nn::Module {
   tt::nn::Embedding wpe;
   tt::nn::ModuleList h;
   tt::nn::LayerNorm lnF;
+  float layerNormEps;
 };
 
 class GPT2LMHeadModel : public tt::nn::Module {
@@ -188,7 +215,7 @@ class GPT2LMHeadModel : public tt::nn::Module {
       : kvCache(kvCache),
         transformer(GPT2Model(config, kvCache, options)),
         lmHead(tt::nn::Linear(config.nEmbd, config.vocabSize, false, options)) {
-    lmHead.weight() = transformer.wte.weight();
+    tieWeights();
     registerModules({
         {"transformer", transformer},
         {"lm_head", lmHead},
@@ -201,6 +228,9 @@ class GPT2LMHeadModel : public tt::nn::Module {
     return logits;
   }
 
+  // lm_head shares the token embedding, redone after loading rebinds wte
+  void tieWeights() { lmHead.weight() = transformer.wte.weight(); }
+
   KVCacheManager *kvCache;
 
   GPT2Model transformer;
@@ -211,11 +241,10 @@ class GPT2LMHeadModel : public tt::nn::Module {
 
 class ModelGPT2 : public GPTModel {
  public:
-  ModelGPT2(const huggingface::model::GPT2Config &config, tinytorch::Device device)
+  ModelGPT2(const huggingface::model::GPT2Config &config, tinytorch::Device device, tinytorch::DType dtype)
       : config_(config),
         device_(device),
-        model_(std::make_unique<gpt2::GPT2LMHeadModel>(config_, &kvCache_,
-                                                       tinytorch::Options(device, config.torchDtype))) {
+        model_(std::make_unique<gpt2::GPT2LMHeadModel>(config_, &kvCache_, tinytorch::Options(device, dtype))) {
     init();
   }
 
@@ -223,7 +252,11 @@ class ModelGPT2 : public GPTModel {
 
   GPTModelType type() override { return GPTModelType::GPT2; }
 
-  bool load(const std::string &path) override { return SafeTensors::load(model_->transformer, path, false); }
+  bool load(const std::string &path) override {
+    bool success = GPTModel::load(path);
+    model_->tieWeights();
+    return success;
+  }
 
   int64_t numLayers() override { return config_.nLayer; }
 
@@ -233,6 +266,10 @@ class ModelGPT2 : public GPTModel {
 
   tinytorch::Device device() const override { return device_; }
 
+ protected:
+  // checkpoint names have no "transformer." prefix
+  tinytorch::nn::Module &stateModule() override { return model_->transformer; }
+
  private:
   const huggingface::model::GPT2Config &config_;
   tinytorch::Device device_;
@@ -18,11 +18,6 @@ namespace tt = tinytorch;
 
 using Config = huggingface::model::LlamaConfig;
 
-inline tt::RopeScalingConfig convertToRopeScalingConfig(const Config &config) {
-  return {config.ropeScaling.factor, config.ropeScaling.highFreqFactor, config.ropeScaling.lowFreqFactor,
-          config.ropeScaling.originalMaxPositionEmbeddings};
-}
-
 inline int64_t getContextSize(const Config &config) {
   if (config.ropeScaling.originalMaxPositionEmbeddings > 0) {
     return config.ropeScaling.originalMaxPositionEmbeddings;
@@ -36,12 +31,9 @@ inline std::unique_ptr<LlamaForCausalLM> createModel(const Config &config, KVCac
                                                      tt::Options options) {
   int64_t headDim = config.hiddenSize / config.numAttentionHeads;
   tt::nn::AttentionConfig attnConfig{config.hiddenSize, config.numAttentionHeads, headDim, config.numKeyValueHeads};
+  auto rope = createRotaryEmbedding(headDim, config.ropeTheta, config.ropeScaling, config.maxPositionEmbeddings);
 
-  auto attnFactory = [&](int layerIdx) {
-    auto rope =
-        tt::nn::RoPE(headDim, getContextSize(config), config.ropeTheta, convertToRopeScalingConfig(config), options);
-    return tt::nn::Attention(&kvCache, layerIdx, attnConfig, std::move(rope), options);
-  };
+  auto attnFactory = [&](int layerIdx) { return tt::nn::Attention(&kvCache, layerIdx, attnConfig, rope, options); };
 
   auto mlpFactory = [&](int /*layerIdx*/) {
     return tt::nn::GatedMLP(config.hiddenSize, config.intermediateSize, options);
@@ -56,10 +48,10 @@ inline std::unique_ptr<LlamaForCausalLM> createModel(const Config &config, KVCac
 
 class ModelLlama : public GPTModel {
  public:
-  ModelLlama(const huggingface::model::LlamaConfig &config, tinytorch::Device device)
+  ModelLlama(const huggingface::model::LlamaConfig &config, tinytorch::Device device, tinytorch::DType dtype)
       : config_(config),
         device_(device),
-        model_(llama::createModel(config_, kvCache_, tinytorch::Options(device, config.torchDtype))) {
+        model_(llama::createModel(config_, kvCache_, tinytorch::Options(device, dtype))) {
     init();
   }
 
@@ -75,6 +67,10 @@ class ModelLlama : public GPTModel {
 
   tinytorch::Device device() const override { return device_; }
 
+ protected:
+  std::vector<SafeTensors::MergedState> mergedStates() override { return model_->mergedStates(); }
+  std::vector<tinytorch::nn::GatedMLP *> gatedMLPs() override { return model_->mlps(); }
+
  private:
   const huggingface::model::LlamaConfig &config_;
   tinytorch::Device device_;
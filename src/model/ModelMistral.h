@@ -24,11 +24,9 @@ inline std::unique_ptr<MistralForCausalLM> createModel(const Config &config, KVC
                                                        tt::Options options) {
   int64_t headDim = config.hiddenSize / config.numAttentionHeads;
   tt::nn::AttentionConfig attnConfig{config.hiddenSize, config.numAttentionHeads, headDim, config.numKeyValueHeads};
+  auto rope = createRotaryEmbedding(headDim, config.ropeTheta, config.ropeScaling, config.maxPositionEmbeddings);
 
-  auto attnFactory = [&](int layerIdx) {
-    auto rope = tt::nn::RoPE(headDim, config.maxPositionEmbeddings, config.ropeTheta, std::nullopt, options);
-    return tt::nn::Attention(&kvCache, layerIdx, attnConfig, std::move(rope), options);
-  };
+  auto attnFactory = [&](int layerIdx) { return tt::nn::Attention(&kvCache, layerIdx, attnConfig, rope, options); };
 
   auto mlpFactory = [&](int /*layerIdx*/) {
     return tt::nn::GatedMLP(config.hiddenSize, config.intermediateSize, options);
@@ -43,10 +41,10 @@ inline std::unique_ptr<MistralForCausalLM> createModel(const Config &config, KVC
 
 class ModelMistral : public GPTModel {
  public:
-  ModelMistral(const huggingface::model::MistralConfig &config, tinytorch::Device device)
+  ModelMistral(const huggingface::model::MistralConfig &config, tinytorch::Device device, tinytorch::DType dtype)
       : config_(config),
         device_(device),
-        model_(mistral::createModel(config_, kvCache_, tinytorch::Options(device, config.torchDtype))) {
+        model_(mistral::createModel(config_, kvCache_, tinytorch::Options(device, dtype))) {
     init();
   }
 
@@ -62,6 +60,10 @@ class ModelMistral : public GPTModel {
 
   tinytorch::Device device() const override { return device_; }
 
+ protected:
+  std::vector<SafeTensors::MergedState> mergedStates() override { return model_->mergedStates(); }
+  std::vector<tinytorch::nn::GatedMLP *> gatedMLPs() override { return model_->mlps(); }
+
  private:
   const huggingface::model::MistralConfig &config_;
   tinytorch::Device device_;
@@ -29,11 +29,9 @@ inline std::unique_ptr<Qwen2ForCausalLM> createModel(const Config &config, KVCac
                                      config.numKeyValueHeads,
                                      true,    // qkvBias=true
                                      false};  // oBias=false
+  auto rope = createRotaryEmbedding(headDim, config.ropeTheta, config.ropeScaling, config.maxPositionEmbeddings);
 
-  auto attnFactory = [&](int layerIdx) {
-    auto rope = tt::nn::RoPE(headDim, config.maxPositionEmbeddings, config.ropeTheta, std::nullopt, options);
-    return tt::nn::Attention(&kvCache, layerIdx, attnConfig, std::move(rope), options);
-  };
+  auto attnFactory = [&](int layerIdx) { return tt::nn::Attention(&kvCache, layerIdx, attnConfig, rope, options); };
 
   auto mlpFactory = [&](int /*layerIdx*/) {
     return tt::nn::GatedMLP(config.hiddenSize, config.intermediateSize, options);
@@ -48,10 +46,10 @@ inline std::unique_ptr<Qwen2ForCausalLM> createModel(const Config &config, KVCac
 
 class ModelQwen2 : public GPTModel {
  public:
-  ModelQwen2(const huggingface::model::QwenConfig &config, tinytorch::Device device)
+  ModelQwen2(const huggingface::model::QwenConfig &config, tinytorch::Device device, tinytorch::DType dtype)
       : config_(config),
         device_(device),
-        model_(qwen2::createModel(config_, kvCache_, tinytorch::Options(device, config.torchDtype))) {
+        model_(qwen2::createModel(config_, kvCache_, tinytorch::Options(device, dtype))) {
     init();
   }
 
@@ -67,6 +65,10 @@ class ModelQwen2 : public GPTModel {
 
   tinytorch::Device device() const override { return device_; }
 
+ protected:
+  std::vector<SafeTensors::MergedState> mergedStates() override { return model_->mergedStates(); }
+  std::vector<tinytorch::nn::GatedMLP *> gatedMLPs() override { return model_->mlps(); }
+
  private:
   const huggingface::model::QwenConfig &config_;
   tinytorch::Device device_;
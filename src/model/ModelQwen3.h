@@ -24,10 +24,11 @@ inline std::unique_ptr<Qwen3ForCausalLM> createModel(const Config &config, KVCac
                                                      tt::Options options) {
   tt::nn::AttentionConfig attnConfig{config.hiddenSize, config.numAttentionHeads, config.headDim,
                                      config.numKeyValueHeads};
+  auto rope =
+      createRotaryEmbedding(config.headDim, config.ropeTheta, config.ropeScaling, config.maxPositionEmbeddings);
 
   auto attnFactory = [&](int layerIdx) {
-    auto rope = tt::nn::RoPE(config.headDim, config.maxPositionEmbeddings, config.ropeTheta, std::nullopt, options);
-    return tt::nn::AttentionWithQKNorm(&kvCache, layerIdx, attnConfig, std::move(rope), config.rmsNormEps, options);
+    return tt::nn::AttentionWithQKNorm(&kvCache, layerIdx, attnConfig, rope, config.rmsNormEps, options);
   };
 
   auto mlpFactory = [&](int /*layerIdx*/) {
@@ -43,10 +44,10 @@ inline std::unique_ptr<Qwen3ForCausalLM> createModel(const Config &config, KVCac
 
 class ModelQwen3 : public GPTModel {
  public:
-  ModelQwen3(const huggingface::model::QwenConfig &config, tinytorch::Device device)
+  ModelQwen3(const huggingface::model::QwenConfig &config, tinytorch::Device device, tinytorch::DType dtype)
       : config_(config),
         device_(device),
-        model_(qwen3::createModel(config_, kvCache_, tinytorch::Options(device, config.torchDtype))) {
+        model_(qwen3::createModel(config_, kvCache_, tinytorch::Options(device, dtype))) {
     init();
   }
 
@@ -62,6 +63,10 @@ class ModelQwen3 : public GPTModel {
 
   tinytorch::Device device() const override { return device_; }
 
+ protected:
+  std::vector<SafeTensors::MergedState> mergedStates() override { return model_->mergedStates(); }
+  std::vector<tinytorch::nn::GatedMLP *> gatedMLPs() override { return model_->mlps(); }
+
  private:
   const huggingface::model::QwenConfig &config_;
   tinytorch::Device device_;
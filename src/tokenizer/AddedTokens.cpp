@@ -0,0 +1,119 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#include "AddedTokens.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace tinygpt::tokenizer {
+
+// ascii only: stripping and word boundaries of special tokens are all about ascii text in practice
+static bool isSpaceByte(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f'; }
+
+static bool isWordByte(char c) {
+  const auto ch = static_cast<uint8_t>(c);
+  return ch >= 0x80 || std::isalnum(ch) || ch == '_';
+}
+
+// Ref: https://github.com/huggingface/tokenizers/blob/main/tokenizers/src/tokenizer/added_vocabulary.rs
+void AddedTokens::build(const std::vector<AddedToken> &tokens) {
+  tokens_.clear();
+  trie_.clear();
+  firstBytes_.clear();
+  maxLength_ = 0;
+  std::memset(isFirstByte_, 0, sizeof(isFirstByte_));
+
+  tokens_.reserve(tokens.size());
+  for (auto &t : tokens) {
+    if (t.content.empty()) {
+      continue;
+    }
+    trie_.insert(t.content, static_cast<int32_t>(tokens_.size()));
+    tokens_.push_back(t);
+    maxLength_ = std::max(maxLength_, t.content.size());
+
+    const auto first = static_cast<uint8_t>(t.content[0]);
+    if (!isFirstByte_[first]) {
+      isFirstByte_[first] = true;
+      firstBytes_.push_back(first);
+    }
+  }
+}
+
+size_t AddedTokens::nextCandidate(std::string_view text, size_t pos, size_t *cached) const {
+  if (firstBytes_.size() > 2) {
+    while (pos < text.size() && !isFirstByte_[static_cast<uint8_t>(text[pos])]) {
+      pos++;
+    }
+    return pos;
+  }
+
+  // next occurrence of each first byte is kept until passed, so a frequent byte does not rescan for a rare one
+  size_t ret = text.size();
+  for (size_t i = 0; i < firstBytes_.size(); i++) {
+    if (cached[i] <= pos) {
+      auto *found = static_cast<const char *>(std::memchr(text.data() + pos, firstBytes_[i], text.size() - pos));
+      cached[i] = found ? static_cast<size_t>(found - text.data()) : text.size();
+    }
+    ret = std::min(ret, cached[i]);
+  }
+  return ret;
+}
+
+void AddedTokens::split(std::vector<AddedTokenPiece> &ret, std::string_view text, size_t start) const {
+  auto emit = [&](size_t begin, size_t end, int32_t id) {
+    ret.push_back({{static_cast<uint32_t>(begin), static_cast<uint32_t>(end)}, id});
+  };
+
+  size_t cached[2] = {0, 0};
+  size_t segStart = start;
+  size_t pos = start;
+  while (pos < text.size()) {
+    pos = nextCandidate(text, pos, cached);
+    if (pos >= text.size()) {
+      break;
+    }
+    size_t len = 0;
+    const int32_t idx = trie_.longestPrefix(text.substr(pos), &len);
+    if (idx < 0) {
+      pos++;
+      continue;
+    }
+
+    auto &token = tokens_[idx];
+    size_t begin = pos;
+    size_t end = pos + len;
+    if (token.singleWord && ((begin > 0 && isWordByte(text[begin - 1])) ||
+                             (end < text.size() && isWordByte(text[end])))) {
+      // matches are not overlapping, the next one starts after the rejected match
+      pos = end;
+      continue;
+    }
+    if (token.lStrip) {
+      while (begin > segStart && isSpaceByte(text[begin - 1])) {
+        begin--;
+      }
+    }
+    if (token.rStrip) {
+      while (end < text.size() && isSpaceByte(text[end])) {
+        end++;
+      }
+    }
+
+    if (begin > segStart) {
+      emit(segStart, begin, -1);
+    }
+    emit(begin, end, token.id);
+    segStart = pos = end;
+  }
+  if (segStart < text.size()) {
+    emit(segStart, text.size(), -1);
+  }
+}
+
+}  // namespace tinygpt::tokenizer
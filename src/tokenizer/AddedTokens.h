@@ -0,0 +1,54 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Base.h"
+#include "Trie.h"
+
+namespace tinygpt::tokenizer {
+
+struct AddedToken {
+  std::string content;
+  int32_t id = -1;
+  bool singleWord = false;
+  bool lStrip = false;
+  bool rStrip = false;
+};
+
+struct AddedTokenPiece {
+  Range range;
+  int32_t id;  // -1 for text between added tokens
+};
+
+// Finds added tokens in a text, leftmost-longest like huggingface's AddedVocabulary.
+// Candidates start at one of the tokens' first bytes, found by memchr when there are at most two of them (`<` / `[`),
+// then the longest token at that position is looked up in a byte trie.
+class AddedTokens {
+ public:
+  void build(const std::vector<AddedToken> &tokens);
+  bool empty() const { return tokens_.empty(); }
+  size_t maxLength() const { return maxLength_; }
+
+  // split text[start:] into added tokens and the (non-empty) text between them, ranges are over `text`,
+  // bytes before `start` are only looked at for single_word boundaries
+  void split(std::vector<AddedTokenPiece> &ret, std::string_view text, size_t start = 0) const;
+
+ private:
+  size_t nextCandidate(std::string_view text, size_t pos, size_t *cached) const;
+
+  std::vector<AddedToken> tokens_;
+  Trie trie_;  // content -> index of tokens_
+  bool isFirstByte_[256] = {};
+  std::vector<uint8_t> firstBytes_;
+  size_t maxLength_ = 0;
+};
+
+}  // namespace tinygpt::tokenizer
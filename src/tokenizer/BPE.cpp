@@ -10,50 +10,14 @@
 #include <queue>
 
 #include "ByteLevel.h"
+#include "util/ThreadPool.h"
 
 namespace tinygpt::tokenizer {
 
-LRUCache::LRUCache(size_t capacity) : capacity_(capacity) { ASSERT(capacity > 0); }
-
-std::optional<LRUCache::Value> LRUCache::get(const Key& key) const {
-  const auto it = map_.find(key);
-  if (it == map_.end()) {
-    return std::nullopt;
-  }
-  list_.splice(list_.begin(), list_, it->second.second);
-  return it->second.first;
-}
-
-void LRUCache::put(const Key& key, Value&& value) const {
-  const auto it = map_.find(key);
-  if (it != map_.end()) {
-    it->second.first = std::move(value);
-    list_.splice(list_.begin(), list_, it->second.second);
-  } else {
-    if (map_.size() == capacity_) {
-      const Key& old_key = list_.back();
-      map_.erase(old_key);
-      list_.pop_back();
-    }
-    list_.push_front(key);
-    map_.emplace(key, std::make_pair(std::move(value), list_.begin()));
-  }
-}
-
-void LRUCache::erase(const Key& key) const {
-  const auto it = map_.find(key);
-  if (it != map_.end()) {
-    list_.erase(it->second.second);
-    map_.erase(it);
-  }
-}
-
-size_t LRUCache::size() const { return map_.size(); }
-
 BPE::BPE(const ankerl::unordered_dense::map<std::string, int32_t>& vocab,
          const ankerl::unordered_dense::map<StringPair, int32_t, StringPairHash>& merges, bool ignoreMerges,
-         bool enableCache)
-    : ignoreMerges_(ignoreMerges), enableCache_(enableCache) {
+         bool enableCache, bool byteLevel)
+    : ignoreMerges_(ignoreMerges), enableCache_(enableCache), byteLevel_(byteLevel) {
   // encoder_ & decoder_
   size_t encoderStrLen = 0;
   int32_t maxTokenId = -std::numeric_limits<int32_t>::max();
@@ -64,30 +28,152 @@ BPE::BPE(const ankerl::unordered_dense::map<std::string, int32_t>& vocab,
   encoderBackStr_.reserve(encoderStrLen);
   encoder_.reserve(vocab.size());
   decoder_.resize(maxTokenId + 1);
+  std::string rawKey;
   for (auto& [k, v] : vocab) {
+    // byte-level keys shrink to raw bytes, so the reserved back string never reallocates
+    if (byteLevel_) {
+      bool ok = ByteLevel::remappedToBytes(k, rawKey);
+      ASSERT(ok);
+    }
+    const std::string& key = byteLevel_ ? rawKey : k;
     const auto* ptr = encoderBackStr_.data() + encoderBackStr_.size();
-    encoderBackStr_.append(k);
-    encoder_[std::string_view(ptr, k.size())] = v;
-    decoder_[v] = ByteLevel::utf8ToBytes(k);
+    encoderBackStr_.append(key);
+    encoder_[std::string_view(ptr, key.size())] = v;
+    decoder_[v] = byteLevel_ ? key : ByteLevel::utf8ToBytes(k);
+  }
+  if (byteLevel_) {
+    for (int32_t b = 0; b < 256; b++) {
+      auto c = static_cast<char>(b);
+      auto it = encoder_.find(std::string_view(&c, 1));
+      byteTokens_[b] = it != encoder_.end() ? it->second : -1;
+    }
   }
 
-  // mergeRanks_
-  size_t mergeStrLen = 0;
-  for (auto& [k, v] : merges) {
-    mergeStrLen += k.first.size() + k.second.size();
+  // byte fallback tokens <0xXX>
+  for (int32_t b = 0; b < 256; b++) {
+    char buf[8];
+    std::snprintf(buf, sizeof(buf), "<0x%02X>", b);
+    auto it = encoder_.find(buf);
+    byteFallback_[b] = it != encoder_.end() ? it->second : -1;
   }
-  mergeRanksBackStr_.reserve(mergeStrLen);
-  mergeRanks_.reserve(merges.size());
+
+  // pairMerges_, merges work on token ids only
+  bool mergesInVocab = true;
+  pairMerges_.reserve(merges.size());
+  std::string rawFirst;
+  std::string rawSecond;
   for (auto& [k, v] : merges) {
-    const auto* ptr1 = mergeRanksBackStr_.data() + mergeRanksBackStr_.size();
-    const auto* ptr2 = ptr1 + k.first.size();
-    mergeRanksBackStr_.append(k.first);
-    mergeRanksBackStr_.append(k.second);
-    mergeRanks_[{std::string_view(ptr1, k.first.size()), std::string_view(ptr2, k.second.size())}] = v;
+    if (byteLevel_ && (!ByteLevel::remappedToBytes(k.first, rawFirst) ||
+                       !ByteLevel::remappedToBytes(k.second, rawSecond))) {
+      mergesInVocab = false;
+      continue;
+    }
+    const std::string& first = byteLevel_ ? rawFirst : k.first;
+    const std::string& second = byteLevel_ ? rawSecond : k.second;
+    auto left = encoder_.find(first);
+    auto right = encoder_.find(second);
+    auto merged = encoder_.find(first + second);
+    if (left == encoder_.end() || right == encoder_.end() || merged == encoder_.end()) {
+      mergesInVocab = false;
+      continue;
+    }
+    pairMerges_[pairKey(left->second, right->second)] = {v, merged->second};
   }
+  if (!mergesInVocab) {
+    LOGW("BPE: merges with tokens out of vocab are ignored");
+  }
+
+  backtrack_ = mergesInVocab && initBacktrack();
+}
+
+bool BPE::initBacktrack() {
+  // encode every token alone the same way as bpeMerge (lowest rank first, then leftmost),
+  // only tokens coming out as themselves can appear in an encoding
+  tokenInfos_.resize(decoder_.size());
+  const auto& entries = encoder_.values();
+  ThreadPool::global().parallelFor(static_cast<int64_t>(entries.size()), 1024, [&](int64_t begin, int64_t end) {
+    std::vector<int32_t> symbols;
+    for (int64_t idx = begin; idx < end; idx++) {
+      auto& [str, id] = entries[idx];
+      if (str.empty()) {
+        continue;
+      }
+      auto chars = splitSymbols(str);
+      symbols.clear();
+      for (auto& c : chars) {
+        auto it = encoder_.find(c);
+        if (it == encoder_.end()) {
+          break;
+        }
+        symbols.push_back(it->second);
+      }
+      if (symbols.size() != chars.size()) {
+        continue;
+      }
+
+      TokenInfo info;
+      while (symbols.size() > 1) {
+        int32_t minRank = std::numeric_limits<int32_t>::max();
+        size_t minIdx = 0;
+        int32_t merged = -1;
+        for (size_t i = 0; i + 1 < symbols.size(); i++) {
+          auto it = pairMerges_.find(pairKey(symbols[i], symbols[i + 1]));
+          if (it != pairMerges_.end() && it->second.rank < minRank) {
+            minRank = it->second.rank;
+            minIdx = i;
+            merged = it->second.id;
+          }
+        }
+        if (merged < 0) {
+          break;
+        }
+        info.rank = minRank;
+        info.left = symbols[minIdx];
+        info.right = symbols[minIdx + 1];
+        symbols[minIdx] = merged;
+        symbols.erase(symbols.begin() + static_cast<int64_t>(minIdx) + 1);
+      }
+      if (symbols.size() == 1 && symbols[0] == id) {
+        info.len = static_cast<uint32_t>(str.size());
+        tokenInfos_[id] = info;
+      }
+    }
+  });
+  for (auto& [str, id] : entries) {
+    if (tokenInfos_[id].len > 0) {
+      tokenTrie_.insert(str, id);
+    }
+  }
+
+  // pair validation assumes the parts of a token are formed by earlier merges
+  for (auto& info : tokenInfos_) {
+    if (info.rank >= 0 && (tokenInfos_[info.left].rank >= info.rank || tokenInfos_[info.right].rank >= info.rank)) {
+      tokenTrie_.clear();
+      tokenInfos_.clear();
+      return false;
+    }
+  }
+
+  for (auto& [str, id] : encoder_) {
+    auto& info = tokenInfos_[id];
+    if (info.len > 1) {
+      size_t len;
+      info.prefix = tokenTrie_.longestPrefix(str.substr(0, str.size() - 1), &len);
+    }
+  }
+  return true;
 }
 
 int32_t BPE::token2Id(const std::string& token) {
+  // byte-level tokens are given in vocab form as in huggingface, e.g. "é" is the single byte 0xE9
+  std::string rawToken;
+  if (byteLevel_ && ByteLevel::remappedToBytes(token, rawToken)) {
+    auto it = encoder_.find(rawToken);
+    if (it != encoder_.end()) {
+      return it->second;
+    }
+  }
+  // raw bytes, or a vocab without byte-level mapping
   auto it = encoder_.find(token);
   if (it != encoder_.end()) {
     return it->second;
@@ -107,14 +193,14 @@ std::string BPE::id2Token(int32_t id) {
 }
 
 std::vector<int32_t> BPE::tokenize(const StringPieces& tokens) {
-  thread_local LRUCache cache_;
-
   std::vector<int32_t> ret;
   auto reserveSize = static_cast<float>(tokens.pieces.size()) * 1.5;
   ret.reserve(static_cast<size_t>(reserveSize));
 
+  const std::string_view backStr = tokens.backStr;
+  std::vector<int32_t> ids;
   for (auto& piece : tokens.pieces) {
-    auto token = tokens.backStr.substr(piece.first, piece.second - piece.first);
+    auto token = backStr.substr(piece.first, piece.second - piece.first);
     // ignore merge
     if (ignoreMerges_) {
       auto it = encoder_.find(token);
@@ -125,218 +211,213 @@ std::vector<int32_t> BPE::tokenize(const StringPieces& tokens) {
     }
 
     // cache
-    if (enableCache_) {
-      auto cacheItem = cache_.get(token);
-      if (cacheItem) {
-        ret.insert(ret.end(), cacheItem.value().begin(), cacheItem.value().end());
-        continue;
-      }
+    if (enableCache_ && cache_.get(token, ret)) {
+      continue;
     }
 
-    // bpe
-    constexpr size_t FAST_BPE_THRESHOLD = 32;
-    auto bpePieces = token.size() > FAST_BPE_THRESHOLD ? bpeV2(token) : bpeV1(token);
-    std::vector<int32_t> ids;
-    ids.reserve(bpePieces.size());
-    for (auto& bpePiece : bpePieces) {
-      auto it = encoder_.find(bpePiece);
-      if (it != encoder_.end()) {
-        ids.push_back(it->second);
-      } else {
-        // byte decode in format <0xXX>
-        for (const auto& c : bpePiece) {
-          char buf[8];
-          std::snprintf(buf, sizeof(buf), "<0x%02X>", static_cast<uint8_t>(c));
-          it = encoder_.find(buf);
-          if (it != encoder_.end()) {
-            ids.push_back(it->second);
-          } else {
-            LOGE("error encode token: %s", std::string(bpePiece).c_str());
-            ASSERT(false);
-          }
-        }
-      }
+    // bpe, symbols out of vocab go through merging and byte fallback
+    ids.clear();
+    if (!backtrack_ || !bpeBacktrack(token, ids)) {
+      ids.clear();
+      bpeMerge(token, ids);
     }
     ret.insert(ret.end(), ids.begin(), ids.end());
     if (enableCache_) {
-      cache_.put(token, std::move(ids));
+      cache_.put(token, ids.data(), ids.size());
     }
   }
   return ret;
 }
 
-std::vector<std::string_view> BPE::bpeV1(std::string_view text) {
-  struct Node {
-    uint32_t pos;
-    uint32_t rank;
-  };
-
-  auto words = ByteLevel::splitUTF8(text);
-  std::vector<Node> nodes(words.size() + 1);
-  for (uint32_t i = 0; i < nodes.size(); i++) {
-    nodes[i].pos = (i < nodes.size() - 1) ? (words[i].data() - text.data()) : text.size();
-    nodes[i].rank = std::numeric_limits<uint32_t>::max();
-  }
-
-  auto getRank = [&text, &nodes, this](uint32_t idx1, uint32_t idx2, uint32_t idx3) -> uint32_t {
-    if (idx3 >= nodes.size()) {
-      return std::numeric_limits<uint32_t>::max();
-    }
-    const auto start = nodes[idx1].pos;
-    const auto end1 = nodes[idx2].pos;
-    const auto end2 = nodes[idx3].pos;
-    std::string_view str1 = {text.data() + start, end1 - start};
-    std::string_view str2 = {text.data() + end1, end2 - end1};
-    const auto it = mergeRanks_.find({str1, str2});
-    if (it != mergeRanks_.end()) {
-      return it->second;
+// Backtracking BPE (as the GitHub `bpe` crate): take the longest token at each position and step back to
+// shorter prefixes until every adjacent pair is one BPE would keep, each byte is revisited a bounded number
+// of times instead of rescanning the merges. Returns false if the text has symbols out of vocab.
+bool BPE::bpeBacktrack(std::string_view text, std::vector<int32_t>& ids) const {
+  // positions known to have no valid encoding of the rest
+  std::vector<uint64_t> deadEnds((text.size() >> 6) + 1, 0);
+  auto isDeadEnd = [&](size_t pos) { return (deadEnds[pos >> 6] >> (pos & 63)) & 1; };
+
+  size_t pos = 0;
+  size_t len;
+  int32_t next = tokenTrie_.longestPrefix(text, &len);
+  while (next >= 0) {
+    int32_t token = next;
+    int32_t last = ids.empty() ? -1 : ids.back();
+    while (true) {
+      size_t end = pos + tokenInfos_[token].len;
+      if (!isDeadEnd(end) && (last < 0 || isValidPair(last, token))) {
+        ids.push_back(token);
+        pos = end;
+        next = tokenTrie_.longestPrefix(text.substr(pos), &len);
+        if (next < 0 && pos < text.size()) {
+          return false;
+        }
+        break;
+      }
+      if (tokenInfos_[token].prefix >= 0) {
+        token = tokenInfos_[token].prefix;
+        continue;
+      }
+      if (last < 0) {
+        return false;
+      }
+      deadEnds[pos >> 6] |= uint64_t(1) << (pos & 63);
+      ids.pop_back();
+      pos -= tokenInfos_[last].len;
+      next = last;
+      break;
     }
-    return std::numeric_limits<uint32_t>::max();
-  };
-
-  for (uint32_t i = 0; i < nodes.size() - 2; i++) {
-    nodes[i].rank = getRank(i, i + 1, i + 2);
   }
+  return pos == text.size();
+}
 
+// whether BPE keeps `left` and `right` apart when encoding their concatenation:
+// undo the merges of both sides latest first, no pair across the boundary may win over them
+bool BPE::isValidPair(int32_t left, int32_t right) const {
+  int32_t limit = std::numeric_limits<int32_t>::max();
   while (true) {
-    if (nodes.size() == 1) {
-      break;
+    auto it = pairMerges_.find(pairKey(left, right));
+    if (it != pairMerges_.end() && it->second.rank < limit) {
+      return false;
     }
-
-    auto minRank = std::make_pair<uint32_t, uint32_t>(std::numeric_limits<uint32_t>::max(), 0);
-    for (uint32_t i = 0; i < nodes.size() - 1; i++) {
-      auto rank = nodes[i].rank;
-      if (rank < minRank.first) {
-        minRank = {rank, i};
+    const auto& leftInfo = tokenInfos_[left];
+    const auto& rightInfo = tokenInfos_[right];
+    if (leftInfo.rank > rightInfo.rank) {
+      limit = leftInfo.rank;
+      left = leftInfo.right;
+    } else {
+      if (rightInfo.rank < 0) {
+        return true;
       }
+      // on equal ranks the left pair merges first
+      limit = rightInfo.rank + 1;
+      right = rightInfo.left;
     }
-
-    if (minRank.first == std::numeric_limits<uint32_t>::max()) {
-      break;
-    }
-
-    auto minIdx = minRank.second;
-    nodes[minIdx].rank = getRank(minIdx, minIdx + 2, minIdx + 3);
-    if (minIdx > 0) {
-      nodes[minIdx - 1].rank = getRank(minIdx - 1, minIdx, minIdx + 2);
-    }
-    nodes.erase(nodes.begin() + (minIdx + 1));
   }
+}
 
-  std::vector<std::string_view> ret;
-  ret.reserve(nodes.size() - 1);
-  for (uint32_t i = 0; i < nodes.size() - 1; i++) {
-    ret.emplace_back(text.data() + nodes[i].pos, nodes[i + 1].pos - nodes[i].pos);
+std::vector<std::string_view> BPE::splitSymbols(std::string_view text) const {
+  if (!byteLevel_) {
+    return ByteLevel::splitUTF8(text);
   }
-  return ret;
+  std::vector<std::string_view> symbols;
+  symbols.reserve(text.size());
+  for (size_t i = 0; i < text.size(); i++) {
+    symbols.emplace_back(text.data() + i, 1);
+  }
+  return symbols;
 }
 
-std::vector<std::string_view> BPE::bpeV2(std::string_view text) {
+void BPE::bpeMerge(std::string_view text, std::vector<int32_t>& ids) const {
   struct Node {
+    int32_t id;  // -1: symbol out of vocab
+    int32_t rank;
     uint32_t pos;
-    uint32_t rank;
-    Node* prev;
-    Node* next;
-    bool active;
+    int32_t prev;
+    int32_t next;
   };
 
-  auto words = ByteLevel::splitUTF8(text);
-  std::vector<Node> nodes(words.size() + 1);
-
-  for (uint32_t i = 0; i < nodes.size(); i++) {
-    nodes[i].pos = (i < words.size()) ? (words[i].data() - text.data()) : text.size();
-    nodes[i].prev = (i > 0) ? &nodes[i - 1] : nullptr;
-    nodes[i].next = (i < nodes.size() - 1) ? &nodes[i + 1] : nullptr;
-    nodes[i].rank = std::numeric_limits<uint32_t>::max();
-    nodes[i].active = true;
+  auto words = splitSymbols(text);
+  const auto numNodes = static_cast<int32_t>(words.size());
+  if (numNodes == 0) {
+    return;
   }
-
-  auto getRank = [&text, this](const Node* node) -> uint32_t {
-    if (!node || !node->next || !node->next->next) {
-      return std::numeric_limits<uint32_t>::max();
+  std::vector<Node> nodes(numNodes);
+  for (int32_t i = 0; i < numNodes; i++) {
+    if (byteLevel_) {
+      nodes[i].id = byteTokens_[static_cast<uint8_t>(words[i][0])];
+    } else {
+      auto it = encoder_.find(words[i]);
+      nodes[i].id = it != encoder_.end() ? it->second : -1;
     }
+    nodes[i].rank = std::numeric_limits<int32_t>::max();
+    nodes[i].pos = static_cast<uint32_t>(words[i].data() - text.data());
+    nodes[i].prev = i - 1;
+    nodes[i].next = (i + 1 < numNodes) ? i + 1 : -1;
+  }
 
-    const uint32_t start = node->pos;
-    const uint32_t mid = node->next->pos;
-    const uint32_t end = node->next->next->pos;
-
-    std::string_view str1(text.data() + start, mid - start);
-    std::string_view str2(text.data() + mid, end - mid);
-
-    auto it = mergeRanks_.find({str1, str2});
-    if (it != mergeRanks_.end()) {
-      return it->second;
+  auto getMerge = [&nodes, this](int32_t idx) -> const Merge* {
+    const auto& node = nodes[idx];
+    if (node.next < 0 || node.id < 0 || nodes[node.next].id < 0) {
+      return nullptr;
     }
-    return std::numeric_limits<uint32_t>::max();
+    auto it = pairMerges_.find(pairKey(node.id, nodes[node.next].id));
+    return it != pairMerges_.end() ? &it->second : nullptr;
   };
 
-  using QueueElem = std::pair<uint32_t, Node*>;  // <rank, node>
+  using QueueElem = std::pair<int32_t, int32_t>;  // <rank, node>
   auto cmp = [](const QueueElem& a, const QueueElem& b) {
     // If ranks are equal, prioritize the smaller index
     if (a.first == b.first) {
-      return a.second->pos > b.second->pos;
+      return a.second > b.second;
     }
     return a.first > b.first;
   };
   std::priority_queue<QueueElem, std::vector<QueueElem>, decltype(cmp)> pq(cmp);
-  for (auto& node : nodes) {
-    if (node.next) {
-      node.rank = getRank(&node);
-      if (node.rank != std::numeric_limits<uint32_t>::max()) {
-        pq.emplace(node.rank, &node);
-      }
+  for (int32_t i = 0; i < numNodes; i++) {
+    if (auto* merge = getMerge(i)) {
+      nodes[i].rank = merge->rank;
+      pq.emplace(merge->rank, i);
     }
   }
 
-  auto activeCount = nodes.size();
+  // merged nodes are unlinked, the left node of a pair takes the merged token
+  auto updateRank = [&](int32_t idx) {
+    auto* merge = getMerge(idx);
+    int32_t rank = merge ? merge->rank : std::numeric_limits<int32_t>::max();
+    if (rank != nodes[idx].rank) {
+      nodes[idx].rank = rank;
+      if (merge) {
+        pq.emplace(rank, idx);
+      }
+    }
+  };
   while (!pq.empty()) {
-    auto [minRank, node] = pq.top();
+    auto [minRank, idx] = pq.top();
     pq.pop();
 
-    if (!node->active || node->rank != minRank) {
+    auto& node = nodes[idx];
+    if (node.id < 0 || node.rank != minRank) {
       continue;
     }
-    Node* nextNode = node->next;
-    if (!nextNode || !nextNode->active) {
+    auto* merge = getMerge(idx);
+    if (!merge) {
       continue;
     }
 
-    // mark not active
-    nextNode->active = false;
-    activeCount--;
-
     // merge with next
-    node->next = nextNode->next;
-    if (node->next) {
-      node->next->prev = node;
+    auto& nextNode = nodes[node.next];
+    nextNode.id = -1;
+    nextNode.rank = std::numeric_limits<int32_t>::max();
+    node.id = merge->id;
+    node.next = nextNode.next;
+    if (node.next >= 0) {
+      nodes[node.next].prev = idx;
     }
 
-    // update rank
-    const uint32_t oldRank = node->rank;
-    node->rank = getRank(node);
-    if (node->rank != oldRank && node->rank != std::numeric_limits<uint32_t>::max()) {
-      pq.emplace(node->rank, node);
-    }
-
-    // update prev node
-    if (node->prev && node->prev->active) {
-      const uint32_t prevOldRank = node->prev->rank;
-      node->prev->rank = getRank(node->prev);
-      if (node->prev->rank != prevOldRank && node->prev->rank != std::numeric_limits<uint32_t>::max()) {
-        pq.emplace(node->prev->rank, node->prev);
-      }
+    updateRank(idx);
+    if (node.prev >= 0) {
+      updateRank(node.prev);
     }
   }
 
-  std::vector<std::string_view> ret;
-  ret.reserve(activeCount - 1);
-  for (Node* curr = &nodes[0]; curr; curr = curr->next) {
-    if (curr->active && curr->next) {
-      ret.emplace_back(text.data() + curr->pos, curr->next->pos - curr->pos);
+  for (int32_t idx = 0; idx >= 0; idx = nodes[idx].next) {
+    if (nodes[idx].id >= 0) {
+      ids.push_back(nodes[idx].id);
+      continue;
+    }
+    // byte fallback in format <0xXX>
+    uint32_t end = nodes[idx].next >= 0 ? nodes[nodes[idx].next].pos : static_cast<uint32_t>(text.size());
+    for (uint32_t pos = nodes[idx].pos; pos < end; pos++) {
+      int32_t id = byteFallback_[static_cast<uint8_t>(text[pos])];
+      if (id < 0) {
+        LOGE("error encode token: %s", std::string(text.substr(nodes[idx].pos, end - nodes[idx].pos)).c_str());
+        ASSERT(false);
+        continue;
+      }
+      ids.push_back(id);
     }
   }
-
-  return ret;
 }
 
 }  // namespace tinygpt::tokenizer
\ No newline at end of file
@@ -6,43 +6,21 @@
 
 #pragma once
 
-#include <list>
-#include <optional>
+#include <array>
 #include <string>
 #include <vector>
 
+#include "BPECache.h"
 #include "Base.h"
+#include "Trie.h"
 
 namespace tinygpt::tokenizer {
 
-constexpr uint32_t NUM_MAX_CACHE = 128 * 1024;
-
-class LRUCache {
- public:
-  using Key = std::string;
-  using Value = std::vector<int32_t>;
-  using ListIt = std::list<Key>::iterator;
-
-  explicit LRUCache(size_t capacity = NUM_MAX_CACHE);
-  ~LRUCache() = default;
-
-  std::optional<Value> get(const Key& key) const;
-  void put(const Key& key, Value&& value) const;
-
-  void erase(const Key& key) const;
-  size_t size() const;
-
- private:
-  size_t capacity_;
-  mutable std::list<Key> list_;
-  mutable ankerl::unordered_dense::map<Key, std::pair<Value, ListIt>> map_;
-};
-
 class BPE : public Component {
  public:
   BPE(const ankerl::unordered_dense::map<std::string, int32_t>& vocab,
       const ankerl::unordered_dense::map<StringPair, int32_t, StringPairHash>& merges, bool ignoreMerges = false,
-      bool enableCache = true);
+      bool enableCache = true, bool byteLevel = false);
 
   ComponentType getType() override { return ComponentType::BPE; }
 
@@ -50,18 +28,53 @@ class BPE : public Component {
   std::string id2Token(int32_t id) override;
   std::vector<int32_t> tokenize(const StringPieces& tokens) override;
 
+  BPECache::Stats cacheStats() const { return cache_.stats(); }
+
  private:
-  std::vector<std::string_view> bpeV1(std::string_view text);
-  std::vector<std::string_view> bpeV2(std::string_view text);
+  struct Merge {
+    int32_t rank;
+    int32_t id;
+  };
+
+  // how BPE forms a token when the token string is encoded alone
+  struct TokenInfo {
+    int32_t rank = -1;    // rank of the last merge, -1: initial symbol
+    int32_t left = -1;    // parts of the last merge
+    int32_t right = -1;
+    int32_t prefix = -1;  // longest reachable token which is a proper prefix
+    uint32_t len = 0;     // bytes, 0: not reachable by merges
+  };
+
+  static uint64_t pairKey(int32_t left, int32_t right) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(left)) << 32) | static_cast<uint32_t>(right);
+  }
+
+  // initial symbols: single bytes for byte-level vocab, UTF-8 chars otherwise
+  std::vector<std::string_view> splitSymbols(std::string_view text) const;
+  bool initBacktrack();
+  bool bpeBacktrack(std::string_view text, std::vector<int32_t>& ids) const;
+  bool isValidPair(int32_t left, int32_t right) const;
+  // merges lowest rank first (then leftmost) on token ids, symbols out of vocab go to byte fallback
+  void bpeMerge(std::string_view text, std::vector<int32_t>& ids) const;
 
   bool ignoreMerges_;
   bool enableCache_;
+  BPECache cache_;
+  // vocab and merges converted from the byte-level unicode remap to raw bytes at load
+  bool byteLevel_;
   ankerl::unordered_dense::map<std::string_view, int32_t> encoder_;
   std::vector<std::string> decoder_;
-  ankerl::unordered_dense::map<StringViewPair, int32_t, StringViewPairHash> mergeRanks_;
-
   std::string encoderBackStr_;
-  std::string mergeRanksBackStr_;
+
+  // (rank, merged token) of a token pair, keyed by pairKey
+  ankerl::unordered_dense::map<uint64_t, Merge> pairMerges_;
+  std::array<int32_t, 256> byteFallback_{};
+  std::array<int32_t, 256> byteTokens_{};  // single byte tokens of byte-level vocab
+
+  // backtracking encoder, disabled when the vocab does not fit (merges out of vocab, non-monotonic ranks)
+  bool backtrack_ = false;
+  Trie tokenTrie_;
+  std::vector<TokenInfo> tokenInfos_;
 };
 
 }  // namespace tinygpt::tokenizer
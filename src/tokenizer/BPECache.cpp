@@ -0,0 +1,118 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#include "BPECache.h"
+
+#include <cstring>
+
+namespace tinygpt::tokenizer {
+
+BPECache::BPECache(size_t capacity) {
+  ASSERT(capacity > 0);
+  slotsPerShard_ = static_cast<uint32_t>((capacity + NUM_SHARDS - 1) / NUM_SHARDS);
+  shards_ = std::make_unique<Shard[]>(NUM_SHARDS);
+}
+
+bool BPECache::get(std::string_view key, std::vector<int32_t> &ids) {
+  const auto hash = hashKey(key);
+  auto &shard = shardOf(hash);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+
+  const auto it = shard.index.find(hash);
+  if (it != shard.index.end()) {
+    auto &slot = shard.slots[it->second];
+    const auto *data = slotData(shard, it->second);
+    const auto *keyData = reinterpret_cast<const char *>(data + slot.numIds);
+    // a different key of the same hash counts as a miss
+    if (slot.keyLen == key.size() && std::memcmp(keyData, key.data(), key.size()) == 0) {
+      slot.referenced = true;
+      ids.insert(ids.end(), data, data + slot.numIds);
+      shard.hits++;
+      return true;
+    }
+  }
+  shard.misses++;
+  return false;
+}
+
+void BPECache::put(std::string_view key, const int32_t *ids, size_t numIds) {
+  if (numIds * sizeof(int32_t) + key.size() > SLOT_BYTES) {
+    return;
+  }
+
+  const auto hash = hashKey(key);
+  auto &shard = shardOf(hash);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+
+  // allocated on first use, the arena and index never grow afterwards
+  if (shard.slots.empty()) {
+    shard.slots.resize(slotsPerShard_);
+    shard.arena.resize(static_cast<size_t>(slotsPerShard_) * (SLOT_BYTES / sizeof(int32_t)));
+    shard.index.reserve(slotsPerShard_);
+  }
+
+  uint32_t idx;
+  const auto it = shard.index.find(hash);
+  if (it != shard.index.end()) {
+    // same key put by another thread, or a colliding key replaced
+    idx = it->second;
+  } else {
+    idx = shard.numUsed < slotsPerShard_ ? shard.numUsed++ : evict(shard);
+    shard.index.emplace(hash, idx);
+  }
+
+  auto &slot = shard.slots[idx];
+  slot.hash = hash;
+  slot.keyLen = static_cast<uint16_t>(key.size());
+  slot.numIds = static_cast<uint16_t>(numIds);
+  slot.referenced = false;
+  auto *data = slotData(shard, idx);
+  std::memcpy(data, ids, numIds * sizeof(int32_t));
+  std::memcpy(reinterpret_cast<char *>(data + numIds), key.data(), key.size());
+}
+
+// CLOCK: sweep the hand, clearing reference bits, until an unreferenced slot is found
+uint32_t BPECache::evict(Shard &shard) {
+  while (true) {
+    auto idx = shard.hand;
+    shard.hand = (shard.hand + 1 == slotsPerShard_) ? 0 : shard.hand + 1;
+    auto &slot = shard.slots[idx];
+    if (slot.referenced) {
+      slot.referenced = false;
+      continue;
+    }
+    shard.index.erase(slot.hash);
+    return idx;
+  }
+}
+
+BPECache::Stats BPECache::stats() const {
+  Stats ret;
+  for (uint32_t i = 0; i < NUM_SHARDS; i++) {
+    auto &shard = shards_[i];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    ret.hits += shard.hits;
+    ret.misses += shard.misses;
+    ret.size += shard.index.size();
+  }
+  return ret;
+}
+
+void BPECache::clear() {
+  for (uint32_t i = 0; i < NUM_SHARDS; i++) {
+    auto &shard = shards_[i];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.slots.clear();
+    shard.arena.clear();
+    shard.index.clear();
+    shard.hand = 0;
+    shard.numUsed = 0;
+    shard.hits = 0;
+    shard.misses = 0;
+  }
+}
+
+}  // namespace tinygpt::tokenizer
@@ -0,0 +1,72 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "Base.h"
+
+namespace tinygpt::tokenizer {
+
+constexpr uint32_t NUM_MAX_CACHE = 128 * 1024;
+
+// Piece -> ids cache shared by all encoding threads.
+// Sharded by key hash, each shard is a fixed array of slots evicted by CLOCK. Key bytes and ids live inline in a
+// flat arena (SLOT_BYTES per slot), pieces too large for a slot are not cached.
+class BPECache {
+ public:
+  static constexpr uint32_t SHARD_BITS = 6;
+  static constexpr uint32_t NUM_SHARDS = 1u << SHARD_BITS;
+  static constexpr uint32_t SLOT_BYTES = 64;
+
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    size_t size = 0;
+  };
+
+  explicit BPECache(size_t capacity = NUM_MAX_CACHE);
+
+  // appends the cached ids of key to `ids`, false on miss
+  bool get(std::string_view key, std::vector<int32_t> &ids);
+  void put(std::string_view key, const int32_t *ids, size_t numIds);
+
+  Stats stats() const;
+  void clear();
+
+ private:
+  struct Slot {
+    uint64_t hash = 0;
+    uint16_t keyLen = 0;
+    uint16_t numIds = 0;
+    bool referenced = false;
+  };
+
+  struct Shard {
+    std::mutex mutex;
+    std::vector<Slot> slots;
+    std::vector<int32_t> arena;  // SLOT_BYTES per slot: ids, then key bytes
+    ankerl::unordered_dense::map<uint64_t, uint32_t> index;
+    uint32_t hand = 0;
+    uint32_t numUsed = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+  };
+
+  static uint64_t hashKey(std::string_view key) { return ankerl::unordered_dense::hash<std::string_view>{}(key); }
+  Shard &shardOf(uint64_t hash) { return shards_[hash >> (64 - SHARD_BITS)]; }
+  int32_t *slotData(Shard &shard, uint32_t slot) { return shard.arena.data() + slot * (SLOT_BYTES / sizeof(int32_t)); }
+  uint32_t evict(Shard &shard);
+
+  uint32_t slotsPerShard_;
+  std::unique_ptr<Shard[]> shards_;
+};
+
+}  // namespace tinygpt::tokenizer
@@ -15,9 +15,12 @@ void ComponentSequence::addComponent(std::unique_ptr<Component>&& component) {
 }
 
 StringPieces ComponentSequence::preTokenize(const StringPieces& text) {
-  StringPieces ret = text;
-  for (auto& comp : components) {
-    ret = comp->preTokenize(ret);
+  if (components.empty()) {
+    return text;
+  }
+  StringPieces ret = components.front()->preTokenize(text);
+  for (size_t i = 1; i < components.size(); i++) {
+    ret = components[i]->preTokenize(ret);
   }
   return ret;
 }
@@ -8,6 +8,7 @@
 
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "Utils/Logger.h"
@@ -37,7 +38,6 @@ enum class ComponentType {
 
 using Range = std::pair<uint32_t, uint32_t>;  // [begin, end]
 using StringPair = std::pair<std::string, std::string>;
-using StringViewPair = std::pair<std::string_view, std::string_view>;
 
 struct StringPairHash {
   using is_avalanching = void;  // mark class as high quality avalanching hash
@@ -50,37 +50,52 @@ struct StringPairHash {
   static size_t combine(size_t h1, size_t h2) noexcept { return h1 ^ (h2 + 0x9e3779b9 + (h1 << 6) + (h1 >> 2)); }
 };
 
-struct StringViewPairHash {
-  using is_avalanching = void;  // mark class as high quality avalanching hash
-
-  size_t operator()(const StringViewPair &p) const {
-    ankerl::unordered_dense::hash<std::string_view> hasher;
-    return combine(hasher(p.first), hasher(p.second));
-  }
+struct StringHash {
+  using is_transparent = void;  // find by std::string_view without building a key string
+  using is_avalanching = void;
 
-  static size_t combine(size_t h1, size_t h2) noexcept { return h1 ^ (h2 + 0x9e3779b9 + (h1 << 6) + (h1 >> 2)); }
+  size_t operator()(std::string_view str) const { return ankerl::unordered_dense::hash<std::string_view>{}(str); }
 };
 
+// Ranges over an immutable text shared by all copies. Stages which only split refine the ranges (copies are cheap),
+// stages which rewrite bytes (Metaspace, ByteLevel) put the new text in a buffer of their own.
 struct StringPieces {
   std::vector<Range> pieces;
-  std::string backStr;
+  std::string_view backStr;  // borrowed from the caller or owned by `storage_`
 
   StringPieces() = default;
 
-  StringPieces(const char *str) {  // NOLINT
-    backStr = str;
-    pieces = {{0, backStr.size()}};
-  }
+  // borrow the text, which must outlive the pieces
+  StringPieces(const char *str) : StringPieces(std::string_view(str)) {}  // NOLINT
 
-  StringPieces(std::string_view str) {  // NOLINT
-    backStr = str;
+  StringPieces(std::string_view str) : backStr(str) {  // NOLINT
     pieces = {{0, backStr.size()}};
   }
 
+  StringPieces(const std::string &str) : StringPieces(std::string_view(str)) {}  // NOLINT
+
+  // take the text over
   StringPieces(std::string &&str) {  // NOLINT
-    backStr = std::move(str);
+    setText(std::move(str));
     pieces = {{0, backStr.size()}};
   }
+
+  void setText(std::string &&str) {
+    storage_ = std::make_shared<const std::string>(std::move(str));
+    backStr = *storage_;
+  }
+
+  // same text with other ranges
+  StringPieces refine(std::vector<Range> &&ranges) const {
+    StringPieces ret;
+    ret.pieces = std::move(ranges);
+    ret.backStr = backStr;
+    ret.storage_ = storage_;
+    return ret;
+  }
+
+ private:
+  std::shared_ptr<const std::string> storage_;
 };
 
 class Component {
@@ -108,6 +108,35 @@ std::string ByteLevel::utf8ToBytes(std::string_view str) {
   return result;
 }
 
+bool ByteLevel::remappedToBytes(std::string_view str, std::string& out) {
+  // alphabet codepoints are all below 0x144
+  static const std::array<int16_t, 0x144> byteOfCodepoint = [] {
+    std::array<int16_t, 0x144> table{};
+    table.fill(-1);
+    for (int16_t i = 0; i < 256; i++) {
+      table[bytesChar_[i]] = i;
+    }
+    return table;
+  }();
+
+  out.clear();
+  out.reserve(str.size());
+  const auto* data = reinterpret_cast<const uint8_t*>(str.data());
+  auto len = static_cast<utf8proc_ssize_t>(str.size());
+  utf8proc_ssize_t i = 0;
+  while (i < len) {
+    utf8proc_int32_t codepoint;
+    auto charLen = utf8proc_iterate(data + i, len - i, &codepoint);
+    if (charLen < 0 || codepoint < 0 || codepoint >= static_cast<int32_t>(byteOfCodepoint.size()) ||
+        byteOfCodepoint[codepoint] < 0) {
+      return false;
+    }
+    out.push_back(static_cast<char>(byteOfCodepoint[codepoint]));
+    i += charLen;
+  }
+  return true;
+}
+
 int32_t ByteLevel::findIncompletePos(std::string_view str) {
   const auto len = static_cast<int32_t>(str.size());
   if (len == 0) {
@@ -150,12 +179,10 @@ std::vector<std::string_view> ByteLevel::splitUTF8(std::string_view str) {
   return results;
 }
 
-ByteLevel::ByteLevel(bool addPrefixSpace, bool useRegex) : addPrefixSpace_(addPrefixSpace), useRegex_(useRegex) {
+ByteLevel::ByteLevel(bool addPrefixSpace, bool useRegex, bool rawBytes)
+    : addPrefixSpace_(addPrefixSpace), useRegex_(useRegex), rawBytes_(rawBytes) {
   if (useRegex_) {
-    // Ref https://github.com/openai/gpt-2/blob/master/src/encoder.py
-    static const std::string PATTERN_GPT2 =
-        R"('s|'t|'re|'ve|'m|'ll|'d| ?\p{L}+| ?\p{N}+| ?[^\s\p{L}\p{N}]+|\s+(?!\S)|\s+)";
-    matcher_ = std::make_unique<Regex>(PATTERN_GPT2);
+    matcher_ = std::make_unique<SplitMatcher>(SplitPattern::GPT2);
     ASSERT(matcher_->valid());
   }
 }
@@ -168,13 +195,17 @@ StringPieces ByteLevel::preTokenize(const StringPieces& text) {
     auto& pieces = text.pieces;
     auto& firstRange = pieces[0];
     if (!addPrefixSpace_ || text.backStr[firstRange.first] == ' ') {
-      return byteLevelEncode(&pieces[0], pieces.size(), text.backStr, {});
+      if (rawBytes_) {
+        return text;
+      }
+      return byteLevelEncode(&pieces[0], pieces.size(), text.backStr, {}, true);
     } else {
       std::string firstPiece;
       firstPiece.reserve(firstRange.second - firstRange.first + 1);
       firstPiece.push_back(' ');
       firstPiece.append(text.backStr.data() + firstRange.first, firstRange.second - firstRange.first);
-      return byteLevelEncode(pieces.size() > 1 ? &pieces[1] : nullptr, pieces.size() - 1, text.backStr, firstPiece);
+      return byteLevelEncode(pieces.size() > 1 ? &pieces[1] : nullptr, pieces.size() - 1, text.backStr, firstPiece,
+                             !rawBytes_);
     }
   } else {
     std::string_view inputView = text.backStr;
@@ -186,23 +217,37 @@ StringPieces ByteLevel::preTokenize(const StringPieces& text) {
       inputView = inputWithSpace;
     }
     auto pieces = Split::split(inputView, *matcher_, SplitDelimiterBehavior::ISOLATED);
-    return byteLevelEncode(&pieces[0], pieces.size(), inputView, {});
+    if (rawBytes_) {
+      if (inputWithSpace.empty()) {
+        return text.refine(std::move(pieces));
+      }
+      StringPieces ret(std::move(inputWithSpace));
+      ret.pieces = std::move(pieces);
+      return ret;
+    }
+    return byteLevelEncode(&pieces[0], pieces.size(), inputView, {}, true);
   }
 }
 
 StringPieces ByteLevel::byteLevelEncode(const Range* pieces, size_t pieceCnt, std::string_view backStr,
-                                        std::string_view firstPiece) {
+                                        std::string_view firstPiece, bool remap) {
   StringPieces ret;
   ret.pieces.reserve(pieceCnt + (firstPiece.empty() ? 0 : 1));
-  ret.backStr.reserve(backStr.size() * 2);
+  std::string encoded;
+  encoded.reserve(backStr.size() * (remap ? 2 : 1) + firstPiece.size());
 
   auto appendPiece = [&](std::string_view sv) {
-    const auto pos = ret.backStr.size();
+    const auto pos = encoded.size();
+    if (!remap) {
+      encoded.append(sv);
+      ret.pieces.emplace_back(pos, encoded.size());
+      return;
+    }
     for (auto c : sv) {
       const auto ch = static_cast<uint8_t>(c);
-      ret.backStr.append(byteUtf8Table_[ch].data(), byteUtf8Len_[ch]);
+      encoded.append(byteUtf8Table_[ch].data(), byteUtf8Len_[ch]);
     }
-    ret.pieces.emplace_back(pos, ret.backStr.size());
+    ret.pieces.emplace_back(pos, encoded.size());
   };
 
   if (!firstPiece.empty()) {
@@ -213,6 +258,7 @@ StringPieces ByteLevel::byteLevelEncode(const Range* pieces, size_t pieceCnt, st
     auto& r = pieces[i];
     appendPiece(backStr.substr(r.first, r.second - r.first));
   }
+  ret.setText(std::move(encoded));
   return ret;
 }
 
@@ -9,7 +9,7 @@
 #include <vector>
 
 #include "Base.h"
-#include "Regex.h"
+#include "SplitMatcher.h"
 
 namespace tinygpt::tokenizer {
 
@@ -17,7 +17,8 @@ static constexpr size_t UNICODE_CODEPOINT_MAX = 0x110000;
 
 class ByteLevel : public Component {
  public:
-  explicit ByteLevel(bool addPrefixSpace = false, bool useRegex = false);
+  // rawBytes: the model works on raw bytes, pieces are emitted over the original text without the unicode remap
+  explicit ByteLevel(bool addPrefixSpace = false, bool useRegex = false, bool rawBytes = false);
 
   ComponentType getType() override { return ComponentType::BYTE_LEVEL; }
 
@@ -27,16 +28,19 @@ class ByteLevel : public Component {
 
   static const std::array<char32_t, 256> &alphabet() { return bytesChar_; }
   static std::string utf8ToBytes(std::string_view str);
+  // exact inverse of the remap, false if str has a char out of the byte-level alphabet
+  static bool remappedToBytes(std::string_view str, std::string &out);
   static int32_t findIncompletePos(std::string_view str);
   static std::vector<std::string_view> splitUTF8(std::string_view str);
 
  private:
   static StringPieces byteLevelEncode(const Range *pieces, size_t pieceCnt, std::string_view backStr,
-                                      std::string_view firstPiece);
+                                      std::string_view firstPiece, bool remap);
   bool addPrefixSpace_;
   bool useRegex_;
+  bool rawBytes_;
 
-  std::unique_ptr<Regex> matcher_;
+  std::unique_ptr<SplitMatcher> matcher_;
 
   static const std::array<char32_t, 256> bytesChar_;
   static const std::array<uint8_t, 256> byteUtf8Len_;
@@ -68,7 +68,7 @@ StringPieces Metaspace::preTokenize(const StringPieces &text) {
     }
   }
 
-  result.backStr = std::move(processedText);
+  result.setText(std::move(processedText));
   return result;
 }
 
@@ -12,15 +12,24 @@
 
 namespace tinygpt::tokenizer {
 
-class Regex {
+// finds all non-overlapping matches, leftmost first
+class Matcher {
+ public:
+  virtual ~Matcher() = default;
+
+  virtual bool valid() const = 0;
+  virtual void matchAll(std::vector<Range> &ret, std::string_view str) const = 0;
+};
+
+class Regex : public Matcher {
   class Impl;
 
  public:
   explicit Regex(std::string_view pattern);
-  ~Regex();
+  ~Regex() override;
 
-  bool valid() const;
-  void matchAll(std::vector<Range> &ret, std::string_view str) const;
+  bool valid() const override;
+  void matchAll(std::vector<Range> &ret, std::string_view str) const override;
   static std::string quoteMeta(std::string_view unquoted);
 
  private:
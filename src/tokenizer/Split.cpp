@@ -8,9 +8,9 @@
 
 namespace tinygpt::tokenizer {
 
-Split::Split(std::string_view pattern, SplitDelimiterBehavior behavior, bool invert)
+Split::Split(std::string_view pattern, SplitDelimiterBehavior behavior, bool invert, SplitPattern builtin)
     : pattern_(pattern), behavior_(behavior), invert_(invert) {
-  matcher_ = std::make_unique<Regex>(pattern);
+  matcher_ = SplitMatcher::create(pattern, builtin);
   patternValid_ = matcher_->valid();
 
   if (invert) {
@@ -24,16 +24,19 @@ StringPieces Split::preTokenize(const StringPieces &text) {
     return {};
   }
 
-  StringPieces ret;
-  ret.backStr = text.backStr;
+  // refine the ranges, the text is shared
+  std::vector<Range> pieces;
+  pieces.reserve(text.pieces.size());
   for (auto &r : text.pieces) {
-    auto splits = split({ret.backStr.data() + r.first, r.second - r.first}, *matcher_, behavior_);
-    ret.pieces.insert(ret.pieces.end(), splits.begin(), splits.end());
+    auto splits = split(text.backStr.substr(r.first, r.second - r.first), *matcher_, behavior_);
+    for (auto &s : splits) {
+      pieces.emplace_back(r.first + s.first, r.first + s.second);
+    }
   }
-  return ret;
+  return text.refine(std::move(pieces));
 }
 
-std::vector<Range> Split::split(std::string_view str, const Regex &matcher, SplitDelimiterBehavior behavior) {
+std::vector<Range> Split::split(std::string_view str, const Matcher &matcher, SplitDelimiterBehavior behavior) {
   std::vector<Range> matches = match(str, matcher);
   std::vector<Range> splits;
   splits.reserve(matches.size());
@@ -61,7 +64,7 @@ std::vector<Range> Split::split(std::string_view str, const Regex &matcher, Spli
   return splits;
 }
 
-std::vector<Range> Split::match(std::string_view str, const Regex &matcher) {
+std::vector<Range> Split::match(std::string_view str, const Matcher &matcher) {
   std::vector<Range> matches;
   matches.reserve(str.size() / 2);
   matcher.matchAll(matches, str);
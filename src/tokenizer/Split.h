@@ -10,7 +10,7 @@
 #include <vector>
 
 #include "Base.h"
-#include "Regex.h"
+#include "SplitMatcher.h"
 
 namespace tinygpt::tokenizer {
 
@@ -25,17 +25,19 @@ enum class SplitDelimiterBehavior {
 
 class Split : public Component {
  public:
-  Split(std::string_view pattern, SplitDelimiterBehavior behavior, bool invert = false);
+  // builtin: hand-written engine recognized for the pattern, pcre2 is used if UNKNOWN
+  Split(std::string_view pattern, SplitDelimiterBehavior behavior, bool invert = false,
+        SplitPattern builtin = SplitPattern::UNKNOWN);
 
   ComponentType getType() override { return ComponentType::SPLIT; }
 
   StringPieces preTokenize(const StringPieces &text) override;
 
-  static std::vector<Range> split(std::string_view str, const Regex &matcher,
+  static std::vector<Range> split(std::string_view str, const Matcher &matcher,
                                   SplitDelimiterBehavior behavior = SplitDelimiterBehavior::ISOLATED);
 
  private:
-  static std::vector<Range> match(std::string_view str, const Regex &matcher);
+  static std::vector<Range> match(std::string_view str, const Matcher &matcher);
 
   static void splitRemoved(std::vector<Range> &results, std::vector<Range> &matches, size_t originSize);
   static void splitIsolated(std::vector<Range> &results, std::vector<Range> &matches, size_t originSize);
@@ -47,7 +49,7 @@ class Split : public Component {
   SplitDelimiterBehavior behavior_;
   bool invert_;
 
-  std::unique_ptr<Regex> matcher_;
+  std::unique_ptr<Matcher> matcher_;
   bool patternValid_;
 };
 
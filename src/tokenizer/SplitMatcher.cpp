@@ -0,0 +1,467 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#include "SplitMatcher.h"
+
+#include <string>
+
+#include "ankerl/unordered_dense.h"
+#include "utf8proc/utf8proc.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace tinygpt::tokenizer {
+
+// Ref https://github.com/openai/gpt-2/blob/master/src/encoder.py
+static constexpr std::string_view PATTERN_GPT2 =
+    R"('s|'t|'re|'ve|'m|'ll|'d| ?\p{L}+| ?\p{N}+| ?[^\s\p{L}\p{N}]+|\s+(?!\S)|\s+)";
+static constexpr std::string_view PATTERN_LLAMA3 =
+    R"((?i:'s|'t|'re|'ve|'m|'ll|'d)|[^\r\n\p{L}\p{N}]?\p{L}+|\p{N}{1,3}| ?[^\s\p{L}\p{N}]+[\r\n]*|\s*[\r\n]+|\s+(?!\S)|\s+)";
+static constexpr std::string_view PATTERN_QWEN2 =
+    R"((?i:'s|'t|'re|'ve|'m|'ll|'d)|[^\r\n\p{L}\p{N}]?\p{L}+|\p{N}| ?[^\s\p{L}\p{N}]+[\r\n]*|\s*[\r\n]+|\s+(?!\S)|\s+)";
+
+static constexpr uint32_t CODEPOINT_MAX = 0x110000;
+
+static constexpr uint8_t CLASS_LETTER = 1;   // \p{L}
+static constexpr uint8_t CLASS_NUMBER = 2;   // \p{N}
+static constexpr uint8_t CLASS_SPACE = 4;    // \s
+static constexpr uint8_t CLASS_NEWLINE = 8;  // [\r\n]
+
+// two-stage table: codepoint >> 8 selects a deduplicated block of 256 classes
+class UnicodeClasses {
+ public:
+  static const UnicodeClasses &instance() {
+    static const UnicodeClasses classes;
+    return classes;
+  }
+
+  uint8_t get(uint32_t cp) const { return blocks_[(static_cast<size_t>(index_[cp >> 8]) << 8) | (cp & 0xFF)]; }
+  const uint8_t *ascii() const { return ascii_; }
+
+ private:
+  UnicodeClasses() {
+    // all scalar values in one string, each class is the union of the matches of its pcre2 property
+    std::string all;
+    all.reserve(4 * CODEPOINT_MAX);
+    for (uint32_t cp = 0; cp < CODEPOINT_MAX; cp++) {
+      if (cp >= 0xD800 && cp < 0xE000) {
+        continue;
+      }
+      utf8proc_uint8_t buf[4];
+      auto len = utf8proc_encode_char(static_cast<utf8proc_int32_t>(cp), buf);
+      all.append(reinterpret_cast<const char *>(buf), len);
+    }
+
+    std::vector<uint8_t> classes(CODEPOINT_MAX, 0);
+    const std::pair<const char *, uint8_t> properties[] = {
+        {R"(\p{L}+)", CLASS_LETTER},
+        {R"(\p{N}+)", CLASS_NUMBER},
+        {R"(\s+)", CLASS_SPACE},
+    };
+    std::vector<Range> matches;
+    for (auto &[pattern, cls] : properties) {
+      Regex regex(pattern);
+      ASSERT(regex.valid());
+      matches.clear();
+      regex.matchAll(matches, all);
+      for (auto &[begin, end] : matches) {
+        const auto *data = reinterpret_cast<const utf8proc_uint8_t *>(all.data());
+        for (size_t i = begin; i < end;) {
+          utf8proc_int32_t cp;
+          auto len = utf8proc_iterate(data + i, static_cast<utf8proc_ssize_t>(end - i), &cp);
+          ASSERT(len > 0);
+          classes[cp] |= cls;
+          i += len;
+        }
+      }
+    }
+    classes['\r'] |= CLASS_NEWLINE;
+    classes['\n'] |= CLASS_NEWLINE;
+
+    ankerl::unordered_dense::map<std::string_view, uint16_t> blockIds;
+    index_.resize(CODEPOINT_MAX >> 8);
+    for (size_t b = 0; b < index_.size(); b++) {
+      std::string_view block(reinterpret_cast<const char *>(classes.data()) + (b << 8), 256);
+      auto [it, inserted] = blockIds.try_emplace(block, static_cast<uint16_t>(blockIds.size()));
+      if (inserted) {
+        blocks_.insert(blocks_.end(), block.begin(), block.end());
+      }
+      index_[b] = it->second;
+    }
+    ascii_ = blocks_.data() + (static_cast<size_t>(index_[0]) << 8);
+  }
+
+  std::vector<uint16_t> index_;
+  std::vector<uint8_t> blocks_;
+  const uint8_t *ascii_ = nullptr;
+};
+
+// strict UTF-8 decode (no overlong, surrogate or out of range forms), returns 0 if invalid
+static inline size_t decodeUTF8(const uint8_t *s, size_t n, uint32_t *cp) {
+  const uint8_t c = s[0];
+  if (c < 0x80) {
+    *cp = c;
+    return 1;
+  }
+  if (c < 0xC2) {
+    return 0;  // continuation byte or overlong 2-byte form
+  }
+  if (c < 0xE0) {
+    if (n < 2 || (s[1] & 0xC0) != 0x80) {
+      return 0;
+    }
+    *cp = ((c & 0x1Fu) << 6) | (s[1] & 0x3Fu);
+    return 2;
+  }
+  if (c < 0xF0) {
+    if (n < 3 || (s[1] & 0xC0) != 0x80 || (s[2] & 0xC0) != 0x80) {
+      return 0;
+    }
+    uint32_t v = ((c & 0x0Fu) << 12) | ((s[1] & 0x3Fu) << 6) | (s[2] & 0x3Fu);
+    if (v < 0x800 || (v >= 0xD800 && v < 0xE000)) {
+      return 0;
+    }
+    *cp = v;
+    return 3;
+  }
+  if (c < 0xF5) {
+    if (n < 4 || (s[1] & 0xC0) != 0x80 || (s[2] & 0xC0) != 0x80 || (s[3] & 0xC0) != 0x80) {
+      return 0;
+    }
+    uint32_t v = ((c & 0x07u) << 18) | ((s[1] & 0x3Fu) << 12) | ((s[2] & 0x3Fu) << 6) | (s[3] & 0x3Fu);
+    if (v < 0x10000 || v >= CODEPOINT_MAX) {
+      return 0;
+    }
+    *cp = v;
+    return 4;
+  }
+  return 0;
+}
+
+// length of the leading ASCII letters [A-Za-z]
+static size_t asciiLetterPrefix(const uint8_t *s, size_t n) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i lower = _mm_set1_epi8(0x20);
+  const __m128i offset = _mm_set1_epi8(static_cast<char>('a' + 0x80));
+  const __m128i limit = _mm_set1_epi8(static_cast<char>(-0x80 + 26));
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i)), lower);
+    // (v - 'a') < 26 as unsigned, in signed compare
+    auto isLetter = _mm_cmplt_epi8(_mm_sub_epi8(v, offset), limit);
+    auto mask = static_cast<uint32_t>(_mm_movemask_epi8(isLetter)) ^ 0xFFFFu;
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#elif defined(__ARM_NEON)
+  for (; i + 16 <= n; i += 16) {
+    uint8x16_t v = vsubq_u8(vorrq_u8(vld1q_u8(s + i), vdupq_n_u8(0x20)), vdupq_n_u8('a'));
+    if (vminvq_u8(vcltq_u8(v, vdupq_n_u8(26))) == 0) {
+      break;
+    }
+  }
+#endif
+  while (i < n && static_cast<uint8_t>((s[i] | 0x20) - 'a') < 26) {
+    i++;
+  }
+  return i;
+}
+
+// cursor over a UTF-8 string, invalid sequences are consumed byte by byte as class 0 and flagged
+class Scanner {
+ public:
+  explicit Scanner(std::string_view str)
+      : s_(reinterpret_cast<const uint8_t *>(str.data())),
+        n_(str.size()),
+        classes_(UnicodeClasses::instance()),
+        ascii_(classes_.ascii()) {}
+
+  size_t size() const { return n_; }
+  uint8_t byte(size_t pos) const { return s_[pos]; }
+  bool invalid() const { return invalid_; }
+
+  // class of the char at pos, `len` gets its byte length
+  uint8_t classAt(size_t pos, size_t *len) const {
+    if (s_[pos] < 0x80) {
+      *len = 1;
+      return ascii_[s_[pos]];
+    }
+    uint32_t cp;
+    *len = decodeUTF8(s_ + pos, n_ - pos, &cp);
+    if (*len == 0) {
+      invalid_ = true;
+      *len = 1;
+      return 0;
+    }
+    return classes_.get(cp);
+  }
+
+  uint8_t classAt(size_t pos) const {
+    size_t len;
+    return classAt(pos, &len);
+  }
+
+  uint32_t codepointAt(size_t pos, size_t *len) const {
+    uint32_t cp;
+    *len = decodeUTF8(s_ + pos, n_ - pos, &cp);
+    if (*len == 0) {
+      invalid_ = true;
+      *len = 1;
+      return 0;
+    }
+    return cp;
+  }
+
+  // end of the run of chars from pos whose class has any bit in `mask` (none, if `mask` is 0)
+  template <uint8_t mask>
+  size_t skip(size_t pos) const {
+    while (pos < n_) {
+      if constexpr (mask == CLASS_LETTER) {
+        pos += asciiLetterPrefix(s_ + pos, n_ - pos);
+        if (pos >= n_) {
+          break;
+        }
+      }
+      size_t len;
+      auto cls = classAt(pos, &len);
+      if constexpr (mask == 0) {
+        if (cls & (CLASS_LETTER | CLASS_NUMBER | CLASS_SPACE)) {
+          break;
+        }
+      } else {
+        if (!(cls & mask)) {
+          break;
+        }
+      }
+      pos += len;
+    }
+    return pos;
+  }
+
+ private:
+  const uint8_t *s_;
+  size_t n_;
+  const UnicodeClasses &classes_;
+  const uint8_t *ascii_;
+  mutable bool invalid_ = false;
+};
+
+static bool isOther(uint8_t cls) { return !(cls & (CLASS_LETTER | CLASS_NUMBER | CLASS_SPACE)); }
+
+// 's|'t|'re|'ve|'m|'ll|'d at pos (which is '\''), returns the match end or 0
+template <bool caseless>
+static size_t matchContraction(const Scanner &sc, size_t pos) {
+  auto lowerAt = [&](size_t p, size_t *len) -> uint32_t {
+    if (p >= sc.size()) {
+      return 0;
+    }
+    auto cp = sc.codepointAt(p, len);
+    if constexpr (caseless) {
+      if (cp >= 'A' && cp <= 'Z') {
+        cp |= 0x20;
+      } else if (cp == 0x17F) {  // LATIN SMALL LETTER LONG S folds to 's'
+        cp = 's';
+      }
+    }
+    return cp;
+  };
+
+  size_t len = 0;
+  size_t p = pos + 1;
+  auto c = lowerAt(p, &len);
+  p += len;
+  switch (c) {
+    case 's':
+    case 't':
+    case 'm':
+    case 'd':
+      return p;
+    case 'r':
+    case 'v':
+      return lowerAt(p, &len) == 'e' ? p + len : 0;
+    case 'l':
+      return lowerAt(p, &len) == 'l' ? p + len : 0;
+    default:
+      return 0;
+  }
+}
+
+// \s+(?!\S)|\s+ and for Llama-3 style patterns also \s*[\r\n]+ before them
+template <bool newlineRule>
+static size_t matchSpaces(const Scanner &sc, size_t pos) {
+  size_t lastStart = pos;
+  size_t newlineEnd = 0;
+  size_t end = pos;
+  while (end < sc.size()) {
+    size_t len;
+    auto cls = sc.classAt(end, &len);
+    if (!(cls & CLASS_SPACE)) {
+      break;
+    }
+    lastStart = end;
+    end += len;
+    if (cls & CLASS_NEWLINE) {
+      newlineEnd = end;
+    }
+  }
+  if (newlineRule && newlineEnd != 0) {
+    return newlineEnd;
+  }
+  // leave the last space to the following word
+  if (end < sc.size() && lastStart > pos) {
+    return lastStart;
+  }
+  return end;
+}
+
+// 's|'t|'re|'ve|'m|'ll|'d| ?\p{L}+| ?\p{N}+| ?[^\s\p{L}\p{N}]+|\s+(?!\S)|\s+
+static size_t matchGPT2(const Scanner &sc, size_t pos) {
+  if (sc.byte(pos) == '\'') {
+    if (auto end = matchContraction<false>(sc, pos)) {
+      return end;
+    }
+  }
+
+  size_t body = pos;
+  size_t len;
+  auto cls = sc.classAt(pos, &len);
+  if (sc.byte(pos) == ' ' && pos + 1 < sc.size()) {
+    auto next = sc.classAt(pos + 1);
+    if (!(next & CLASS_SPACE)) {
+      body = pos + 1;
+      cls = next;
+    }
+  }
+  if (cls & CLASS_LETTER) {
+    return sc.skip<CLASS_LETTER>(body);
+  }
+  if (cls & CLASS_NUMBER) {
+    return sc.skip<CLASS_NUMBER>(body);
+  }
+  if (isOther(cls)) {
+    return sc.skip<0>(body);
+  }
+  return matchSpaces<false>(sc, pos);
+}
+
+// (?i:'s|'t|'re|'ve|'m|'ll|'d)|[^\r\n\p{L}\p{N}]?\p{L}+|\p{N}{1,maxDigits}| ?[^\s\p{L}\p{N}]+[\r\n]*|\s*[\r\n]+|
+// \s+(?!\S)|\s+
+template <size_t maxDigits>
+static size_t matchLlama3(const Scanner &sc, size_t pos) {
+  if (sc.byte(pos) == '\'') {
+    if (auto end = matchContraction<true>(sc, pos)) {
+      return end;
+    }
+  }
+
+  size_t len;
+  auto cls = sc.classAt(pos, &len);
+  if (cls & CLASS_LETTER) {
+    return sc.skip<CLASS_LETTER>(pos);
+  }
+  if (!(cls & (CLASS_NUMBER | CLASS_NEWLINE)) && pos + len < sc.size() && (sc.classAt(pos + len) & CLASS_LETTER)) {
+    return sc.skip<CLASS_LETTER>(pos + len);
+  }
+  if (cls & CLASS_NUMBER) {
+    size_t end = pos + len;
+    for (size_t i = 1; i < maxDigits && end < sc.size(); i++) {
+      if (!(sc.classAt(end, &len) & CLASS_NUMBER)) {
+        break;
+      }
+      end += len;
+    }
+    return end;
+  }
+
+  size_t body = pos;
+  if (sc.byte(pos) == ' ' && pos + 1 < sc.size() && isOther(sc.classAt(pos + 1))) {
+    body = pos + 1;
+    cls = 0;
+  }
+  if (isOther(cls)) {
+    size_t end = sc.skip<0>(body);
+    while (end < sc.size() && (sc.byte(end) == '\r' || sc.byte(end) == '\n')) {
+      end++;
+    }
+    return end;
+  }
+  return matchSpaces<true>(sc, pos);
+}
+
+template <size_t (*match)(const Scanner &, size_t)>
+static void matchLoop(std::vector<Range> &ret, std::string_view str) {
+  const auto base = ret.size();
+  Scanner sc(str);
+  for (size_t pos = 0; pos < sc.size();) {
+    auto end = match(sc, pos);
+    ret.emplace_back(pos, end);
+    pos = end;
+  }
+  // pcre2 rejects the whole subject on invalid UTF-8
+  if (sc.invalid()) {
+    ret.resize(base);
+  }
+}
+
+SplitMatcher::SplitMatcher(SplitPattern pattern) : pattern_(pattern) {
+  if (pattern_ != SplitPattern::UNKNOWN) {
+    // build the tables now instead of inside the first encode
+    UnicodeClasses::instance();
+  }
+}
+
+SplitPattern SplitMatcher::recognize(std::string_view pattern) {
+  for (auto p : {SplitPattern::GPT2, SplitPattern::LLAMA3, SplitPattern::QWEN2}) {
+    if (pattern == patternString(p)) {
+      return p;
+    }
+  }
+  return SplitPattern::UNKNOWN;
+}
+
+std::string_view SplitMatcher::patternString(SplitPattern pattern) {
+  switch (pattern) {
+    case SplitPattern::GPT2:
+      return PATTERN_GPT2;
+    case SplitPattern::LLAMA3:
+      return PATTERN_LLAMA3;
+    case SplitPattern::QWEN2:
+      return PATTERN_QWEN2;
+    default:
+      break;
+  }
+  return {};
+}
+
+std::unique_ptr<Matcher> SplitMatcher::create(std::string_view pattern, SplitPattern builtin) {
+  if (builtin != SplitPattern::UNKNOWN) {
+    return std::make_unique<SplitMatcher>(builtin);
+  }
+  return std::make_unique<Regex>(pattern);
+}
+
+void SplitMatcher::matchAll(std::vector<Range> &ret, std::string_view str) const {
+  switch (pattern_) {
+    case SplitPattern::GPT2:
+      matchLoop<matchGPT2>(ret, str);
+      break;
+    case SplitPattern::LLAMA3:
+      matchLoop<matchLlama3<3>>(ret, str);
+      break;
+    case SplitPattern::QWEN2:
+      matchLoop<matchLlama3<1>>(ret, str);
+      break;
+    default:
+      break;
+  }
+}
+
+}  // namespace tinygpt::tokenizer
@@ -0,0 +1,41 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#pragma once
+
+#include "Regex.h"
+
+namespace tinygpt::tokenizer {
+
+// split regexes shipped by HuggingFace tokenizers which have a hand-written engine
+enum class SplitPattern {
+  UNKNOWN = 0,
+  GPT2,    // also the ByteLevel `use_regex` pattern
+  LLAMA3,  // Llama-3
+  QWEN2,   // Qwen2/2.5/3
+};
+
+// State machine over unicode class tables, gives exactly the matches of the pcre2 Regex of the same pattern.
+// Class tables are derived from pcre2's own \p{L}, \p{N} and \s, so both engines agree on every codepoint.
+class SplitMatcher : public Matcher {
+ public:
+  explicit SplitMatcher(SplitPattern pattern);
+
+  // builtin pattern of a split regex, UNKNOWN if it should run on pcre2
+  static SplitPattern recognize(std::string_view pattern);
+  static std::string_view patternString(SplitPattern pattern);
+
+  // hand-written engine for known patterns, pcre2 Regex otherwise
+  static std::unique_ptr<Matcher> create(std::string_view pattern, SplitPattern builtin);
+
+  bool valid() const override { return pattern_ != SplitPattern::UNKNOWN; }
+  void matchAll(std::vector<Range> &ret, std::string_view str) const override;
+
+ private:
+  SplitPattern pattern_;
+};
+
+}  // namespace tinygpt::tokenizer
@@ -0,0 +1,255 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#include "StreamEncoder.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace tinygpt::tokenizer {
+
+// line starts tried as cut per chunk, from the end
+constexpr int kMaxCutCandidates = 4;
+
+static bool isSpaceByte(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f'; }
+
+static bool startsWith(const std::vector<int32_t> &ids, const std::vector<int32_t> &prefix) {
+  return ids.size() >= prefix.size() && std::equal(prefix.begin(), prefix.end(), ids.begin());
+}
+
+// last line of a text, with its trailing newline
+static std::string_view lastLine(std::string_view text) {
+  auto lineStart = text.size() >= 2 ? text.rfind('\n', text.size() - 2) : std::string_view::npos;
+  return text.substr(lineStart == std::string_view::npos ? 0 : lineStart + 1);
+}
+
+StreamEncoder::StreamEncoder(const Tokenizer &tokenizer, Sink sink, bool allowAddedTokens, size_t chunkSize)
+    : tokenizer_(tokenizer),
+      sink_(std::move(sink)),
+      allowAddedTokens_(allowAddedTokens),
+      chunkSize_(std::max<size_t>(chunkSize, 1)) {
+  // special tokens before and after a placeholder id, a segment cut in parts gets them on its first and last part
+  constexpr int32_t kPlaceholder = -1;
+  std::vector<int32_t> probe = {kPlaceholder};
+  if (tokenizer_.postProcessor_) {
+    probe = tokenizer_.postProcessor_->postProcess(probe, allowAddedTokens_);
+  }
+  if (std::count(probe.begin(), probe.end(), kPlaceholder) == 1) {
+    auto it = std::find(probe.begin(), probe.end(), kPlaceholder);
+    segmentPrefix_.assign(probe.begin(), it);
+    segmentSuffix_.assign(it + 1, probe.end());
+    cuttable_ = true;
+  }
+  reset();
+}
+
+StreamEncoder::StreamEncoder(const Tokenizer &tokenizer, std::vector<int32_t> &out, bool allowAddedTokens,
+                             size_t chunkSize)
+    : StreamEncoder(
+          tokenizer, [&out](const int32_t *ids, size_t n) { out.insert(out.end(), ids, ids + n); }, allowAddedTokens,
+          chunkSize) {}
+
+void StreamEncoder::feed(std::string_view bytes) {
+  // a large input (e.g. a whole mapping) is taken in chunks, so the buffer does not copy all of it
+  while (!bytes.empty()) {
+    auto n = std::min(bytes.size(), chunkSize_);
+    buffer_.append(bytes.data(), n);
+    bytes.remove_prefix(n);
+
+    auto pending = buffer_.size() - bufferStart_;
+    if (pending >= processAt_) {
+      process(false);
+      pending = buffer_.size() - bufferStart_;
+      processAt_ = pending + std::max(chunkSize_, pending);
+    }
+  }
+}
+
+bool StreamEncoder::feed(std::istream &in) {
+  std::string chunk(chunkSize_, '\0');
+  while (in) {
+    in.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+    auto n = static_cast<size_t>(in.gcount());
+    if (n > 0) {
+      feed(std::string_view(chunk.data(), n));
+    }
+  }
+  return !in.bad();
+}
+
+void StreamEncoder::finish() {
+  process(true);
+  if (started_ && tokenizer_.addEosToken_ && lastId_ != tokenizer_.eosTokenId_) {
+    sink_(&tokenizer_.eosTokenId_, 1);
+  }
+  reset();
+}
+
+void StreamEncoder::process(bool final) {
+  std::string_view text = buffer_;
+  std::vector<AddedTokenPiece> pieces;
+  if (allowAddedTokens_) {
+    tokenizer_.addedTokens_.split(pieces, text, bufferStart_);
+  } else if (bufferStart_ < text.size()) {
+    pieces.push_back({{static_cast<uint32_t>(bufferStart_), static_cast<uint32_t>(text.size())}, -1});
+  }
+
+  // the last bytes may still become (part of) an added token
+  size_t safeEnd = text.size();
+  if (!final && allowAddedTokens_) {
+    safeEnd -= std::min(safeEnd, tokenizer_.addedTokens_.maxLength());
+  }
+
+  size_t consumed = bufferStart_;
+  for (size_t i = 0; i < pieces.size(); i++) {
+    auto &range = pieces[i].range;
+    auto piece = text.substr(range.first, range.second - range.first);
+    const bool complete = final || (range.second <= safeEnd && (pieces[i].id >= 0 || i + 1 < pieces.size()));
+    if (complete) {
+      if (pieces[i].id >= 0) {
+        emit({pieces[i].id});
+      } else if (inSegment_) {
+        continueSegment(piece, true);
+      } else {
+        emit(tokenizer_.encodeWithModel(piece, allowAddedTokens_));
+      }
+      consumed = range.second;
+      continue;
+    }
+
+    // text still growing: encode the part before a cut
+    size_t cut;
+    if (pieces[i].id < 0 && cuttable_ && findCut(text, range.first, std::min<size_t>(safeEnd, range.second), &cut)) {
+      continueSegment(text.substr(range.first, cut - range.first), false);
+      consumed = cut;
+    }
+    break;
+  }
+
+  // keep one byte before the pending text as context
+  if (consumed > bufferStart_) {
+    buffer_.erase(0, consumed - 1);
+    bufferStart_ = 1;
+  }
+}
+
+// A line start in text[begin, end) after a newline with no whitespace around, at which the encoding splits: the line
+// before encodes to the same ids whether or not the next line follows. Pieces of the split regexes never cross it,
+// and start-of-text rules (prefix space, prepend) go to the context line of the next part.
+bool StreamEncoder::findCut(std::string_view text, size_t begin, size_t end, size_t *cut) const {
+  int candidates = 0;
+  size_t pos = end;
+  while (pos > begin + 1 && candidates < kMaxCutCandidates) {
+    auto nl = text.rfind('\n', pos - 2);
+    if (nl == std::string_view::npos || nl < begin) {
+      break;
+    }
+    pos = nl + 1;
+    // a lone newline, so it is not part of a longer whitespace run
+    if (nl == begin || isSpaceByte(text[nl - 1]) || isSpaceByte(text[pos])) {
+      continue;
+    }
+    candidates++;
+
+    auto lineStart = text.rfind('\n', nl - 1);
+    lineStart = (lineStart == std::string_view::npos || lineStart < begin) ? begin : lineStart + 1;
+    auto nextEnd = text.find('\n', pos);
+    nextEnd = nextEnd == std::string_view::npos ? end : std::min(end, nextEnd + 1);
+    if (isCutSafe(text.substr(lineStart, pos - lineStart), text.substr(pos, nextEnd - pos))) {
+      *cut = pos;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool StreamEncoder::isCutSafe(std::string_view line, std::string_view next) const {
+  auto lineIds = tokenizer_.encodePieces(line);
+  std::string joined(line);
+  joined.append(next);
+  auto joinedIds = tokenizer_.encodePieces(joined);
+  return joinedIds.size() > lineIds.size() && startsWith(joinedIds, lineIds);
+}
+
+// The part before a cut is held until the text after the cut is known: emitted if its last line keeps its ids with
+// that text after it, otherwise the cut is undone and both are encoded together. So no ids are emitted before the
+// text they depend on is seen.
+void StreamEncoder::continueSegment(std::string_view text, bool last) {
+  std::vector<int32_t> ids;
+  if (!inSegment_) {
+    heldIds_ = segmentPrefix_;
+    auto partIds = tokenizer_.encodePieces(text);
+    heldIds_.insert(heldIds_.end(), partIds.begin(), partIds.end());
+    held_ = text;
+    heldFirst_ = true;
+    inSegment_ = true;
+  } else if (encodeAfter(lastLine(held_), text, ids)) {
+    emit(heldIds_);
+    context_ = lastLine(held_);
+    heldIds_ = std::move(ids);
+    held_ = text;
+    heldFirst_ = false;
+  } else {
+    held_.append(text);
+    if (heldFirst_) {
+      heldIds_ = segmentPrefix_;
+      auto partIds = tokenizer_.encodePieces(held_);
+      heldIds_.insert(heldIds_.end(), partIds.begin(), partIds.end());
+    } else {
+      // the context was confirmed with the start of the held text before it was emitted
+      encodeAfter(context_, held_, heldIds_);
+    }
+  }
+
+  if (last) {
+    heldIds_.insert(heldIds_.end(), segmentSuffix_.begin(), segmentSuffix_.end());
+    emit(heldIds_);
+    held_.clear();
+    heldIds_.clear();
+    inSegment_ = false;
+  }
+}
+
+// ids of text encoded after the context line, so the text is not taken as the start of a segment.
+// false if the context itself encodes differently with the text after it
+bool StreamEncoder::encodeAfter(std::string_view context, std::string_view text, std::vector<int32_t> &ids) const {
+  auto contextIds = tokenizer_.encodePieces(context);
+  std::string joined(context);
+  joined.append(text);
+  ids = tokenizer_.encodePieces(joined);
+  const bool same = startsWith(ids, contextIds);
+  ids.erase(ids.begin(), ids.begin() + static_cast<std::ptrdiff_t>(std::min(contextIds.size(), ids.size())));
+  return same;
+}
+
+void StreamEncoder::emit(const std::vector<int32_t> &ids) {
+  if (ids.empty()) {
+    return;
+  }
+  if (!started_) {
+    started_ = true;
+    if (tokenizer_.addBosToken_ && ids.front() != tokenizer_.bosTokenId_) {
+      sink_(&tokenizer_.bosTokenId_, 1);
+    }
+  }
+  sink_(ids.data(), ids.size());
+  lastId_ = ids.back();
+}
+
+void StreamEncoder::reset() {
+  buffer_.clear();
+  processAt_ = chunkSize_;
+  bufferStart_ = 0;
+  inSegment_ = false;
+  held_.clear();
+  heldIds_.clear();
+  heldFirst_ = false;
+  context_.clear();
+  started_ = false;
+  lastId_ = -1;
+}
+
+}  // namespace tinygpt::tokenizer
@@ -0,0 +1,75 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#pragma once
+
+#include <functional>
+#include <istream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Tokenizer.h"
+
+namespace tinygpt::tokenizer {
+
+// Incremental encoder for input which does not fit in memory, the ids are the same as Tokenizer::encode of the
+// whole input. Pending bytes are encoded once they reach `chunkSize`, cut at added tokens or at line starts whose
+// encoding does not depend on the text before, the rest (with any incomplete pre-token or utf-8 sequence) is
+// carried to the next chunk. The part before a cut is only emitted once the text up to the next cut confirms it.
+// Memory stays around twice `chunkSize` as long as the input has such cuts, a single huge line is buffered whole.
+class StreamEncoder {
+ public:
+  using Sink = std::function<void(const int32_t *ids, size_t n)>;
+
+  static constexpr size_t kDefaultChunkSize = 1024 * 1024;
+
+  StreamEncoder(const Tokenizer &tokenizer, Sink sink, bool allowAddedTokens = true,
+                size_t chunkSize = kDefaultChunkSize);
+  // append the ids to `out`
+  StreamEncoder(const Tokenizer &tokenizer, std::vector<int32_t> &out, bool allowAddedTokens = true,
+                size_t chunkSize = kDefaultChunkSize);
+
+  // bytes of a file, a socket or a mapping, in pieces of any size
+  void feed(std::string_view bytes);
+  // feed the stream to its end, false on read error
+  bool feed(std::istream &in);
+
+  // encode the pending bytes, the encoder can be reused for another input afterwards
+  void finish();
+
+ private:
+  void process(bool final);
+  bool findCut(std::string_view text, size_t begin, size_t end, size_t *cut) const;
+  bool isCutSafe(std::string_view line, std::string_view next) const;
+  void continueSegment(std::string_view text, bool last);
+  bool encodeAfter(std::string_view context, std::string_view text, std::vector<int32_t> &ids) const;
+  void emit(const std::vector<int32_t> &ids);
+  void reset();
+
+  const Tokenizer &tokenizer_;
+  Sink sink_;
+  bool allowAddedTokens_;
+  size_t chunkSize_;
+
+  // special tokens the post-processor puts around every segment between added tokens
+  std::vector<int32_t> segmentPrefix_;
+  std::vector<int32_t> segmentSuffix_;
+  bool cuttable_ = false;
+
+  std::string buffer_;
+  size_t processAt_ = 0;    // pending size of the next encoding, grows while no cut is found
+  size_t bufferStart_ = 0;  // pending text, bytes before are context for single_word added tokens
+  bool inSegment_ = false;  // pending text continues a segment of which a part is cut off
+  std::string held_;        // last part cut off, not emitted until the text after it confirms the cut
+  std::vector<int32_t> heldIds_;
+  bool heldFirst_ = false;  // held part starts the segment
+  std::string context_;     // last line of the part emitted before the held one
+  bool started_ = false;
+  int32_t lastId_ = -1;
+};
+
+}  // namespace tinygpt::tokenizer
@@ -6,24 +6,17 @@
 
 #include "Tokenizer.h"
 
-#include <thread>
+#include <algorithm>
 
 #include "huggingface/TokenizerConfig.h"
+#include "util/ThreadPool.h"
 
 namespace tinygpt::tokenizer {
 
-Tokenizer::~Tokenizer() {
-  {
-    std::lock_guard<std::mutex> lock(mutex_);
-    stop_ = true;
-  }
-  cv_.notify_all();
-  for (auto& t : threads_) {
-    if (t.joinable()) {
-      t.join();
-    }
-  }
-}
+// batch costs are in text bytes, a decoded id gives about this many
+constexpr size_t kDecodeBytesPerId = 4;
+
+Tokenizer::~Tokenizer() = default;
 
 bool Tokenizer::initWithConfig(const std::string& tokenizerPath, const std::string& cfgPath) {
   namespace ht = huggingface::tokenizer;
@@ -40,14 +33,14 @@ bool Tokenizer::initWithConfig(const std::string& tokenizerPath, const std::stri
   decoder_ = ht::createComponent(config.decoder);
 
   // add token
-  ankerl::unordered_dense::map<std::string, int32_t> addedTokens;
+  std::vector<AddedToken> addedTokens;
   for (auto& t : config.addedTokens) {
     // skip reserved tokens
     constexpr char const* RESERVED_TOKEN_HF = "reserved_special_token";
     if (t.content.find(RESERVED_TOKEN_HF) != std::string::npos) {
       continue;
     }
-    addedTokens[t.content] = t.id;
+    addedTokens.push_back({t.content, t.id, t.singleWord, t.lStrip, t.rStrip});
   }
   addTokens(addedTokens);
 
@@ -89,17 +82,17 @@ std::vector<int32_t> Tokenizer::encode(const std::string& text, bool allowAddedT
   if (!allowAddedTokens) {
     ret = encodeWithModel(text, false);
   } else {
-    auto pieces = splitAddedTokens(text);
+    std::vector<AddedTokenPiece> pieces;
+    addedTokens_.split(pieces, text);
     for (auto& piece : pieces) {
       // added tokens
-      auto it = addedEncoder_.find(piece);
-      if (it != addedEncoder_.end()) {
-        ret.push_back(it->second);
+      if (piece.id >= 0) {
+        ret.push_back(piece.id);
         continue;
       }
 
       // other tokens
-      auto ids = encodeWithModel(piece, true);
+      auto ids = encodeWithModel({text.data() + piece.range.first, piece.range.second - piece.range.first}, true);
       ret.insert(ret.end(), ids.begin(), ids.end());
     }
   }
@@ -134,7 +127,8 @@ std::vector<std::vector<int32_t>> Tokenizer::encodeBatch(tinytorch::ArrayView<st
                                                          bool allowAddedTokens) {
   std::vector<std::vector<int32_t>> results(texts.size());
   parallelFor<std::string, std::vector<int32_t>>(
-      texts, results, [&](const std::string& s) { return encode(s, allowAddedTokens); }, numThreads);
+      texts, results, [&](const std::string& s) { return encode(s, allowAddedTokens); },
+      [](const std::string& s) { return s.size(); }, numThreads);
   return results;
 }
 
@@ -176,7 +170,8 @@ std::vector<std::string> Tokenizer::decodeBatch(tinytorch::ArrayView<tinytorch::
                                                 uint32_t numThreads) {
   std::vector<std::string> results(ids.size());
   parallelFor<tinytorch::ArrayView<int32_t>, std::string>(
-      ids, results, [&](tinytorch::ArrayView<int32_t> v) { return decode(v, 0); }, numThreads);
+      ids, results, [&](tinytorch::ArrayView<int32_t> v) { return decode(v, 0); },
+      [](tinytorch::ArrayView<int32_t> v) { return v.size() * kDecodeBytesPerId; }, numThreads);
   return results;
 }
 
@@ -197,7 +192,8 @@ std::vector<std::string> Tokenizer::decodeBatch(tinytorch::ArrayView<int32_t> id
   }
 
   parallelFor<tinytorch::ArrayView<int32_t>, std::string>(
-      idsList, results, [&](tinytorch::ArrayView<int32_t> v) { return decode(v, offset); }, numThreads);
+      idsList, results, [&](tinytorch::ArrayView<int32_t> v) { return decode(v, offset); },
+      [&](tinytorch::ArrayView<int32_t> v) { return (v.size() - offset) * kDecodeBytesPerId; }, numThreads);
   return results;
 }
 
@@ -266,58 +262,80 @@ std::string Tokenizer::decodeStreamFlush() {
   return retStr;
 }
 
-void Tokenizer::addTokens(const ankerl::unordered_dense::map<std::string, int32_t>& tokens) {
-  addedEncoder_ = tokens;
+void Tokenizer::addTokens(const std::vector<AddedToken>& tokens) {
+  addedEncoder_.clear();
   minAddedTokenId_ = std::numeric_limits<int32_t>::max();
-  int32_t cnt = 0;
-  for (auto& [k, v] : tokens) {
-    minAddedTokenId_ = std::min(minAddedTokenId_, v);
-    maxAddedTokenId_ = std::max(maxAddedTokenId_, v);
-    if (cnt > 0) {
-      addedPattern_ += "|";
-    }
-    addedPattern_ += Regex::quoteMeta(k);
-    cnt++;
+  for (auto& t : tokens) {
+    addedEncoder_[t.content] = t.id;
+    minAddedTokenId_ = std::min(minAddedTokenId_, t.id);
+    maxAddedTokenId_ = std::max(maxAddedTokenId_, t.id);
   }
   addedDecoder_.resize(maxAddedTokenId_ - minAddedTokenId_ + 1);
-  for (auto& [k, v] : tokens) {
-    addedDecoder_[v - minAddedTokenId_] = k;
-  }
-  if (!addedPattern_.empty()) {
-    addedMatcher_ = std::make_unique<Regex>("(" + addedPattern_ + ")");
-    ASSERT(addedMatcher_->valid());
+  for (auto& t : tokens) {
+    addedDecoder_[t.id - minAddedTokenId_] = t.content;
   }
+  addedTokens_.build(tokens);
 }
 
-std::vector<std::string> Tokenizer::splitAddedTokens(const std::string& text) const {
-  if (!addedMatcher_) {
-    return {text};
-  }
-  const auto ranges = Split::split(text, *addedMatcher_, SplitDelimiterBehavior::ISOLATED);
-  std::vector<std::string> results;
-  results.reserve(ranges.size());
-  for (const auto& r : ranges) {
-    results.emplace_back(text.substr(r.first, r.second - r.first));
+std::vector<int32_t> Tokenizer::encodeWithModel(std::string_view text, bool addSpecialTokens) const {
+  std::vector<int32_t> ids = encodePieces(text);
+  if (postProcessor_) {
+    ids = postProcessor_->postProcess(ids, addSpecialTokens);
   }
-  return results;
+  return ids;
 }
 
-std::vector<int32_t> Tokenizer::encodeWithModel(const std::string& text, bool addSpecialTokens) const {
-  std::string normedText;
-  if (normalizer_) {
-    normedText = normalizer_->normalize(text);
-  } else {
-    normedText = text;
-  }
-  StringPieces preTokenizedStr(normedText);
+std::vector<int32_t> Tokenizer::encodePieces(std::string_view text) const {
+  // borrows the input text, only the normalizer and byte rewriting pre-tokenizers allocate a new buffer
+  StringPieces preTokenizedStr = normalizer_ ? StringPieces(normalizer_->normalize(text)) : StringPieces(text);
   if (preTokenizer_) {
     preTokenizedStr = preTokenizer_->preTokenize(preTokenizedStr);
   }
-  std::vector<int32_t> ids = model_->tokenize(preTokenizedStr);
-  if (postProcessor_) {
-    ids = postProcessor_->postProcess(ids, addSpecialTokens);
+  return tokenizeWithModel(preTokenizedStr);
+}
+
+std::vector<int32_t> Tokenizer::tokenizeWithModel(const StringPieces& text) const {
+  auto& pool = ThreadPool::global();
+  if (parallelChunkSize_ == 0 || text.backStr.size() < 2 * parallelChunkSize_ || text.pieces.size() < 2 ||
+      pool.numThreads() == 1) {
+    return model_->tokenize(text);
+  }
+
+  // the model encodes every pre-tokenized piece on its own, so chunks of whole pieces give the same ids
+  std::vector<std::pair<size_t, size_t>> chunks;
+  size_t begin = 0;
+  size_t bytes = 0;
+  for (size_t i = 0; i < text.pieces.size(); i++) {
+    bytes += text.pieces[i].second - text.pieces[i].first;
+    if (bytes >= parallelChunkSize_) {
+      chunks.emplace_back(begin, i + 1);
+      begin = i + 1;
+      bytes = 0;
+    }
   }
-  return ids;
+  if (begin < text.pieces.size()) {
+    chunks.emplace_back(begin, text.pieces.size());
+  }
+
+  std::vector<std::vector<int32_t>> chunkIds(chunks.size());
+  pool.parallelFor(static_cast<int64_t>(chunks.size()), 1, [&](int64_t chunkBegin, int64_t chunkEnd) {
+    for (int64_t c = chunkBegin; c < chunkEnd; c++) {
+      auto& [first, last] = chunks[c];
+      auto pieces = std::vector<Range>(text.pieces.begin() + first, text.pieces.begin() + last);
+      chunkIds[c] = model_->tokenize(text.refine(std::move(pieces)));
+    }
+  });
+
+  size_t numIds = 0;
+  for (auto& ids : chunkIds) {
+    numIds += ids.size();
+  }
+  std::vector<int32_t> ret;
+  ret.reserve(numIds);
+  for (auto& ids : chunkIds) {
+    ret.insert(ret.end(), ids.begin(), ids.end());
+  }
+  return ret;
 }
 
 std::string Tokenizer::applyChatTemplate(const std::vector<ChatMessage>& messages, bool addGenerationPrompt) const {
@@ -330,70 +348,67 @@ std::string Tokenizer::applyChatTemplate(const std::vector<ChatMessage>& message
   return tokenizer::applyChatTemplate(chatTemplate_, messages, addGenerationPrompt, bosToken, eosToken);
 }
 
-void Tokenizer::workerThread() {
-  while (!stop_) {
-    std::function<void()> task;
-    bool gotTask = false;
-    while (tasks_.try_dequeue(task)) {
-      gotTask = true;
-      task();
-    }
-    if (!gotTask) {
-      std::unique_lock<std::mutex> lock(mutex_);
-      cv_.wait(lock, [this] { return stop_ || tasks_.size_approx() > 0; });
-    }
-  }
-}
-
-template <typename Input, typename Output, typename Func>
-void Tokenizer::parallelFor(tinytorch::ArrayView<Input> inputs, std::vector<Output>& outputs, Func func,
+template <typename Input, typename Output, typename Func, typename Cost>
+void Tokenizer::parallelFor(tinytorch::ArrayView<Input> inputs, std::vector<Output>& outputs, Func func, Cost cost,
                             uint32_t numThreads) {
+  // work (in text bytes) below which a chunk is not worth a handoff to another thread
+  constexpr size_t kMinChunkCost = 16 * 1024;
+  // chunks per thread, small enough to balance a batch mixing huge and tiny inputs
+  constexpr size_t kChunksPerThread = 8;
+
   size_t n = inputs.size();
   if (n == 0) {
     return;
   }
+  auto runRange = [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      outputs[i] = func(inputs[i]);
+    }
+  };
 
-  static auto maxThreads = std::thread::hardware_concurrency();
-  numThreads = std::min<uint32_t>(numThreads, maxThreads);
-  numThreads = std::min<uint32_t>(numThreads, n);
+  size_t totalCost = 0;
+  for (size_t i = 0; i < n; i++) {
+    totalCost += cost(inputs[i]);
+  }
+  auto& pool = ThreadPool::global();
+  numThreads = std::min(std::max<uint32_t>(numThreads, 1), pool.numThreads());
+  if (numThreads == 1 || n == 1 || totalCost < 2 * kMinChunkCost) {
+    runRange(0, n);
+    return;
+  }
 
-  {
-    // init threads
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (stop_) {
-      return;
-    }
-    if (threads_.size() < numThreads) {
-      for (uint32_t i = threads_.size(); i < numThreads; i++) {
-        threads_.emplace_back(&Tokenizer::workerThread, this);
-      }
+  // contiguous chunks of similar cost, a huge input gets a chunk of its own
+  const size_t targetCost = std::max(kMinChunkCost, totalCost / (numThreads * kChunksPerThread));
+  struct Chunk {
+    size_t begin;
+    size_t end;
+    size_t cost;
+  };
+  std::vector<Chunk> chunks;
+  Chunk chunk{0, 0, 0};
+  for (size_t i = 0; i < n; i++) {
+    chunk.cost += cost(inputs[i]);
+    chunk.end = i + 1;
+    if (chunk.cost >= targetCost) {
+      chunks.push_back(chunk);
+      chunk = {i + 1, i + 1, 0};
     }
   }
-
-  size_t finished = 0;
-  std::mutex finishedMutex;
-  std::condition_variable finishedCv;
-
-  std::vector<std::function<void()>> fs;
-  fs.reserve(inputs.size());
-  for (size_t i = 0; i < inputs.size(); i++) {
-    auto task = [&, i]() {
-      outputs[i] = func(inputs[i]);
-      {
-        std::lock_guard<std::mutex> lock(finishedMutex);
-        if (++finished == inputs.size()) {
-          finishedCv.notify_one();
-        }
-      }
-    };
-    fs.emplace_back(std::move(task));
+  if (chunk.end > chunk.begin) {
+    chunks.push_back(chunk);
   }
-  tasks_.enqueue_bulk(fs.begin(), fs.size());
-  cv_.notify_all();
+  // largest first, so the tail of the batch is made of small chunks
+  std::stable_sort(chunks.begin(), chunks.end(), [](const Chunk& a, const Chunk& b) { return a.cost > b.cost; });
 
-  // wait until all tasks done
-  std::unique_lock<std::mutex> lock(finishedMutex);
-  finishedCv.wait(lock, [&] { return finished == inputs.size(); });
+  // numThreads participants (calling thread included) take chunks from a shared counter until none is left
+  std::atomic<size_t> nextChunk{0};
+  numThreads = static_cast<uint32_t>(std::min<size_t>(numThreads, chunks.size()));
+  pool.parallelFor(numThreads, 1, [&](int64_t, int64_t) {
+    for (size_t idx = nextChunk.fetch_add(1, std::memory_order_relaxed); idx < chunks.size();
+         idx = nextChunk.fetch_add(1, std::memory_order_relaxed)) {
+      runRange(chunks[idx].begin, chunks[idx].end);
+    }
+  });
 }
 
 }  // namespace tinygpt::tokenizer
\ No newline at end of file
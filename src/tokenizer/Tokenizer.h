@@ -6,18 +6,13 @@
 
 #pragma once
 
-#include <atomic>
-#include <condition_variable>
-#include <functional>
-#include <mutex>
-#include <thread>
 #include <vector>
 
+#include "AddedTokens.h"
 #include "BPE.h"
 #include "Base.h"
 #include "ByteLevel.h"
 #include "ChatTemplate.h"
-#include "Regex.h"
 #include "Split.h"
 #include "TemplateProcessing.h"
 #include "Utils/VectorUtils.h"
@@ -26,6 +21,9 @@ namespace tinygpt::tokenizer {
 
 class Tokenizer {
  public:
+  // bytes of pre-tokenized pieces per parallel chunk when encoding one large input
+  static constexpr size_t kDefaultParallelChunkSize = 1024 * 1024;
+
   Tokenizer() = default;
   ~Tokenizer();
 
@@ -35,6 +33,12 @@ class Tokenizer {
   std::string id2Token(int32_t id);
 
   std::vector<int32_t> encode(const std::string& text, bool allowAddedTokens = true);
+
+  // inputs of at least two chunks run the model on chunks of whole pre-tokenized pieces in parallel,
+  // ids are the same as sequential encoding. 0: always sequential
+  void setParallelChunkSize(size_t bytes) { parallelChunkSize_ = bytes; }
+  size_t parallelChunkSize() const { return parallelChunkSize_; }
+
   std::vector<std::vector<int32_t>> encodeBatch(const std::vector<std::string>& texts, uint32_t numThreads = 8,
                                                 bool allowAddedTokens = true);
   std::vector<std::vector<int32_t>> encodeBatch(tinytorch::ArrayView<std::string> texts, uint32_t numThreads = 8,
@@ -71,13 +75,18 @@ class Tokenizer {
   void setChatTemplate(const std::string& tmpl) { chatTemplate_ = tmpl; }
 
  private:
-  void addTokens(const ankerl::unordered_dense::map<std::string, int32_t>& tokens);
-  std::vector<std::string> splitAddedTokens(const std::string& text) const;
-  std::vector<int32_t> encodeWithModel(const std::string& text, bool addSpecialTokens) const;
+  friend class StreamEncoder;
 
-  void workerThread();
-  template <typename Input, typename Output, typename Func>
-  void parallelFor(tinytorch::ArrayView<Input> inputs, std::vector<Output>& outputs, Func func, uint32_t numThreads);
+  void addTokens(const std::vector<AddedToken>& tokens);
+  std::vector<int32_t> encodeWithModel(std::string_view text, bool addSpecialTokens) const;
+  // normalizer, pre-tokenizer and model, without the post-processor
+  std::vector<int32_t> encodePieces(std::string_view text) const;
+  std::vector<int32_t> tokenizeWithModel(const StringPieces& text) const;
+
+  // cost: work of one input in text bytes (bytes to encode, ids * kDecodeBytesPerId to decode)
+  template <typename Input, typename Output, typename Func, typename Cost>
+  void parallelFor(tinytorch::ArrayView<Input> inputs, std::vector<Output>& outputs, Func func, Cost cost,
+                   uint32_t numThreads);
 
   std::unique_ptr<Component> normalizer_;
   std::unique_ptr<Component> preTokenizer_;
@@ -92,6 +101,8 @@ class Tokenizer {
   bool addBosToken_ = false;
   bool addEosToken_ = false;
 
+  size_t parallelChunkSize_ = kDefaultParallelChunkSize;
+
   // stream decode cache
   struct TokenStreamCache {
     int32_t id;
@@ -101,22 +112,14 @@ class Tokenizer {
   std::string streamCacheStr_;
 
   // added tokens
-  std::string addedPattern_;
-  std::unique_ptr<Regex> addedMatcher_;
-  ankerl::unordered_dense::map<std::string, int32_t> addedEncoder_;
+  AddedTokens addedTokens_;
+  ankerl::unordered_dense::map<std::string, int32_t, StringHash, std::equal_to<>> addedEncoder_;
   int32_t minAddedTokenId_ = -1;
   int32_t maxAddedTokenId_ = -1;
   std::vector<std::string> addedDecoder_;
 
   // chat template
   std::string chatTemplate_;
-
-  // threads management
-  std::vector<std::thread> threads_;
-  moodycamel::ConcurrentQueue<std::function<void()>> tasks_;
-  std::mutex mutex_;
-  std::condition_variable cv_;
-  std::atomic<bool> stop_{false};
 };
 
 }  // namespace tinygpt::tokenizer
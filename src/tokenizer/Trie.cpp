@@ -0,0 +1,48 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#include "Trie.h"
+
+namespace tinygpt::tokenizer {
+
+void Trie::insert(std::string_view key, int32_t value) {
+  ASSERT(value >= 0);
+  uint32_t node = 0;
+  for (auto c : key) {
+    auto [it, inserted] = edges_.try_emplace(edgeKey(node, static_cast<uint8_t>(c)), 0);
+    if (inserted) {
+      it->second = static_cast<uint32_t>(values_.size());
+      values_.push_back(-1);
+    }
+    node = it->second;
+  }
+  values_[node] = value;
+}
+
+int32_t Trie::longestPrefix(std::string_view text, size_t* len) const {
+  int32_t value = -1;
+  *len = 0;
+  uint32_t node = 0;
+  for (size_t i = 0; i < text.size(); i++) {
+    auto it = edges_.find(edgeKey(node, static_cast<uint8_t>(text[i])));
+    if (it == edges_.end()) {
+      break;
+    }
+    node = it->second;
+    if (values_[node] >= 0) {
+      value = values_[node];
+      *len = i + 1;
+    }
+  }
+  return value;
+}
+
+void Trie::clear() {
+  values_.assign(1, -1);
+  edges_.clear();
+}
+
+}  // namespace tinygpt::tokenizer
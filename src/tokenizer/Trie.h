@@ -0,0 +1,34 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+#include "Base.h"
+
+namespace tinygpt::tokenizer {
+
+// byte trie mapping keys to non-negative values, for longest prefix lookup
+class Trie {
+ public:
+  void insert(std::string_view key, int32_t value);
+
+  // value of the longest key which is a prefix of text (-1 if none), `len` gets the key length
+  int32_t longestPrefix(std::string_view text, size_t* len) const;
+
+  void clear();
+  size_t numNodes() const { return values_.size(); }
+
+ private:
+  static uint64_t edgeKey(uint32_t node, uint8_t c) { return (static_cast<uint64_t>(node) << 8) | c; }
+
+  std::vector<int32_t> values_{-1};  // node 0 is root
+  ankerl::unordered_dense::map<uint64_t, uint32_t> edges_;
+};
+
+}  // namespace tinygpt::tokenizer
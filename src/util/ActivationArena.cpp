@@ -0,0 +1,138 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#include "ActivationArena.h"
+
+#include "HugePages.h"
+
+namespace tinygpt {
+
+namespace tt = tinytorch;
+
+static thread_local ActivationArena *gCurrentArena = nullptr;
+
+ActivationArena::Scope::Scope(ActivationArena &arena, int64_t batch, int64_t seqLen) : prev_(gCurrentArena) {
+  arena.begin(batch, seqLen);
+  gCurrentArena = &arena;
+}
+
+ActivationArena::Scope::~Scope() {
+  gCurrentArena->end();
+  gCurrentArena = prev_;
+}
+
+tt::Tensor ActivationArena::empty(tt::IntArrayView shape, const tt::Tensor &like) {
+  if (gCurrentArena) {
+    return gCurrentArena->alloc(shape, like);
+  }
+  return tt::Tensor::empty(shape, like.options());
+}
+
+void ActivationArena::nextStep() {
+  if (gCurrentArena) {
+    gCurrentArena->step_++;
+  }
+}
+
+void ActivationArena::clear() {
+  plans_.clear();
+  buffer_ = tt::Tensor();
+  hasBufferType_ = false;
+}
+
+void ActivationArena::begin(int64_t batch, int64_t seqLen) {
+  bucket_ = {batch, seqLen};
+  auto it = plans_.find(bucket_);
+  active_ = (it != plans_.end()) ? &it->second : nullptr;
+  if (active_) {
+    active_->lastUse = ++passCount_;
+  }
+  recorded_.clear();
+  cursor_ = 0;
+  step_ = 0;
+  diverged_ = false;
+}
+
+void ActivationArena::end() {
+  if (!active_ && !diverged_) {
+    commitPlan();
+  }
+  active_ = nullptr;
+  recorded_.clear();
+}
+
+bool ActivationArena::compatible(const tt::Tensor &like) const {
+  return like.device().isCpu() && (!hasBufferType_ || like.dtype() == bufferDtype_);
+}
+
+tt::Tensor ActivationArena::alloc(tt::IntArrayView shape, const tt::Tensor &like) {
+  int64_t numel = 1;
+  for (auto dim : shape) {
+    numel *= dim;
+  }
+  Request request{numel, step_, !compatible(like)};
+  if (diverged_) {
+    return tt::Tensor::empty(shape, like.options());
+  }
+
+  if (!active_) {
+    // recording pass
+    if (!request.dynamic && !hasBufferType_) {
+      bufferOptions_ = like.options();
+      bufferDtype_ = like.dtype();
+      hasBufferType_ = true;
+    }
+    recorded_.push_back(request);
+    return tt::Tensor::empty(shape, like.options());
+  }
+
+  if (active_->size < 0 || cursor_ >= active_->requests.size() || !(active_->requests[cursor_] == request)) {
+    diverged_ = true;
+    return tt::Tensor::empty(shape, like.options());
+  }
+  int64_t offset = active_->offsets[cursor_++];
+  if (request.dynamic) {
+    return tt::Tensor::empty(shape, like.options());
+  }
+  return tt::function::narrow(buffer_, 0, offset, numel).view(shape);
+}
+
+void ActivationArena::commitPlan() {
+  Plan plan;
+  plan.requests = std::move(recorded_);
+  plan.lastUse = ++passCount_;
+
+  // an activation is written in its step and read at the latest by the next one
+  std::vector<MemoryRequest> requests;
+  requests.reserve(plan.requests.size());
+  for (auto &req : plan.requests) {
+    requests.push_back({req.dynamic ? 0 : req.numel, req.step, req.step + 1});
+  }
+  plan.size = planMemory(requests, plan.offsets, kAlignment);
+
+  if (hasBufferType_) {
+    auto elemSize = static_cast<int64_t>(tt::dtypeSize(bufferDtype_));
+    if (plan.size * elemSize > kMaxBufferBytes) {
+      plan.size = -1;
+    } else if (plan.size > bufferSize()) {
+      buffer_ = tt::Tensor::empty({plan.size}, bufferOptions_);
+      HugePages::advise(buffer_);
+    }
+  }
+
+  if (plans_.size() >= kMaxBuckets) {
+    auto victim = plans_.begin();
+    for (auto it = plans_.begin(); it != plans_.end(); ++it) {
+      if (it->second.lastUse < victim->second.lastUse) {
+        victim = it;
+      }
+    }
+    plans_.erase(victim);
+  }
+  plans_[bucket_] = std::move(plan);
+}
+
+}  // namespace tinygpt
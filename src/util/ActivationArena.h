@@ -0,0 +1,96 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#pragma once
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "Functions.h"
+#include "MemoryPlanner.h"
+
+namespace tinygpt {
+
+// Activation memory of the forward pass, planned per (batch, seqLen) bucket.
+// The first forward of a bucket allocates dynamically and records every activation request, lifetimes are in
+// steps (one step per decoder layer, an activation lives until the end of the next step). A static plan then
+// assigns offsets in one shared buffer, later forwards of the same bucket replay it without allocating.
+// A forward that deviates from the recorded sequence falls back to dynamic allocation for the rest of the pass.
+class ActivationArena {
+ public:
+  // planned buckets kept, least recently used ones are dropped first
+  static constexpr size_t kMaxBuckets = 16;
+  // buckets needing a larger buffer are never planned
+  static constexpr int64_t kMaxBufferBytes = 512LL * 1024 * 1024;
+  // offset alignment in elements
+  static constexpr int64_t kAlignment = 64;
+
+  // makes the arena current on this thread for one forward pass
+  class Scope {
+   public:
+    Scope(ActivationArena &arena, int64_t batch, int64_t seqLen);
+    ~Scope();
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+   private:
+    ActivationArena *prev_;
+  };
+
+  // uninitialized activation tensor with the dtype/device of `like`, from the current arena if any (CPU only)
+  static tinytorch::Tensor empty(tinytorch::IntArrayView shape, const tinytorch::Tensor &like);
+
+  // marks the end of a step (decoder layer) of the current pass
+  static void nextStep();
+
+  void clear();
+
+  size_t numPlans() const { return plans_.size(); }
+  int64_t bufferSize() const { return buffer_.defined() ? buffer_.numel() : 0; }
+
+ private:
+  struct Request {
+    int64_t numel;
+    int64_t step;
+    bool dynamic;  // not a CPU tensor of the buffer dtype
+
+    bool operator==(const Request &other) const {
+      return numel == other.numel && step == other.step && dynamic == other.dynamic;
+    }
+  };
+
+  struct Plan {
+    std::vector<Request> requests;
+    std::vector<int64_t> offsets;
+    int64_t size = 0;  // elements, -1 if too large to plan
+    uint64_t lastUse = 0;
+  };
+
+  void begin(int64_t batch, int64_t seqLen);
+  void end();
+  tinytorch::Tensor alloc(tinytorch::IntArrayView shape, const tinytorch::Tensor &like);
+  bool compatible(const tinytorch::Tensor &like) const;
+  void commitPlan();
+
+  std::map<std::pair<int64_t, int64_t>, Plan> plans_;
+  tinytorch::Tensor buffer_;  // 1-D, dtype of the first CPU activation seen
+  tinytorch::Options bufferOptions_;
+  tinytorch::DType bufferDtype_ = tinytorch::DType::Float32;
+  bool hasBufferType_ = false;
+  uint64_t passCount_ = 0;
+
+  // current pass
+  std::pair<int64_t, int64_t> bucket_;
+  Plan *active_ = nullptr;  // nullptr while recording
+  std::vector<Request> recorded_;
+  size_t cursor_ = 0;
+  int64_t step_ = 0;
+  bool diverged_ = false;
+};
+
+}  // namespace tinygpt
@@ -0,0 +1,109 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#include "HugePages.h"
+
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "Utils/Logger.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+namespace tinygpt {
+
+namespace tt = tinytorch;
+
+static std::atomic<bool> gEnabled{false};
+static std::atomic<int64_t> gAdvisedBytes{0};
+
+bool HugePages::setEnabled(bool enabled) {
+  if (!enabled) {
+    gEnabled = false;
+    return true;
+  }
+#if defined(MADV_HUGEPAGE)
+  // "always [madvise] never", the selected mode is bracketed
+  std::ifstream ifs("/sys/kernel/mm/transparent_hugepage/enabled");
+  std::string mode;
+  if (!std::getline(ifs, mode)) {
+    LOGW("Huge pages: transparent huge pages not available, use regular pages");
+    return false;
+  }
+  if (mode.find("[never]") != std::string::npos) {
+    LOGW("Huge pages: transparent huge pages disabled by the system (%s), use regular pages", mode.c_str());
+    return false;
+  }
+  gEnabled = true;
+  return true;
+#else
+  LOGW("Huge pages: not supported on this platform, use regular pages");
+  return false;
+#endif
+}
+
+bool HugePages::enabled() { return gEnabled; }
+
+void HugePages::advise(void *ptr, size_t length) {
+#if defined(MADV_HUGEPAGE)
+  if (!gEnabled) {
+    return;
+  }
+  auto begin = (reinterpret_cast<uintptr_t>(ptr) + kHugePageSize - 1) & ~(kHugePageSize - 1);
+  auto end = (reinterpret_cast<uintptr_t>(ptr) + length) & ~(kHugePageSize - 1);
+  if (end <= begin) {
+    return;
+  }
+  if (madvise(reinterpret_cast<void *>(begin), end - begin, MADV_HUGEPAGE) != 0) {
+    LOGW("madvise HUGEPAGE failed");
+    return;
+  }
+  gAdvisedBytes += static_cast<int64_t>(end - begin);
+#else
+  (void)ptr;
+  (void)length;
+#endif
+}
+
+void HugePages::advise(const tt::Tensor &tensor) {
+  if (!gEnabled || !tensor.defined() || !tensor.device().isCpu()) {
+    return;
+  }
+  advise(tensor.dataPtr<>(), tensor.numel() * tt::dtypeSize(tensor.dtype()));
+}
+
+int64_t HugePages::advisedBytes() { return gAdvisedBytes; }
+
+int64_t HugePages::residentBytes() {
+  std::ifstream ifs("/proc/self/smaps_rollup");
+  std::string line;
+  while (std::getline(ifs, line)) {
+    if (line.rfind("AnonHugePages:", 0) == 0) {
+      std::istringstream iss(line.substr(14));
+      int64_t kb = 0;
+      iss >> kb;
+      return kb * 1024;
+    }
+  }
+  return -1;
+}
+
+void HugePages::logStats() {
+  constexpr double kMB = 1024.0 * 1024.0;
+  int64_t resident = residentBytes();
+  if (resident < 0) {
+    LOGI("Huge pages: advised %.1f MB", static_cast<double>(advisedBytes()) / kMB);
+    return;
+  }
+  LOGI("Huge pages: advised %.1f MB, backed %.1f MB", static_cast<double>(advisedBytes()) / kMB,
+       static_cast<double>(resident) / kMB);
+}
+
+}  // namespace tinygpt
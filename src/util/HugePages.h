@@ -0,0 +1,38 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Functions.h"
+
+namespace tinygpt {
+
+// Transparent huge pages (2MB) for the large CPU buffers: weights, KV cache and activations.
+// Buffers are advised with MADV_HUGEPAGE before their first touch, the kernel backs them with huge pages when it
+// can and falls back to regular pages otherwise. Policy is process wide, off by default.
+class HugePages {
+ public:
+  static constexpr size_t kHugePageSize = 2 << 20;
+
+  // enabling fails (and logs why) if the system has no transparent huge page support
+  static bool setEnabled(bool enabled);
+  static bool enabled();
+
+  // only the huge page aligned part of the range is advised, no-op if disabled
+  static void advise(void *ptr, size_t length);
+  static void advise(const tinytorch::Tensor &tensor);
+
+  static int64_t advisedBytes();
+  // anonymous memory of the process actually backed by huge pages, -1 if unknown
+  static int64_t residentBytes();
+
+  static void logStats();
+};
+
+}  // namespace tinygpt
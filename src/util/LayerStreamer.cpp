@@ -0,0 +1,221 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#include "LayerStreamer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "MappedFile.h"
+#include "Utils/Logger.h"
+#include "kernel/TensorOps.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace tinygpt {
+
+namespace tt = tinytorch;
+
+static thread_local LayerStreamer *gCurrentStreamer = nullptr;
+
+static int64_t nowMillis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// release the pages of an anonymous range, only the pages fully inside it: partial pages are shared with neighbours
+static void releasePages(void *ptr, size_t length) {
+#ifndef _WIN32
+  static const auto pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+  auto begin = (reinterpret_cast<uintptr_t>(ptr) + pageSize - 1) & ~(pageSize - 1);
+  auto end = (reinterpret_cast<uintptr_t>(ptr) + length) & ~(pageSize - 1);
+  if (end > begin && madvise(reinterpret_cast<void *>(begin), end - begin, MADV_DONTNEED) != 0) {
+    LOGW("madvise DONTNEED failed");
+  }
+#else
+  (void)ptr;
+  (void)length;
+#endif
+}
+
+LayerStreamer::Scope::Scope(LayerStreamer *streamer, int64_t numTokens) : prev_(gCurrentStreamer) {
+  if (streamer) {
+    streamer->begin(numTokens);
+  }
+  gCurrentStreamer = streamer;
+}
+
+LayerStreamer::Scope::~Scope() {
+  if (gCurrentStreamer) {
+    gCurrentStreamer->end();
+  }
+  gCurrentStreamer = prev_;
+}
+
+LayerStreamer::LayerStreamer(std::vector<std::vector<Range>> layers)
+    : layers_(std::move(layers)), resident_(layers_.size(), 1), pending_(layers_.size(), 0) {
+  worker_ = std::thread(&LayerStreamer::workerLoop, this);
+}
+
+LayerStreamer::~LayerStreamer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  workerCv_.notify_all();
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+}
+
+void LayerStreamer::nextLayer() {
+  auto *streamer = gCurrentStreamer;
+  if (!streamer || streamer->cursor_ >= streamer->layers_.size()) {
+    return;
+  }
+  size_t layer = streamer->cursor_++;
+  streamer->drop(layer);
+  streamer->prefetch(layer + 2);
+  if (layer + 1 < streamer->layers_.size()) {
+    streamer->waitResident(layer + 1);
+  }
+}
+
+LayerStreamer::Stats LayerStreamer::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void LayerStreamer::logStats() const {
+  auto s = stats();
+  constexpr double kMB = 1024.0 * 1024.0;
+  double seconds = static_cast<double>(std::max<int64_t>(s.elapsedMillis, 1)) / 1000.0;
+  LOGI("Layer streaming: passes %lld, tokens %lld, %.1f token/s, read %.1f MB/s (prefetch %.1f MB, restore %.1f MB), "
+       "dropped %.1f MB, stall %lld / %lld ms",
+       static_cast<long long>(s.passes), static_cast<long long>(s.tokens), static_cast<double>(s.tokens) / seconds,
+       static_cast<double>(s.prefetchedBytes) / kMB / seconds, static_cast<double>(s.prefetchedBytes) / kMB,
+       static_cast<double>(s.restoredBytes) / kMB, static_cast<double>(s.droppedBytes) / kMB,
+       static_cast<long long>(s.stallMillis), static_cast<long long>(s.elapsedMillis));
+}
+
+void LayerStreamer::begin(int64_t numTokens) {
+  cursor_ = 0;
+  passStartMillis_ = nowMillis();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.passes++;
+    stats_.tokens += numTokens;
+  }
+  prefetch(0);
+  prefetch(1);
+  if (!layers_.empty()) {
+    waitResident(0);
+  }
+}
+
+void LayerStreamer::end() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.elapsedMillis += nowMillis() - passStartMillis_;
+}
+
+void LayerStreamer::prefetch(size_t layer) {
+  if (layer >= layers_.size()) {
+    return;
+  }
+  int64_t bytes = 0;
+  for (const auto &range : layers_[layer]) {
+    MappedFile::willNeed(range.src ? range.src : range.data, range.nbytes);
+    bytes += static_cast<int64_t>(range.nbytes);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.prefetchedBytes += bytes;
+  if (!resident_[layer] && !pending_[layer]) {
+    pending_[layer] = 1;
+    queue_.push_back(layer);
+    workerCv_.notify_one();
+  }
+}
+
+void LayerStreamer::drop(size_t layer) {
+  int64_t bytes = 0;
+  for (const auto &range : layers_[layer]) {
+    if (range.src) {
+      releasePages(range.data, range.nbytes);
+    } else {
+      MappedFile::dontNeed(range.data, range.nbytes);
+    }
+    bytes += static_cast<int64_t>(range.nbytes);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  resident_[layer] = 0;
+  stats_.droppedBytes += bytes;
+}
+
+void LayerStreamer::waitResident(size_t layer) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (resident_[layer]) {
+    return;
+  }
+  if (!pending_[layer]) {
+    pending_[layer] = 1;
+    queue_.push_back(layer);
+    workerCv_.notify_one();
+  }
+  int64_t start = nowMillis();
+  residentCv_.wait(lock, [&] { return resident_[layer] != 0; });
+  stats_.stallMillis += nowMillis() - start;
+}
+
+void LayerStreamer::restore(size_t layer) {
+  int64_t bytes = 0;
+  for (const auto &range : layers_[layer]) {
+    if (!range.src) {
+      continue;
+    }
+    if (range.srcType == range.dtype) {
+      std::memcpy(range.data, range.src, range.nbytes);
+    } else {
+      auto numel = static_cast<int64_t>(range.nbytes / tt::dtypeSize(range.dtype));
+      kernel::convert(range.src, range.srcType, range.data, range.dtype, numel);
+    }
+    bytes += static_cast<int64_t>(range.nbytes);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.restoredBytes += bytes;
+}
+
+void LayerStreamer::workerLoop() {
+  while (true) {
+    size_t layer;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      workerCv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+      if (stop_) {
+        return;
+      }
+      layer = queue_.front();
+      queue_.pop_front();
+    }
+
+    restore(layer);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      resident_[layer] = 1;
+      pending_[layer] = 0;
+    }
+    residentCv_.notify_all();
+  }
+}
+
+}  // namespace tinygpt
@@ -0,0 +1,98 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Functions.h"
+
+namespace tinygpt {
+
+// Out-of-core execution for models larger than RAM, meant for large batch prefill / scoring where the compute of
+// a layer hides the I/O of the next one.
+// While layer i runs, layer i + 1 is read ahead and restored in the background; once layer i is done its pages are
+// dropped. States viewing the mapped checkpoint only need page hints. States copied out of it (merged or converted
+// weights) are released with the pages and copied again from the checkpoint before their next use.
+class LayerStreamer {
+ public:
+  // a state of a decoder layer
+  struct Range {
+    void *data = nullptr;
+    size_t nbytes = 0;
+    const void *src = nullptr;  // mapped source of a copied state, nullptr if `data` views the mapped pages
+    tinytorch::DType srcType = tinytorch::DType::Float32;
+    tinytorch::DType dtype = tinytorch::DType::Float32;
+  };
+
+  struct Stats {
+    int64_t passes = 0;
+    int64_t tokens = 0;
+    int64_t prefetchedBytes = 0;
+    int64_t restoredBytes = 0;  // copied states read again from the checkpoint
+    int64_t droppedBytes = 0;
+    int64_t stallMillis = 0;  // compute waiting for a restore
+    int64_t elapsedMillis = 0;
+  };
+
+  // makes the streamer current on this thread for one forward pass, nullptr streams nothing
+  class Scope {
+   public:
+    Scope(LayerStreamer *streamer, int64_t numTokens);
+    ~Scope();
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+   private:
+    LayerStreamer *prev_;
+  };
+
+  // layers[i]: states of decoder layer i, all currently resident
+  explicit LayerStreamer(std::vector<std::vector<Range>> layers);
+  ~LayerStreamer();
+
+  LayerStreamer(const LayerStreamer &) = delete;
+  LayerStreamer &operator=(const LayerStreamer &) = delete;
+
+  // marks the end of a decoder layer of the current pass
+  static void nextLayer();
+
+  Stats stats() const;
+  void logStats() const;
+
+ private:
+  void begin(int64_t numTokens);
+  void end();
+
+  void prefetch(size_t layer);
+  void drop(size_t layer);
+  void waitResident(size_t layer);
+  void restore(size_t layer);
+  void workerLoop();
+
+  std::vector<std::vector<Range>> layers_;
+  std::vector<uint8_t> resident_;  // copied states of the layer hold valid data
+  std::vector<uint8_t> pending_;   // restore queued or running
+
+  // current pass
+  size_t cursor_ = 0;
+  int64_t passStartMillis_ = 0;
+
+  mutable std::mutex mutex_;
+  std::condition_variable workerCv_;
+  std::condition_variable residentCv_;
+  std::deque<size_t> queue_;
+  Stats stats_;
+  bool stop_ = false;
+  std::thread worker_;
+};
+
+}  // namespace tinygpt
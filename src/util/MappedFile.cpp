@@ -0,0 +1,63 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#include "MappedFile.h"
+
+#include "Utils/Logger.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace tinygpt {
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string &path) {
+  tinytorch::MMappingResult mapping = tinytorch::MMapUtils::mapFileForRead(path);
+  if (!mapping.success) {
+    LOGE("Error mapFileForRead: %s", path.c_str());
+    return nullptr;
+  }
+  return std::shared_ptr<MappedFile>(new MappedFile(path, mapping));
+}
+
+MappedFile::~MappedFile() { tinytorch::MMapUtils::unmapFile(mapping_); }
+
+#ifndef _WIN32
+static bool advise(const void *ptr, size_t length, int advice) {
+  if (length == 0) {
+    return true;
+  }
+  static const auto pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+  auto begin = reinterpret_cast<uintptr_t>(ptr) & ~(pageSize - 1);
+  auto end = reinterpret_cast<uintptr_t>(ptr) + length;
+  return madvise(reinterpret_cast<void *>(begin), end - begin, advice) == 0;
+}
+#endif
+
+void MappedFile::willNeed(const void *ptr, size_t length) {
+#ifndef _WIN32
+  if (!advise(ptr, length, MADV_WILLNEED)) {
+    LOGW("madvise WILLNEED failed");
+  }
+#else
+  (void)ptr;
+  (void)length;
+#endif
+}
+
+void MappedFile::dontNeed(const void *ptr, size_t length) {
+#ifndef _WIN32
+  if (!advise(ptr, length, MADV_DONTNEED)) {
+    LOGW("madvise DONTNEED failed");
+  }
+#else
+  (void)ptr;
+  (void)length;
+#endif
+}
+
+}  // namespace tinygpt
@@ -0,0 +1,42 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "Utils/MMapUtils.h"
+
+namespace tinygpt {
+
+// read-only file mapping, unmapped when the last owner releases it
+class MappedFile {
+ public:
+  static std::shared_ptr<MappedFile> open(const std::string &path);
+
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  const uint8_t *data() const { return static_cast<const uint8_t *>(mapping_.dataPtr); }
+  const std::string &path() const { return path_; }
+
+  // Page hints for ranges of a mapping, widened to the page boundaries.
+  // willNeed starts asynchronous readahead, dontNeed drops the pages (re-read from the file on the next access).
+  static void willNeed(const void *ptr, size_t length);
+  static void dontNeed(const void *ptr, size_t length);
+
+ private:
+  MappedFile(std::string path, const tinytorch::MMappingResult &mapping)
+      : path_(std::move(path)), mapping_(mapping) {}
+
+  std::string path_;
+  tinytorch::MMappingResult mapping_;
+};
+
+}  // namespace tinygpt
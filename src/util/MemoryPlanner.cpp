@@ -0,0 +1,59 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#include "MemoryPlanner.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace tinygpt {
+
+static int64_t alignUp(int64_t value, int64_t alignment) { return (value + alignment - 1) / alignment * alignment; }
+
+int64_t planMemory(const std::vector<MemoryRequest> &requests, std::vector<int64_t> &offsets, int64_t alignment) {
+  const size_t n = requests.size();
+  offsets.assign(n, 0);
+
+  std::vector<size_t> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&](size_t a, size_t b) { return requests[a].size > requests[b].size; });
+
+  int64_t total = 0;
+  std::vector<size_t> placed;
+  std::vector<size_t> conflicts;
+  for (size_t idx : order) {
+    const auto &req = requests[idx];
+    if (req.size <= 0) {
+      continue;
+    }
+
+    conflicts.clear();
+    for (size_t other : placed) {
+      const auto &o = requests[other];
+      if (o.firstStep <= req.lastStep && req.firstStep <= o.lastStep) {
+        conflicts.push_back(other);
+      }
+    }
+    std::sort(conflicts.begin(), conflicts.end(), [&](size_t a, size_t b) { return offsets[a] < offsets[b]; });
+
+    // lowest gap between overlapping requests that is large enough
+    int64_t offset = 0;
+    for (size_t other : conflicts) {
+      if (offset + req.size <= offsets[other]) {
+        break;
+      }
+      offset = std::max(offset, alignUp(offsets[other] + requests[other].size, alignment));
+    }
+
+    offsets[idx] = offset;
+    placed.push_back(idx);
+    total = std::max(total, offset + req.size);
+  }
+  return total;
+}
+
+}  // namespace tinygpt
@@ -0,0 +1,26 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace tinygpt {
+
+// buffer request of a straight-line pass, live during steps [firstStep, lastStep]
+struct MemoryRequest {
+  int64_t size = 0;
+  int64_t firstStep = 0;
+  int64_t lastStep = 0;
+};
+
+// Static offset assignment for one buffer: requests with overlapping lifetimes get disjoint ranges.
+// Greedy by size (largest first), each request takes the lowest aligned offset that fits between the
+// already placed requests it overlaps with. Returns the buffer size, offsets[i] belongs to requests[i].
+int64_t planMemory(const std::vector<MemoryRequest> &requests, std::vector<int64_t> &offsets, int64_t alignment = 64);
+
+}  // namespace tinygpt
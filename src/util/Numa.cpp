@@ -0,0 +1,152 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#include "Numa.h"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#include "Utils/Logger.h"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace tinygpt {
+
+struct NumaTopology {
+  std::vector<std::vector<int>> nodes;  // CPUs of each node with CPUs
+  std::vector<int> nodeIds;             // sysfs node id of each entry
+};
+
+// sysfs list format, "0-3,8-11" -> {0, 1, 2, 3, 8, 9, 10, 11}
+static std::vector<int> parseList(const std::string &list) {
+  std::vector<int> cpus;
+  std::stringstream ss(list);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (item.empty()) {
+      continue;
+    }
+    auto dash = item.find('-');
+    int first = std::stoi(item.substr(0, dash));
+    int last = dash == std::string::npos ? first : std::stoi(item.substr(dash + 1));
+    for (int cpu = first; cpu <= last; cpu++) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+static const NumaTopology &topology() {
+  static NumaTopology topo = [] {
+    NumaTopology t;
+#ifdef __linux__
+    std::ifstream onlineFile("/sys/devices/system/node/online");
+    std::string online;
+    std::getline(onlineFile, online);
+    for (int node : parseList(online)) {
+      std::ifstream ifs("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+      std::string list;
+      std::getline(ifs, list);
+      auto cpus = parseList(list);
+      if (!cpus.empty()) {
+        t.nodes.push_back(std::move(cpus));
+        t.nodeIds.push_back(node);
+      }
+    }
+#endif
+    return t;
+  }();
+  return topo;
+}
+
+static std::mutex gMutex;
+static std::vector<std::unique_ptr<ThreadPool>> gPools;
+static std::vector<ThreadPool *> gPoolPtrs;
+
+int Numa::numNodes() { return std::max<int>(1, static_cast<int>(topology().nodes.size())); }
+
+const std::vector<int> &Numa::nodeCpus(int node) {
+  static const std::vector<int> empty;
+  const auto &topo = topology();
+  return node < static_cast<int>(topo.nodes.size()) ? topo.nodes[node] : empty;
+}
+
+int Numa::nodeOfCpu(int cpu) {
+  const auto &topo = topology();
+  for (size_t node = 0; node < topo.nodes.size(); node++) {
+    if (std::find(topo.nodes[node].begin(), topo.nodes[node].end(), cpu) != topo.nodes[node].end()) {
+      return static_cast<int>(node);
+    }
+  }
+  return -1;
+}
+
+bool Numa::setEnabled(bool enabled) {
+  std::lock_guard<std::mutex> lock(gMutex);
+  if (!enabled) {
+    gPoolPtrs.clear();
+    gPools.clear();
+    return true;
+  }
+  if (!gPools.empty()) {
+    return true;
+  }
+  if (numNodes() < 2) {
+    LOGI("NUMA: single node, use the global thread pool");
+    return false;
+  }
+
+  for (int node = 0; node < numNodes(); node++) {
+    const auto &cpus = nodeCpus(node);
+    // submitters do not run node chunks, one worker per CPU of the node
+    gPools.push_back(std::make_unique<ThreadPool>(static_cast<uint32_t>(cpus.size()) + 1, cpus));
+    gPoolPtrs.push_back(gPools.back().get());
+    LOGI("NUMA: node %d, %zu cpus", topology().nodeIds[node], cpus.size());
+  }
+  return true;
+}
+
+bool Numa::enabled() { return !nodePools().empty(); }
+
+const std::vector<ThreadPool *> &Numa::nodePools() { return gPoolPtrs; }
+
+bool Numa::bindPages(const void *ptr, size_t length, int node) {
+#if defined(__linux__) && defined(SYS_mbind)
+  constexpr int kMpolBind = 2;         // MPOL_BIND
+  constexpr unsigned kMpolMfMove = 2;  // MPOL_MF_MOVE
+  constexpr size_t kMaskBits = 1024;
+  static const auto pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+
+  const auto &topo = topology();
+  if (node < 0 || node >= static_cast<int>(topo.nodeIds.size())) {
+    return false;
+  }
+  auto begin = (reinterpret_cast<uintptr_t>(ptr) + pageSize - 1) & ~(pageSize - 1);
+  auto end = (reinterpret_cast<uintptr_t>(ptr) + length) & ~(pageSize - 1);
+  if (end <= begin) {
+    return true;
+  }
+
+  unsigned long mask[kMaskBits / (8 * sizeof(unsigned long))] = {};
+  int nodeId = topo.nodeIds[node];
+  mask[nodeId / (8 * sizeof(unsigned long))] |= 1UL << (nodeId % (8 * sizeof(unsigned long)));
+  return syscall(SYS_mbind, begin, end - begin, kMpolBind, mask, kMaskBits, kMpolMfMove) == 0;
+#else
+  (void)ptr;
+  (void)length;
+  (void)node;
+  return false;
+#endif
+}
+
+}  // namespace tinygpt
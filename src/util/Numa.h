@@ -0,0 +1,40 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "ThreadPool.h"
+
+namespace tinygpt {
+
+// NUMA placement for multi-socket CPU inference (Linux only).
+// When enabled, every node gets a thread pool pinned on its CPUs. The gated MLPs split their intermediate dimension
+// across the nodes, bind each weight slice to the memory of the node that reads it and reduce the node results, the
+// other layers are node-agnostic.
+// On a single node machine enabling is a no-op and the global pool is used.
+class Numa {
+ public:
+  // nodes with CPUs, as listed in sysfs, 1 if unknown
+  static int numNodes();
+  static const std::vector<int> &nodeCpus(int node);
+  // index of the node owning the CPU, -1 if unknown
+  static int nodeOfCpu(int cpu);
+
+  // returns false (and keeps it off) when there are fewer than two nodes
+  static bool setEnabled(bool enabled);
+  static bool enabled();
+
+  // pinned pools of the nodes, empty if disabled
+  static const std::vector<ThreadPool *> &nodePools();
+
+  // move the pages fully inside the range to the node's memory, best effort
+  static bool bindPages(const void *ptr, size_t length, int node);
+};
+
+}  // namespace tinygpt
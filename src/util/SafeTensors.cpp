@@ -6,15 +6,20 @@
 
 #include "SafeTensors.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 
 #include "Utils/Logger.h"
-#include "Utils/MMapUtils.h"
+#include "kernel/TensorOps.h"
 #include "rapidjson/document.h"
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/writer.h"
 #include "util/PathUtils.h"
+#include "util/TensorUtils.h"
+#include "util/ThreadPool.h"
 
 namespace tinygpt {
 
@@ -94,8 +99,11 @@ bool SafeTensors::save(tt::nn::Module& module, const std::string& path) {
   headerDoc.Accept(writer);
   std::string headerStr = sb.GetString();
 
+  // pad the header so the data section starts 64 bytes aligned, mapped states are then SIMD aligned
+  constexpr size_t kDataAlignment = 64;
   size_t headerLen = headerStr.size();
-  size_t alignedHeaderLen = ((headerLen + 7) / 8) * 8;
+  size_t alignedHeaderLen =
+      ((sizeof(uint64_t) + headerLen + kDataAlignment - 1) / kDataAlignment) * kDataAlignment - sizeof(uint64_t);
   headerStr.resize(alignedHeaderLen, ' ');
 
   std::ofstream ofs(path, std::ios::binary);
@@ -121,114 +129,306 @@ bool SafeTensors::save(tt::nn::Module& module, const std::string& path) {
   return true;
 }
 
-bool SafeTensors::load(tt::nn::Module& module, const std::string& path, bool strict) {
+bool SafeTensors::load(tt::nn::Module& module, const std::string& path, bool strict,
+                       std::vector<std::shared_ptr<MappedFile>>* mappedFiles,
+                       const std::vector<MergedState>& mergedStates) {
   auto endsWith = [](const std::string& str, const std::string& suffix) {
     return suffix.size() <= str.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
   };
 
+  LoadContext ctx;
+  for (const auto& [name, tensor] : module.namedStates()) {
+    ctx.states[name] = tensor;
+  }
+  ctx.mappedFiles = mappedFiles;
+  if (mappedFiles) {
+    // collected before any shard rebinds a state, so storage sharing is seen as built
+    ctx.aliasGroups = collectAliasGroups(ctx.states);
+    for (const auto& merged : mergedStates) {
+      for (auto* part : merged.parts) {
+        ctx.mergedOf[part] = &merged;
+      }
+    }
+  }
+
   if (endsWith(path, ".index.json")) {
-    return loadMulti(module, path, strict);
+    return loadMulti(ctx, path, strict);
   }
 
   if (endsWith(path, ".safetensors")) {
-    return loadInternal(module, path, strict, {});
+    return loadInternal(ctx, path, strict, {});
   }
 
   LOGE("Unknown file type: %s", path.c_str());
   return false;
 }
 
-bool SafeTensors::loadInternal(tt::nn::Module& module, const std::string& path, bool strict,
-                               const ankerl::unordered_dense::set<std::string>& onlyKeys) {
-  tt::MMappingResult mappingResult = tt::MMapUtils::mapFileForRead(path);
-  if (!mappingResult.success) {
-    LOGE("Error mapFileForRead: %s", path.c_str());
-    return false;
+// plain copy of a large state, split across the pool so page faults and memcpy run on all cores
+static void copyParallel(void* dst, const void* src, size_t nbytes) {
+  constexpr int64_t kCopyGrain = 1 << 22;
+  auto* dstPtr = static_cast<uint8_t*>(dst);
+  const auto* srcPtr = static_cast<const uint8_t*>(src);
+  ThreadPool::global().parallelFor(static_cast<int64_t>(nbytes), kCopyGrain, [&](int64_t begin, int64_t end) {
+    std::memcpy(dstPtr + begin, srcPtr + begin, end - begin);
+  });
+}
+// convert from the mapped file straight into the state, through a bounded staging buffer for device states
+static void copyConverted(tt::Tensor& dst, const void* src, tt::DType srcType) {
+  constexpr int64_t kStagingElements = 1 << 22;
+  const int64_t numel = dst.numel();
+  if (dst.device().isCpu()) {
+    kernel::convert(src, srcType, dst.dataPtr<>(), dst.dtype(), numel);
+    return;
   }
 
-  void* fileMap = mappingResult.dataPtr;
-  uint64_t headerSize = *static_cast<uint64_t*>(fileMap);
-  const char* headerPtr = static_cast<const char*>(fileMap) + sizeof(uint64_t);
+  const auto srcElemSize = static_cast<int64_t>(dtypeSize(srcType));
+  const auto dstElemSize = static_cast<int64_t>(dtypeSize(dst.dtype()));
+  std::vector<uint8_t> staging(std::min(numel, kStagingElements) * dstElemSize);
+  auto* dstPtr = static_cast<uint8_t*>(dst.dataPtr<>());
+  for (int64_t i = 0; i < numel; i += kStagingElements) {
+    int64_t len = std::min(kStagingElements, numel - i);
+    kernel::convert(static_cast<const uint8_t*>(src) + i * srcElemSize, srcType, staging.data(), dst.dtype(), len);
+    tt::Storage::copyOnDevice(dstPtr + i * dstElemSize, dst.device(), staging.data(), tt::Device::cpu(),
+                              len * dstElemSize);
+  }
+}
+
+SafeTensors::AliasGroups SafeTensors::collectAliasGroups(
+    const ankerl::unordered_dense::map<std::string, tt::TensorPtr>& states) {
+  struct Range {
+    uintptr_t begin;
+    uintptr_t end;
+    tt::TensorPtr tensor;
+  };
+  std::vector<Range> ranges;
+  for (const auto& [name, tensor] : states) {
+    if (!tensor->defined() || !tensor->device().isCpu() || tensor->numel() == 0) {
+      continue;
+    }
+    auto begin = reinterpret_cast<uintptr_t>(tensor->dataPtr<>());
+    ranges.push_back({begin, begin + tensor->numel() * dtypeSize(tensor->dtype()), tensor});
+  }
+  std::sort(ranges.begin(), ranges.end(), [](const Range& a, const Range& b) {
+    return a.begin != b.begin ? a.begin < b.begin : a.end < b.end;
+  });
+
+  // identical ranges are tied states (e.g. lm_head and embed_tokens) and alias together,
+  // overlapping or adjacent ranges are views into a merged weight (MergedLinear), see aliasMerged
+  AliasGroups groups;
+  uintptr_t prevEnd = 0;
+  for (size_t i = 0; i < ranges.size();) {
+    size_t j = i + 1;
+    while (j < ranges.size() && ranges[j].begin == ranges[i].begin && ranges[j].end == ranges[i].end) {
+      j++;
+    }
+    bool isolated = prevEnd < ranges[i].begin && (j == ranges.size() || ranges[i].end < ranges[j].begin);
+    if (isolated) {
+      auto group = std::make_shared<std::vector<tt::TensorPtr>>();
+      for (size_t k = i; k < j; k++) {
+        group->push_back(ranges[k].tensor);
+        groups[ranges[k].tensor] = group;
+      }
+    }
+    prevEnd = std::max(prevEnd, ranges[i].end);
+    i = j;
+  }
+  return groups;
+}
+
+bool SafeTensors::aliasMerged(LoadContext& ctx, const MergedState& merged,
+                              const ankerl::unordered_dense::map<tt::TensorPtr, const Entry*>& fileEntries) {
+  // parts in this file, in the merged dtype and one after another as in the merged layout
+  const uint8_t* next = nullptr;
+  for (auto* part : merged.parts) {
+    auto it = fileEntries.find(part);
+    if (it == fileEntries.end() || it->second->dtype != merged.merged->dtype() || it->second->shape != part->shape() ||
+        it->second->nbytes != part->numel() * dtypeSize(part->dtype()) || (next && it->second->data != next)) {
+      return false;
+    }
+    next = it->second->data + it->second->nbytes;
+  }
+
+  // zero-copy: the merged state views the whole range, each part its own range
+  *merged.merged = TensorUtils::fromBlob(fileEntries.find(merged.parts.front())->second->data, merged.merged->shape(),
+                                         merged.merged->dtype());
+  for (auto* part : merged.parts) {
+    *part = TensorUtils::fromBlob(fileEntries.find(part)->second->data, part->shape(), part->dtype());
+    ctx.aliased.insert(part);
+  }
+  return true;
+}
+
+bool SafeTensors::readIndex(const MappedFile& file, std::vector<std::pair<std::string, Entry>>& entries) {
+  const uint8_t* fileMap = file.data();
+  uint64_t headerSize = *reinterpret_cast<const uint64_t*>(fileMap);
+  const char* headerPtr = reinterpret_cast<const char*>(fileMap) + sizeof(uint64_t);
   std::string headerStr(headerPtr, headerSize);
 
   rapidjson::Document headerDoc;
   headerDoc.Parse(headerStr.c_str());
-
-  ankerl::unordered_dense::map<std::string, tt::TensorPtr> name2tensor;
-  for (const auto& [name, tensor] : module.namedStates()) {
-    name2tensor[name] = tensor;
+  if (!headerDoc.IsObject()) {
+    return false;
   }
 
-  bool success = true;
-  ankerl::unordered_dense::set<std::string> fileKeys;
+  const uint8_t* dataBase = fileMap + sizeof(uint64_t) + headerSize;
   for (auto it = headerDoc.MemberBegin(); it != headerDoc.MemberEnd(); ++it) {
     std::string name = it->name.GetString();
     if (KeySafeTensorsMeta == name) {
       continue;
     }
-    if (!onlyKeys.empty() && onlyKeys.count(name) == 0) {
-      continue;
+    const auto& info = it->value;
+
+    Entry entry;
+    for (auto& v : info["shape"].GetArray()) entry.shape.pushBack(v.GetInt64());
+    entry.dtype = fromTypeString(info["dtype"].GetString());
+    size_t start = info["data_offsets"][0].GetUint64();
+    size_t end = info["data_offsets"][1].GetUint64();
+    entry.data = dataBase + start;
+    entry.nbytes = end - start;
+    entries.emplace_back(std::move(name), std::move(entry));
+  }
+  return true;
+}
+
+bool SafeTensors::loadInternal(LoadContext& ctx, const std::string& path, bool strict,
+                               const ankerl::unordered_dense::set<std::string>& onlyKeys) {
+  auto mappedFile = MappedFile::open(path);
+  if (!mappedFile) {
+    return false;
+  }
+
+  std::vector<std::pair<std::string, Entry>> entries;
+  if (!readIndex(*mappedFile, entries)) {
+    LOGE("Invalid safetensors header: %s", path.c_str());
+    return false;
+  }
+
+  struct CopyTask {
+    tt::TensorPtr tensor;
+    const void* src;
+    size_t nbytes;
+    tt::DType fileType;
+  };
+  std::vector<CopyTask> tasks;
+
+  // entries of merged parts, looked up as a whole when the first part is reached
+  ankerl::unordered_dense::map<tt::TensorPtr, const Entry*> mergedEntries;
+  for (const auto& [name, entry] : entries) {
+    auto iter = ctx.states.find(name);
+    if (iter != ctx.states.end() && ctx.mergedOf.count(iter->second)) {
+      mergedEntries[iter->second] = &entry;
     }
+  }
 
-    fileKeys.insert(name);
-    const auto& info = it->value;
+  bool success = true;
+  ankerl::unordered_dense::set<std::string> fileKeys;
+  {
+    // header pass: validate and rebind aliased states, states of other shards may be rebound concurrently
+    std::lock_guard<std::mutex> lock(ctx.mutex);
+    for (const auto& [name, entry] : entries) {
+      if (!onlyKeys.empty() && onlyKeys.count(name) == 0) {
+        continue;
+      }
 
-    auto iter = name2tensor.find(name);
-    if (iter == name2tensor.end()) {
-      LOGW("Unexpected key: %s", name.c_str());
-      if (strict) {
+      fileKeys.insert(name);
+
+      auto iter = ctx.states.find(name);
+      if (iter == ctx.states.end()) {
+        LOGW("Unexpected key: %s", name.c_str());
+        if (strict) {
+          success = false;
+        }
+        continue;
+      }
+      tt::TensorPtr tensor = iter->second;
+
+      // shape
+      if (entry.shape != tensor->shape()) {
+        LOGE("shape not equal for tensor: %s", name.c_str());
         success = false;
+        continue;
       }
-      continue;
-    }
-    tt::TensorPtr tensor = iter->second;
 
-    // shape
-    tt::SizeVector shape;
-    for (auto& v : info["shape"].GetArray()) shape.pushBack(v.GetInt64());
-    if (shape != tensor->shape()) {
-      LOGE("shape not equal for tensor: %s", name.c_str());
-      success = false;
-      continue;
+      // dtype, float types are converted while copied
+      tt::DType fileType = entry.dtype;
+      bool needConvert = fileType != tensor->dtype();
+      if (needConvert && !(kernel::isConvertible(fileType) && kernel::isConvertible(tensor->dtype()))) {
+        LOGE("dtype not equal for tensor: %s", name.c_str());
+        success = false;
+        continue;
+      }
+
+      // data_offsets
+      size_t nbytes = entry.nbytes;
+      size_t fileSize = tensor->numel() * dtypeSize(fileType);
+      if (nbytes != fileSize) {
+        LOGE("size not equal for tensor: %s", name.c_str());
+        success = false;
+        continue;
+      }
+      const void* dataPtr = entry.data;
+
+      if (ctx.aliased.count(tensor)) {
+        // tied to a state already loaded from another shard
+        continue;
+      }
+      auto mergedIt = ctx.mergedOf.find(tensor);
+      if (!needConvert && mergedIt != ctx.mergedOf.end() && aliasMerged(ctx, *mergedIt->second, mergedEntries)) {
+        continue;
+      }
+      auto groupIt = ctx.aliasGroups.find(tensor);
+      if (!needConvert && groupIt != ctx.aliasGroups.end()) {
+        // zero-copy: the state and the states tied to it view the mapped pages
+        auto blob = TensorUtils::fromBlob(dataPtr, entry.shape, tensor->dtype());
+        for (auto* tied : *groupIt->second) {
+          *tied = blob;
+          ctx.aliased.insert(tied);
+        }
+        continue;
+      }
+      tasks.push_back({tensor, dataPtr, nbytes, fileType});
+    }
+    if (ctx.mappedFiles) {
+      ctx.mappedFiles->push_back(mappedFile);
     }
+  }
 
-    // dtype
-    std::string dtype = info["dtype"].GetString();
-    if (fromTypeString(dtype) != tensor->dtype()) {
-      LOGE("dtype not equal for tensor: %s", name.c_str());
-      success = false;
-      continue;
+  // copy pass: keep readahead a window ahead of the copies, so disk reads overlap with memcpy / conversion
+  constexpr size_t kReadAheadBytes = 256 << 20;
+  size_t adviseIdx = 0;
+  size_t advisedBytes = 0;
+  size_t copiedBytes = 0;
+  for (const auto& task : tasks) {
+    while (adviseIdx < tasks.size() && advisedBytes < copiedBytes + kReadAheadBytes) {
+      MappedFile::willNeed(tasks[adviseIdx].src, tasks[adviseIdx].nbytes);
+      advisedBytes += tasks[adviseIdx].nbytes;
+      adviseIdx++;
     }
 
-    // data_offsets
-    size_t start = info["data_offsets"][0].GetUint64();
-    size_t end = info["data_offsets"][1].GetUint64();
-    size_t nbytes = end - start;
-    size_t tensorSize = tensor->numel() * dtypeSize(tensor->dtype());
-    if (nbytes != tensorSize) {
-      LOGE("size not equal for tensor: %s", name.c_str());
-      success = false;
-      continue;
+    auto& tensor = *task.tensor;
+    if (task.fileType != tensor.dtype()) {
+      copyConverted(tensor, task.src, task.fileType);
+    } else if (tensor.device().isCpu()) {
+      copyParallel(tensor.dataPtr<>(), task.src, task.nbytes);
+    } else {
+      tt::Storage::copyOnDevice(tensor.dataPtr<>(), tensor.device(), task.src, tt::Device::cpu(),
+                                static_cast<int64_t>(task.nbytes));
     }
-    const void* dataPtr = static_cast<const char*>(fileMap) + sizeof(uint64_t) + headerSize + start;
-    tt::Storage::copyOnDevice(tensor->dataPtr<>(), tensor->device(), dataPtr, tt::Device::cpu(),
-                              static_cast<int64_t>(nbytes));
+    copiedBytes += task.nbytes;
   }
 
   if (onlyKeys.empty()) {
-    for (const auto& [name, tensor] : name2tensor) {
+    for (const auto& [name, tensor] : ctx.states) {
       if (!fileKeys.count(name)) {
         LOGW("Missing key: %s", name.c_str());
         if (strict) success = false;
       }
     }
   }
-
-  tt::MMapUtils::unmapFile(mappingResult);
   return success;
 }
 
-bool SafeTensors::loadMulti(tt::nn::Module& module, const std::string& indexPath, bool strict) {
+bool SafeTensors::loadMulti(LoadContext& ctx, const std::string& indexPath, bool strict) {
   std::ifstream ifs(indexPath, std::ios::binary);
   if (!ifs.is_open()) {
     LOGE("Error open index file: %s", indexPath.c_str());
@@ -262,20 +462,27 @@ bool SafeTensors::loadMulti(tt::nn::Module& module, const std::string& indexPath
     shard2keys[shardFile].push_back(tensorName);
   }
 
-  bool success = true;
+  std::vector<std::pair<std::string, ankerl::unordered_dense::set<std::string>>> shards;
   std::string baseDir = PathUtils::getBaseDir(indexPath);
   for (const auto& [shardFile, keys] : shard2keys) {
-    std::string shardPath = PathUtils::joinPath(baseDir, shardFile);
-
-    ankerl::unordered_dense::set<std::string> keySet(keys.begin(), keys.end());
-    if (!loadInternal(module, shardPath, false, keySet)) {
-      LOGE("Failed to load shard: %s", shardPath.c_str());
-      success = false;
-      if (strict) {
-        break;
+    shards.emplace_back(PathUtils::joinPath(baseDir, shardFile),
+                        ankerl::unordered_dense::set<std::string>(keys.begin(), keys.end()));
+  }
+
+  // shards are independent files, load them concurrently
+  std::atomic<bool> success{true};
+  ThreadPool::global().parallelFor(static_cast<int64_t>(shards.size()), 1, [&](int64_t begin, int64_t end) {
+    for (int64_t i = begin; i < end; i++) {
+      if (strict && !success) {
+        return;
+      }
+      const auto& [shardPath, keySet] = shards[i];
+      if (!loadInternal(ctx, shardPath, false, keySet)) {
+        LOGE("Failed to load shard: %s", shardPath.c_str());
+        success = false;
       }
     }
-  }
+  });
   return success;
 }
 
@@ -6,6 +6,11 @@
 
 #pragma once
 
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "MappedFile.h"
 #include "Modules.h"
 #include "ankerl/unordered_dense.h"
 
@@ -13,16 +18,56 @@ namespace tinygpt {
 
 class SafeTensors {
  public:
+  // a tensor stored in a mapped file
+  struct Entry {
+    tinytorch::SizeVector shape;
+    tinytorch::DType dtype = tinytorch::DType::Float32;
+    const uint8_t* data = nullptr;
+    size_t nbytes = 0;
+  };
+
+  // a state the module computes with (e.g. a MergedLinear weight) and the states of its parts, views along dim 0
+  struct MergedState {
+    tinytorch::TensorPtr merged;
+    std::vector<tinytorch::TensorPtr> parts;
+  };
+
   static bool save(tinytorch::nn::Module& module, const std::string& path);
-  static bool load(tinytorch::nn::Module& module, const std::string& path, bool strict = true);
+  // Float states stored in another float dtype are converted during the copy.
+  // mappedFiles: when set, CPU states whose dtype matches the file alias the mapped pages instead of being copied,
+  // the mappings are appended and must outlive the module. A merged state aliases the file when its parts are
+  // stored one after another in order (as `save` writes them), otherwise the parts are copied into it
+  static bool load(tinytorch::nn::Module& module, const std::string& path, bool strict = true,
+                   std::vector<std::shared_ptr<MappedFile>>* mappedFiles = nullptr,
+                   const std::vector<MergedState>& mergedStates = {});
+
+  // tensors of a mapped safetensors file in header order
+  static bool readIndex(const MappedFile& file, std::vector<std::pair<std::string, Entry>>& entries);
 
  private:
+  // states allowed to alias file pages, each mapped to all states sharing its storage (tied weights)
+  using AliasGroups =
+      ankerl::unordered_dense::map<tinytorch::TensorPtr, std::shared_ptr<std::vector<tinytorch::TensorPtr>>>;
+
+  // shared by the shards of one load, shards are loaded concurrently
+  struct LoadContext {
+    ankerl::unordered_dense::map<std::string, tinytorch::TensorPtr> states;
+    std::vector<std::shared_ptr<MappedFile>>* mappedFiles = nullptr;  // nullptr: always copy
+    AliasGroups aliasGroups;
+    ankerl::unordered_dense::map<tinytorch::TensorPtr, const MergedState*> mergedOf;  // part -> merged state
+    ankerl::unordered_dense::set<tinytorch::TensorPtr> aliased;  // states already viewing a mapped file
+    std::mutex mutex;                                            // guards aliased and mappedFiles
+  };
+
   static std::string toTypeString(tinytorch::DType type);
   static tinytorch::DType fromTypeString(const std::string& s);
 
-  static bool loadInternal(tinytorch::nn::Module& module, const std::string& path, bool strict,
+  static AliasGroups collectAliasGroups(const ankerl::unordered_dense::map<std::string, tinytorch::TensorPtr>& states);
+  static bool aliasMerged(LoadContext& ctx, const MergedState& merged,
+                          const ankerl::unordered_dense::map<tinytorch::TensorPtr, const Entry*>& fileEntries);
+  static bool loadInternal(LoadContext& ctx, const std::string& path, bool strict,
                            const ankerl::unordered_dense::set<std::string>& onlyKeys);
-  static bool loadMulti(tinytorch::nn::Module& module, const std::string& indexPath, bool strict = true);
+  static bool loadMulti(LoadContext& ctx, const std::string& indexPath, bool strict);
 };
 
 }  // namespace tinygpt
@@ -0,0 +1,23 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#pragma once
+
+#include "Functions.h"
+
+namespace tinygpt {
+
+class TensorUtils {
+ public:
+  // CPU tensor over external memory, no copy and no ownership: the memory must outlive the tensor and
+  // every tensor sharing its storage
+  static tinytorch::Tensor fromBlob(const void *data, tinytorch::IntArrayView shape, tinytorch::DType dtype) {
+    tinytorch::Options options(tinytorch::Device::cpu(), dtype);
+    return tinytorch::Tensor::fromBlob(const_cast<void *>(data), shape, options);
+  }
+};
+
+}  // namespace tinygpt
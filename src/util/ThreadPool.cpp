@@ -0,0 +1,262 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+#include "Numa.h"
+#include "Utils/Logger.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace tinygpt {
+
+ThreadPool::ThreadPool(uint32_t numThreads, std::vector<int> cpus) {
+  const uint32_t numWorkers = std::max<uint32_t>(numThreads, 1) - 1;
+  std::vector<int> workerCpus(numWorkers, -1);
+  std::vector<int> workerNodes(numWorkers, -1);
+  for (uint32_t i = 0; i < numWorkers && !cpus.empty(); i++) {
+    workerCpus[i] = cpus[i % cpus.size()];
+    workerNodes[i] = Numa::nodeOfCpu(workerCpus[i]);
+  }
+
+  // all deques exist before a worker starts stealing from them
+  queues_.reserve(numWorkers);
+  for (uint32_t i = 0; i < numWorkers; i++) {
+    auto worker = std::make_unique<Worker>();
+    for (uint32_t d = 1; d < numWorkers; d++) {
+      worker->victims.push_back((i + d) % numWorkers);
+    }
+    std::stable_partition(worker->victims.begin(), worker->victims.end(),
+                          [&](uint32_t v) { return workerNodes[v] == workerNodes[i]; });
+    queues_.push_back(std::move(worker));
+  }
+  workers_.reserve(numWorkers);
+  for (uint32_t i = 0; i < numWorkers; i++) {
+    workers_.emplace_back(&ThreadPool::workerLoop, this, i, workerCpus[i]);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex_);
+    stop_ = true;
+  }
+  sleepCv_.notify_all();
+  for (auto &t : workers_) {
+    if (t.joinable()) {
+      t.join();
+    }
+  }
+}
+
+struct GlobalPoolConfig {
+  uint32_t numThreads = 0;
+  bool pin = false;
+  bool created = false;
+};
+
+static std::mutex gGlobalMutex;
+static GlobalPoolConfig gGlobalConfig;
+
+static uint32_t hardwareThreads() { return std::max(1u, std::thread::hardware_concurrency()); }
+
+bool ThreadPool::configureGlobal(uint32_t numThreads, bool pin) {
+  std::lock_guard<std::mutex> lock(gGlobalMutex);
+  if (gGlobalConfig.created) {
+    if ((numThreads == 0 || numThreads == gGlobalConfig.numThreads) && pin == gGlobalConfig.pin) {
+      return true;
+    }
+    LOGW("ThreadPool: global pool already running with %u threads, new settings ignored", gGlobalConfig.numThreads);
+    return false;
+  }
+  gGlobalConfig.numThreads = numThreads;
+  gGlobalConfig.pin = pin;
+  return true;
+}
+
+ThreadPool &ThreadPool::global() {
+  static ThreadPool pool = [] {
+    std::lock_guard<std::mutex> lock(gGlobalMutex);
+    uint32_t numThreads = gGlobalConfig.numThreads > 0 ? gGlobalConfig.numThreads : hardwareThreads();
+    std::vector<int> cpus;
+    if (gGlobalConfig.pin) {
+      // one CPU of each node in turn, so the workers spread over the nodes evenly whatever their number,
+      // the first CPU is left to the calling threads
+      for (size_t idx = 0;; idx++) {
+        bool more = false;
+        for (int node = 0; node < Numa::numNodes(); node++) {
+          const auto &nodeCpus = Numa::nodeCpus(node);
+          if (idx < nodeCpus.size()) {
+            cpus.push_back(nodeCpus[idx]);
+            more = true;
+          }
+        }
+        if (!more) {
+          break;
+        }
+      }
+      if (cpus.empty()) {
+        for (uint32_t i = 0; i < hardwareThreads(); i++) {
+          cpus.push_back(static_cast<int>(i));
+        }
+      }
+      std::rotate(cpus.begin(), cpus.begin() + 1, cpus.end());
+    }
+    gGlobalConfig.numThreads = numThreads;
+    gGlobalConfig.created = true;
+    LOGI("ThreadPool: global pool with %u threads%s", numThreads, gGlobalConfig.pin ? ", pinned" : "");
+    return ThreadPool(numThreads, std::move(cpus));
+  }();
+  return pool;
+}
+
+void ThreadPool::runChunks(Job &job) {
+  while (true) {
+    int64_t idx = job.nextChunk.fetch_add(1, std::memory_order_relaxed);
+    if (idx >= job.numChunks) {
+      break;
+    }
+    int64_t begin = idx * job.chunk;
+    int64_t end = std::min(job.n, begin + job.chunk);
+    (*job.func)(begin, end);
+    if (job.doneChunks.fetch_add(1, std::memory_order_acq_rel) + 1 == job.numChunks) {
+      std::lock_guard<std::mutex> lock(job.doneMutex);
+      job.doneCv.notify_all();
+    }
+  }
+}
+
+void ThreadPool::parallelFor(int64_t n, int64_t grain, const RangeFunc &func) {
+  if (n <= 0) {
+    return;
+  }
+  grain = std::max<int64_t>(grain, 1);
+  int64_t maxChunks = std::min<int64_t>((n + grain - 1) / grain, numThreads());
+  if (maxChunks <= 1 || workers_.empty()) {
+    func(0, n);
+    return;
+  }
+
+  // calling thread takes part, so nested parallelFor never deadlocks
+  wait(enqueue(n, grain, func), true);
+}
+
+ThreadPool::TaskHandle ThreadPool::submit(int64_t n, int64_t grain, const RangeFunc &func) {
+  if (n <= 0) {
+    return nullptr;
+  }
+  if (workers_.empty()) {
+    func(0, n);
+    return nullptr;
+  }
+  return enqueue(n, std::max<int64_t>(grain, 1), func);
+}
+
+ThreadPool::TaskHandle ThreadPool::enqueue(int64_t n, int64_t grain, const RangeFunc &func) {
+  int64_t maxChunks = std::min<int64_t>((n + grain - 1) / grain, numThreads());
+  auto job = std::make_shared<Job>();
+  job->func = &func;
+  job->n = n;
+  job->chunk = (n + maxChunks - 1) / maxChunks;
+  job->numChunks = (n + job->chunk - 1) / job->chunk;
+
+  // one entry per chunk on the deques of different workers, starting after those of the last job
+  const auto numQueues = static_cast<uint32_t>(queues_.size());
+  const auto entries = static_cast<uint32_t>(std::min<int64_t>(job->numChunks, numQueues));
+  const uint32_t first = nextQueue_.fetch_add(entries, std::memory_order_relaxed);
+  pending_.fetch_add(entries, std::memory_order_release);
+  for (uint32_t i = 0; i < entries; i++) {
+    auto &queue = *queues_[(first + i) % numQueues];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.jobs.push_back(job);
+  }
+
+  { std::lock_guard<std::mutex> lock(sleepMutex_); }
+  if (entries >= numQueues) {
+    sleepCv_.notify_all();
+  } else {
+    for (uint32_t i = 0; i < entries; i++) {
+      sleepCv_.notify_one();
+    }
+  }
+  return job;
+}
+
+void ThreadPool::wait(const TaskHandle &task, bool help) {
+  if (!task) {
+    return;
+  }
+  if (help) {
+    runChunks(*task);
+  }
+
+  // the last chunks are usually about to finish, spin a little before sleeping on the latch.
+  // entries of the job left on the deques are dropped by the workers, they find no chunk to run
+  constexpr int kSpinCount = 64;
+  for (int i = 0; i < kSpinCount && task->doneChunks.load(std::memory_order_acquire) < task->numChunks; i++) {
+    std::this_thread::yield();
+  }
+  if (task->doneChunks.load(std::memory_order_acquire) < task->numChunks) {
+    std::unique_lock<std::mutex> lock(task->doneMutex);
+    task->doneCv.wait(lock, [&] { return task->doneChunks.load(std::memory_order_acquire) >= task->numChunks; });
+  }
+}
+
+std::shared_ptr<ThreadPool::Job> ThreadPool::takeJob(uint32_t self) {
+  std::shared_ptr<Job> job;
+  {
+    auto &own = *queues_[self];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.jobs.empty()) {
+      job = std::move(own.jobs.front());
+      own.jobs.pop_front();
+    }
+  }
+  // steal the newest entry, the owner works from the oldest
+  for (size_t i = 0; !job && i < queues_[self]->victims.size(); i++) {
+    auto &victim = *queues_[queues_[self]->victims[i]];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.jobs.empty()) {
+      job = std::move(victim.jobs.back());
+      victim.jobs.pop_back();
+    }
+  }
+  if (job) {
+    pending_.fetch_sub(1, std::memory_order_relaxed);
+  }
+  return job;
+}
+
+void ThreadPool::workerLoop(uint32_t self, int cpu) {
+#ifdef __linux__
+  if (cpu >= 0) {
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpu, &cpuSet);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+  }
+#else
+  (void)cpu;
+#endif
+  while (true) {
+    if (auto job = takeJob(self)) {
+      runChunks(*job);
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleepMutex_);
+    sleepCv_.wait(lock, [this] { return stop_ || pending_.load(std::memory_order_acquire) > 0; });
+    if (stop_) {
+      return;
+    }
+  }
+}
+
+}  // namespace tinygpt
@@ -0,0 +1,93 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tinygpt {
+
+// Each worker has its own deque of jobs, a job is pushed to as many deques as it has chunks for other threads, and
+// a worker out of jobs steals from the others, those of its own NUMA node first. Chunks of a job are claimed with an
+// atomic counter, the thread finishing the last one wakes the waiters of that job only.
+class ThreadPool {
+ public:
+  using RangeFunc = std::function<void(int64_t begin, int64_t end)>;
+
+  // cpus: workers are pinned to these CPUs in turn (Linux only), empty: not pinned
+  explicit ThreadPool(uint32_t numThreads, std::vector<int> cpus = {});
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // process-wide pool shared by CPU kernels and tokenizer work, sized to hardware concurrency by default
+  static ThreadPool &global();
+
+  // set up the global pool before its first use, numThreads 0: hardware concurrency, pin: one worker per CPU.
+  // returns false if the global pool is already running with other settings
+  static bool configureGlobal(uint32_t numThreads, bool pin = false);
+
+  // number of threads taking part in parallelFor (workers + calling thread)
+  uint32_t numThreads() const { return static_cast<uint32_t>(queues_.size()) + 1; }
+
+  // split [0, n) into chunks of at least `grain` items, the calling thread takes part and returns when all done
+  void parallelFor(int64_t n, int64_t grain, const RangeFunc &func);
+
+ private:
+  struct Job;
+
+ public:
+  using TaskHandle = std::shared_ptr<Job>;
+
+  // as parallelFor, but only the workers run the chunks and the call returns at once,
+  // `func` must stay alive until `wait` returns
+  TaskHandle submit(int64_t n, int64_t grain, const RangeFunc &func);
+  // help: the calling thread runs pending chunks too
+  void wait(const TaskHandle &task, bool help = false);
+
+ private:
+  struct Job {
+    const RangeFunc *func;
+    int64_t n;
+    int64_t chunk;
+    int64_t numChunks;
+    std::atomic<int64_t> nextChunk{0};
+    std::atomic<int64_t> doneChunks{0};
+    // completion latch
+    std::mutex doneMutex;
+    std::condition_variable doneCv;
+  };
+
+  struct Worker {
+    std::mutex mutex;
+    std::deque<std::shared_ptr<Job>> jobs;
+    std::vector<uint32_t> victims;  // other workers, same NUMA node first
+  };
+
+  static void runChunks(Job &job);
+  TaskHandle enqueue(int64_t n, int64_t grain, const RangeFunc &func);
+  std::shared_ptr<Job> takeJob(uint32_t self);
+  void workerLoop(uint32_t self, int cpu);
+
+  std::vector<std::unique_ptr<Worker>> queues_;
+  std::vector<std::thread> workers_;
+  std::atomic<uint32_t> nextQueue_{0};
+  std::atomic<int64_t> pending_{0};  // job entries in all deques
+  std::mutex sleepMutex_;
+  std::condition_variable sleepCv_;
+  bool stop_ = false;
+};
+
+}  // namespace tinygpt
@@ -0,0 +1,629 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#include <cmath>
+#include <random>
+
+#include "kernel/Attention.h"
+#include "kernel/Convert.h"
+#include "kernel/MLP.h"
+#include "kernel/Norm.h"
+#include "kernel/Rope.h"
+#include "kernel/Vec.h"
+#include "test.h"
+#include "util/ThreadPool.h"
+
+using namespace tinygpt;
+
+static std::vector<float> randomVector(size_t n, uint32_t seed) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<float> dist(-1.f, 1.f);
+  std::vector<float> ret(n);
+  for (auto &v : ret) {
+    v = dist(gen);
+  }
+  return ret;
+}
+
+// naive reference, query: [B, H, D], key/value: [B, L, Hkv, D]
+static std::vector<float> refDecodeAttention(const std::vector<float> &q, const std::vector<float> &k,
+                                             const std::vector<float> &v, const kernel::DecodeAttentionParams &p) {
+  std::vector<float> out(p.batch * p.numHeads * p.headDim, 0.f);
+  int64_t groupSize = p.numHeads / p.numKvHeads;
+  for (int64_t b = 0; b < p.batch; b++) {
+    for (int64_t h = 0; h < p.numHeads; h++) {
+      int64_t kvh = h / groupSize;
+      const float *qRow = &q[(b * p.numHeads + h) * p.headDim];
+      std::vector<float> scores(p.kvLen);
+      float maxScore = -INFINITY;
+      for (int64_t j = 0; j < p.kvLen; j++) {
+        const float *kRow = &k[b * p.kvBatchStride + j * p.kvSeqStride + kvh * p.headDim];
+        float s = 0.f;
+        for (int64_t d = 0; d < p.headDim; d++) {
+          s += qRow[d] * kRow[d];
+        }
+        scores[j] = s * p.scale;
+        maxScore = std::max(maxScore, scores[j]);
+      }
+      float sum = 0.f;
+      for (auto &s : scores) {
+        s = std::exp(s - maxScore);
+        sum += s;
+      }
+      float *o = &out[(b * p.numHeads + h) * p.headDim];
+      for (int64_t j = 0; j < p.kvLen; j++) {
+        const float *vRow = &v[b * p.kvBatchStride + j * p.kvSeqStride + kvh * p.headDim];
+        for (int64_t d = 0; d < p.headDim; d++) {
+          o[d] += scores[j] / sum * vRow[d];
+        }
+      }
+    }
+  }
+  return out;
+}
+
+static kernel::DecodeAttentionParams makeDecodeParams(int64_t batch, int64_t numHeads, int64_t numKvHeads,
+                                                      int64_t headDim, int64_t kvLen) {
+  kernel::DecodeAttentionParams p;
+  p.batch = batch;
+  p.numHeads = numHeads;
+  p.numKvHeads = numKvHeads;
+  p.headDim = headDim;
+  p.kvLen = kvLen;
+  p.kvSeqStride = numKvHeads * headDim;
+  p.kvBatchStride = kvLen * p.kvSeqStride;
+  p.scale = 1.f / std::sqrt(static_cast<float>(headDim));
+  return p;
+}
+
+static void checkDecodeAttentionF32(int64_t batch, int64_t numHeads, int64_t numKvHeads, int64_t headDim,
+                                    int64_t kvLen, int64_t numSplits = 0) {
+  auto p = makeDecodeParams(batch, numHeads, numKvHeads, headDim, kvLen);
+  p.numSplits = numSplits;
+  auto q = randomVector(batch * numHeads * headDim, 1);
+  auto k = randomVector(batch * p.kvBatchStride, 2);
+  auto v = randomVector(batch * p.kvBatchStride, 3);
+
+  std::vector<float> out(q.size());
+  kernel::decodeAttention(q.data(), k.data(), v.data(), out.data(), p);
+  EXPECT_TRUE(VectorNear(refDecodeAttention(q, k, v, p), out));
+}
+
+TEST(TEST_kernel, decode_attention_mha) { checkDecodeAttentionF32(2, 4, 4, 64, 37); }
+
+TEST(TEST_kernel, decode_attention_gqa) { checkDecodeAttentionF32(1, 8, 2, 128, 100); }
+
+TEST(TEST_kernel, decode_attention_mqa) { checkDecodeAttentionF32(2, 6, 1, 32, 1); }
+
+TEST(TEST_kernel, decode_attention_long_kv) { checkDecodeAttentionF32(1, 4, 2, 64, 2051); }
+
+TEST(TEST_kernel, decode_attention_split_kv) { checkDecodeAttentionF32(2, 8, 2, 64, 1000, 3); }
+
+TEST(TEST_kernel, decode_attention_bf16) {
+  auto p = makeDecodeParams(1, 8, 2, 64, 300);
+  auto q = randomVector(p.numHeads * p.headDim, 4);
+  auto k = randomVector(p.kvBatchStride, 5);
+  auto v = randomVector(p.kvBatchStride, 6);
+
+  // round inputs to bf16 so the reference sees the same values
+  auto toBf16 = [](std::vector<float> &src) {
+    std::vector<kernel::BF16> ret(src.size());
+    for (size_t i = 0; i < src.size(); i++) {
+      ret[i] = kernel::fromFloat<kernel::BF16>(src[i]);
+      src[i] = kernel::toFloat(ret[i]);
+    }
+    return ret;
+  };
+  auto qh = toBf16(q);
+  auto kh = toBf16(k);
+  auto vh = toBf16(v);
+
+  std::vector<kernel::BF16> outH(q.size());
+  kernel::decodeAttention(qh.data(), kh.data(), vh.data(), outH.data(), p);
+
+  auto expected = refDecodeAttention(q, k, v, p);
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_NEAR(expected[i], kernel::toFloat(outH[i]), 1e-2);
+  }
+}
+
+// naive reference, query: [B, S, H, D], key/value: [B, L, Hkv, D]
+static std::vector<float> refPrefillAttention(const std::vector<float> &q, const std::vector<float> &k,
+                                              const std::vector<float> &v, const kernel::PrefillAttentionParams &p) {
+  std::vector<float> out(p.batch * p.qBatchStride, 0.f);
+  int64_t groupSize = p.numHeads / p.numKvHeads;
+  for (int64_t b = 0; b < p.batch; b++) {
+    for (int64_t i = 0; i < p.qLen; i++) {
+      int64_t limit = p.causal ? std::min(p.kvLen, i + p.kvLen - p.qLen + 1) : p.kvLen;
+      for (int64_t h = 0; h < p.numHeads; h++) {
+        int64_t kvh = h / groupSize;
+        const float *qRow = &q[b * p.qBatchStride + i * p.qSeqStride + h * p.headDim];
+        std::vector<float> scores(limit);
+        float maxScore = -INFINITY;
+        for (int64_t j = 0; j < limit; j++) {
+          const float *kRow = &k[b * p.kvBatchStride + j * p.kvSeqStride + kvh * p.headDim];
+          float s = 0.f;
+          for (int64_t d = 0; d < p.headDim; d++) {
+            s += qRow[d] * kRow[d];
+          }
+          scores[j] = s * p.scale;
+          maxScore = std::max(maxScore, scores[j]);
+        }
+        float sum = 0.f;
+        for (auto &s : scores) {
+          s = std::exp(s - maxScore);
+          sum += s;
+        }
+        float *o = &out[b * p.qBatchStride + i * p.qSeqStride + h * p.headDim];
+        for (int64_t j = 0; j < limit; j++) {
+          const float *vRow = &v[b * p.kvBatchStride + j * p.kvSeqStride + kvh * p.headDim];
+          for (int64_t d = 0; d < p.headDim; d++) {
+            o[d] += scores[j] / sum * vRow[d];
+          }
+        }
+      }
+    }
+  }
+  return out;
+}
+
+static void checkPrefillAttentionF32(int64_t batch, int64_t numHeads, int64_t numKvHeads, int64_t headDim,
+                                     int64_t qLen, int64_t kvLen, bool causal) {
+  kernel::PrefillAttentionParams p;
+  p.batch = batch;
+  p.numHeads = numHeads;
+  p.numKvHeads = numKvHeads;
+  p.headDim = headDim;
+  p.qLen = qLen;
+  p.kvLen = kvLen;
+  p.qSeqStride = numHeads * headDim;
+  p.qBatchStride = qLen * p.qSeqStride;
+  p.kvSeqStride = numKvHeads * headDim;
+  p.kvBatchStride = kvLen * p.kvSeqStride;
+  p.scale = 1.f / std::sqrt(static_cast<float>(headDim));
+  p.causal = causal;
+
+  auto q = randomVector(batch * p.qBatchStride, 7);
+  auto k = randomVector(batch * p.kvBatchStride, 8);
+  auto v = randomVector(batch * p.kvBatchStride, 9);
+
+  std::vector<float> out(q.size());
+  kernel::prefillAttention(q.data(), k.data(), v.data(), out.data(), p);
+  EXPECT_TRUE(VectorNear(refPrefillAttention(q, k, v, p), out));
+}
+
+TEST(TEST_kernel, prefill_attention_causal) {
+  checkPrefillAttentionF32(1, 4, 4, 64, 100, 100, true);
+  checkPrefillAttentionF32(2, 8, 2, 128, 70, 70, true);
+}
+
+TEST(TEST_kernel, prefill_attention_head_dims) {
+  checkPrefillAttentionF32(1, 4, 2, 96, 33, 33, true);
+  checkPrefillAttentionF32(1, 2, 1, 256, 20, 20, true);
+  checkPrefillAttentionF32(1, 4, 2, 40, 17, 17, true);
+}
+
+TEST(TEST_kernel, prefill_attention_with_past) {
+  checkPrefillAttentionF32(1, 8, 2, 64, 10, 150, true);
+  checkPrefillAttentionF32(1, 4, 4, 64, 10, 150, false);
+}
+
+TEST(TEST_kernel, qkv_norm_rope) {
+  kernel::QKVRopeParams p;
+  p.batch = 2;
+  p.seqLen = 3;
+  p.numHeads = 4;
+  p.numKvHeads = 2;
+  p.headDim = 16;
+  p.pastLength = 5;
+  p.kvSeqStride = p.numKvHeads * p.headDim;
+  p.kvBatchStride = 10 * p.kvSeqStride;  // cache capacity 10
+  p.normEps = 1e-6f;
+
+  std::vector<float> invFreq(p.headDim / 2);
+  std::vector<float> cos(p.seqLen * p.headDim / 2);
+  std::vector<float> sin(p.seqLen * p.headDim / 2);
+  kernel::ropeInvFreq(invFreq.data(), p.headDim, 10000.f);
+  kernel::ropeCosSin(cos.data(), sin.data(), invFreq.data(), p.headDim, p.pastLength, p.seqLen);
+  p.cos = cos.data();
+  p.sin = sin.data();
+
+  const int64_t rowSize = (p.numHeads + 2 * p.numKvHeads) * p.headDim;
+  auto qkv = randomVector(p.batch * p.seqLen * rowSize, 10);
+  auto qWeight = randomVector(p.headDim, 11);
+  auto kWeight = randomVector(p.headDim, 12);
+
+  std::vector<float> queries(p.batch * p.seqLen * p.numHeads * p.headDim);
+  std::vector<float> keyCache(p.batch * p.kvBatchStride, 0.f);
+  std::vector<float> valueCache(p.batch * p.kvBatchStride, 0.f);
+  kernel::qkvNormRope(qkv.data(), qWeight.data(), kWeight.data(), queries.data(), keyCache.data(), valueCache.data(),
+                      p);
+
+  // reference: rmsnorm then rotate_half rope
+  auto refHead = [&](const float *x, const float *w, int64_t pos) {
+    const int64_t D = p.headDim;
+    std::vector<float> n(D);
+    float sumSq = 0.f;
+    for (int64_t i = 0; i < D; i++) {
+      sumSq += x[i] * x[i];
+    }
+    float invRms = 1.f / std::sqrt(sumSq / D + p.normEps);
+    for (int64_t i = 0; i < D; i++) {
+      n[i] = x[i] * invRms * w[i];
+    }
+    std::vector<float> out(D);
+    for (int64_t i = 0; i < D / 2; i++) {
+      float freq = pos / std::pow(10000.f, 2.f * i / D);
+      out[i] = n[i] * std::cos(freq) - n[i + D / 2] * std::sin(freq);
+      out[i + D / 2] = n[i + D / 2] * std::cos(freq) + n[i] * std::sin(freq);
+    }
+    return out;
+  };
+
+  for (int64_t b = 0; b < p.batch; b++) {
+    for (int64_t s = 0; s < p.seqLen; s++) {
+      int64_t pos = p.pastLength + s;
+      const float *row = &qkv[(b * p.seqLen + s) * rowSize];
+      for (int64_t h = 0; h < p.numHeads; h++) {
+        auto expected = refHead(row + h * p.headDim, qWeight.data(), pos);
+        auto *actual = &queries[((b * p.seqLen + s) * p.numHeads + h) * p.headDim];
+        EXPECT_TRUE(VectorNear(expected, std::vector<float>(actual, actual + p.headDim)));
+      }
+      for (int64_t h = 0; h < p.numKvHeads; h++) {
+        const float *kSrc = row + (p.numHeads + h) * p.headDim;
+        const float *vSrc = row + (p.numHeads + p.numKvHeads + h) * p.headDim;
+        auto expected = refHead(kSrc, kWeight.data(), pos);
+        auto *kSlot = &keyCache[b * p.kvBatchStride + pos * p.kvSeqStride + h * p.headDim];
+        auto *vSlot = &valueCache[b * p.kvBatchStride + pos * p.kvSeqStride + h * p.headDim];
+        EXPECT_TRUE(VectorNear(expected, std::vector<float>(kSlot, kSlot + p.headDim)));
+        EXPECT_TRUE(
+            VectorNear(std::vector<float>(vSrc, vSrc + p.headDim), std::vector<float>(vSlot, vSlot + p.headDim)));
+      }
+    }
+  }
+
+  // slots before pastLength are untouched
+  EXPECT_EQ(keyCache[0], 0.f);
+  EXPECT_EQ(valueCache[p.kvBatchStride + 4 * p.kvSeqStride], 0.f);
+}
+
+TEST(TEST_kernel, rope_inv_freq_llama3) {
+  const int64_t headDim = 64;
+  std::vector<float> base(headDim / 2);
+  std::vector<float> scaled(headDim / 2);
+  kernel::RopeScaling scaling;
+  scaling.type = kernel::RopeType::LLAMA3;
+  scaling.factor = 8.f;
+  scaling.originalMaxPositionEmbeddings = 8192;
+  kernel::ropeInvFreq(base.data(), headDim, 500000.f);
+  EXPECT_FLOAT_EQ(1.f, kernel::ropeInvFreq(scaled.data(), headDim, 500000.f, &scaling));
+
+  // high frequencies kept, low frequencies divided by factor
+  EXPECT_FLOAT_EQ(base.front(), scaled.front());
+  EXPECT_FLOAT_EQ(base.back() / 8.f, scaled.back());
+  for (size_t i = 0; i < base.size(); i++) {
+    EXPECT_LE(scaled[i], base[i]);
+    EXPECT_GE(scaled[i], base[i] / 8.f - 1e-12f);
+  }
+}
+
+TEST(TEST_kernel, rope_inv_freq_yarn) {
+  const int64_t headDim = 128;
+  std::vector<float> base(headDim / 2);
+  std::vector<float> scaled(headDim / 2);
+  kernel::RopeScaling scaling;
+  scaling.type = kernel::RopeType::YARN;
+  scaling.factor = 4.f;
+  scaling.originalMaxPositionEmbeddings = 32768;
+  kernel::ropeInvFreq(base.data(), headDim, 1000000.f);
+  float attnScaling = kernel::ropeInvFreq(scaled.data(), headDim, 1000000.f, &scaling);
+
+  // extrapolated high frequencies, interpolated low frequencies, ramp in between
+  EXPECT_NEAR(0.1f * std::log(4.f) + 1.f, attnScaling, 1e-6f);
+  EXPECT_FLOAT_EQ(base.front(), scaled.front());
+  EXPECT_FLOAT_EQ(base.back() / 4.f, scaled.back());
+  for (size_t i = 1; i < base.size(); i++) {
+    EXPECT_LE(scaled[i] / base[i], scaled[i - 1] / base[i - 1] + 1e-6f);
+  }
+
+  scaling.attentionFactor = 1.5f;
+  EXPECT_FLOAT_EQ(1.5f, kernel::ropeInvFreq(scaled.data(), headDim, 1000000.f, &scaling));
+}
+
+TEST(TEST_kernel, rope_inv_freq_dynamic) {
+  const int64_t headDim = 64;
+  std::vector<float> base(headDim / 2);
+  std::vector<float> scaled(headDim / 2);
+  kernel::RopeScaling scaling;
+  scaling.type = kernel::RopeType::DYNAMIC;
+  scaling.factor = 2.f;
+  scaling.originalMaxPositionEmbeddings = 2048;
+  kernel::ropeInvFreq(base.data(), headDim, 10000.f);
+
+  // unscaled within the original context
+  kernel::ropeInvFreq(scaled.data(), headDim, 10000.f, &scaling, 2048);
+  EXPECT_TRUE(VectorNear(base, scaled));
+
+  // base rescaled to theta * (factor * seqLen / original - (factor - 1))^(dim / (dim - 2))
+  kernel::ropeInvFreq(scaled.data(), headDim, 10000.f, &scaling, 4096);
+  double theta = 10000.0 * std::pow(3.0, 64.0 / 62.0);
+  for (int64_t i = 0; i < headDim / 2; i++) {
+    EXPECT_NEAR(1.0 / std::pow(theta, 2.0 * i / headDim), scaled[i], 1e-6);
+  }
+}
+
+TEST(TEST_kernel, rope_cos_sin) {
+  const int64_t headDim = 8;
+  std::vector<float> invFreq(headDim / 2);
+  kernel::ropeInvFreq(invFreq.data(), headDim, 10000.f);
+
+  std::vector<float> cos(3 * headDim / 2);
+  std::vector<float> sin(3 * headDim / 2);
+  kernel::ropeCosSin(cos.data(), sin.data(), invFreq.data(), headDim, 7, 3, 2.f);
+  for (int64_t r = 0; r < 3; r++) {
+    for (int64_t i = 0; i < headDim / 2; i++) {
+      float freq = static_cast<float>(7 + r) * invFreq[i];
+      EXPECT_NEAR(2.f * std::cos(freq), cos[r * headDim / 2 + i], 1e-6f);
+      EXPECT_NEAR(2.f * std::sin(freq), sin[r * headDim / 2 + i], 1e-6f);
+    }
+  }
+}
+
+TEST(TEST_kernel, add_rms_norm) {
+  const int64_t rows = 5;
+  const int64_t dim = 48;
+  auto residual = randomVector(rows * dim, 13);
+  auto delta = randomVector(rows * dim, 14);
+  auto weight = randomVector(dim, 15);
+
+  std::vector<float> expectedResidual(rows * dim);
+  std::vector<float> expected(rows * dim);
+  for (int64_t r = 0; r < rows; r++) {
+    float sumSq = 0.f;
+    for (int64_t i = 0; i < dim; i++) {
+      expectedResidual[r * dim + i] = residual[r * dim + i] + delta[r * dim + i];
+      sumSq += expectedResidual[r * dim + i] * expectedResidual[r * dim + i];
+    }
+    float invRms = 1.f / std::sqrt(sumSq / dim + 1e-5f);
+    for (int64_t i = 0; i < dim; i++) {
+      expected[r * dim + i] = expectedResidual[r * dim + i] * invRms * weight[i];
+    }
+  }
+
+  std::vector<float> out(rows * dim);
+  kernel::addRMSNorm(residual.data(), delta.data(), weight.data(), out.data(), rows, dim, 1e-5f);
+  EXPECT_TRUE(VectorNear(expectedResidual, residual));
+  EXPECT_TRUE(VectorNear(expected, out));
+
+  // without delta the residual is left as is
+  kernel::addRMSNorm(residual.data(), static_cast<const float *>(nullptr), weight.data(), out.data(), rows, dim,
+                     1e-5f);
+  EXPECT_TRUE(VectorNear(expectedResidual, residual));
+  EXPECT_TRUE(VectorNear(expected, out));
+}
+
+TEST(TEST_kernel, add_layer_norm) {
+  const int64_t rows = 3;
+  const int64_t dim = 40;
+  auto residual = randomVector(rows * dim, 16);
+  auto delta = randomVector(rows * dim, 17);
+  auto weight = randomVector(dim, 18);
+  auto bias = randomVector(dim, 19);
+
+  std::vector<float> expected(rows * dim);
+  for (int64_t r = 0; r < rows; r++) {
+    std::vector<float> x(dim);
+    float mean = 0.f;
+    for (int64_t i = 0; i < dim; i++) {
+      x[i] = residual[r * dim + i] + delta[r * dim + i];
+      mean += x[i];
+    }
+    mean /= dim;
+    float var = 0.f;
+    for (int64_t i = 0; i < dim; i++) {
+      var += (x[i] - mean) * (x[i] - mean);
+    }
+    float invStd = 1.f / std::sqrt(var / dim + 1e-5f);
+    for (int64_t i = 0; i < dim; i++) {
+      expected[r * dim + i] = (x[i] - mean) * invStd * weight[i] + bias[i];
+    }
+  }
+
+  std::vector<float> out(rows * dim);
+  kernel::addLayerNorm(residual.data(), delta.data(), weight.data(), bias.data(), out.data(), rows, dim, 1e-5f);
+  EXPECT_TRUE(VectorNear(expected, out));
+}
+
+static std::vector<float> refGatedMLP(const std::vector<float> &x, const std::vector<float> &gateUp,
+                                      const std::vector<float> &down, const kernel::GatedMLPParams &p) {
+  const int64_t H = p.hiddenSize;
+  const int64_t I = p.intermediateSize;
+  std::vector<float> out(p.numTokens * H, 0.f);
+  for (int64_t t = 0; t < p.numTokens; t++) {
+    std::vector<float> act(I);
+    for (int64_t j = 0; j < I; j++) {
+      float g = 0.f;
+      float u = 0.f;
+      for (int64_t k = 0; k < H; k++) {
+        g += x[t * H + k] * gateUp[j * H + k];
+        u += x[t * H + k] * gateUp[(I + j) * H + k];
+      }
+      act[j] = g / (1.f + std::exp(-g)) * u;
+    }
+    for (int64_t h = 0; h < H; h++) {
+      for (int64_t j = 0; j < I; j++) {
+        out[t * H + h] += act[j] * down[h * I + j];
+      }
+    }
+  }
+  return out;
+}
+
+TEST(TEST_kernel, gated_mlp) {
+  for (int64_t numPartitions : {0, 1, 3}) {
+    kernel::GatedMLPParams p;
+    p.numTokens = 2;
+    p.hiddenSize = 72;
+    p.intermediateSize = 200;
+    p.numPartitions = numPartitions;
+
+    auto x = randomVector(p.numTokens * p.hiddenSize, 20);
+    auto gateUp = randomVector(2 * p.intermediateSize * p.hiddenSize, 21);
+    auto down = randomVector(p.hiddenSize * p.intermediateSize, 22);
+
+    std::vector<float> out(x.size());
+    kernel::gatedMLP(x.data(), gateUp.data(), down.data(), out.data(), p);
+    auto expected = refGatedMLP(x, gateUp, down, p);
+    for (size_t i = 0; i < expected.size(); i++) {
+      EXPECT_NEAR(expected[i], out[i], 1e-3 * std::max(1.f, std::fabs(expected[i])));
+    }
+  }
+}
+
+TEST(TEST_kernel, gated_mlp_node_pools) {
+  // two "nodes" on any machine: the per node split and the reduction match the single pool result
+  ThreadPool node0(3);
+  ThreadPool node1(2);
+  std::vector<ThreadPool *> pools = {&node0, &node1};
+
+  kernel::GatedMLPParams p;
+  p.numTokens = 3;
+  p.hiddenSize = 40;
+  p.intermediateSize = 300;
+  p.nodePools = &pools;
+
+  auto x = randomVector(p.numTokens * p.hiddenSize, 25);
+  auto gateUp = randomVector(2 * p.intermediateSize * p.hiddenSize, 26);
+  auto down = randomVector(p.hiddenSize * p.intermediateSize, 27);
+
+  std::vector<float> out(x.size());
+  kernel::gatedMLP(x.data(), gateUp.data(), down.data(), out.data(), p);
+  auto expected = refGatedMLP(x, gateUp, down, p);
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_NEAR(expected[i], out[i], 1e-3 * std::max(1.f, std::fabs(expected[i])));
+  }
+
+  // weights in the node layout only, the full weights are not read
+  std::vector<std::vector<float>> nodeBuffers;
+  nodeBuffers.reserve(4);
+  std::vector<const void *> nodeWeights;
+  for (int64_t node = 0; node < 2; node++) {
+    int64_t begin, end;
+    kernel::gatedMLPNodeRows(p.intermediateSize, 2, node, begin, end);
+    auto &gateUpBuffer = nodeBuffers.emplace_back(2 * (end - begin) * p.hiddenSize);
+    auto &downBuffer = nodeBuffers.emplace_back(p.hiddenSize * (end - begin));
+    kernel::gatedMLPNodeLayout(gateUp.data(), down.data(), gateUpBuffer.data(), downBuffer.data(), p.hiddenSize,
+                               p.intermediateSize, 2, node, *pools[node]);
+    nodeWeights.push_back(gateUpBuffer.data());
+    nodeWeights.push_back(downBuffer.data());
+  }
+  p.nodeWeights = nodeWeights.data();
+  std::vector<float> nodeOut(x.size());
+  kernel::gatedMLP<float>(x.data(), nullptr, nullptr, nodeOut.data(), p);
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_NEAR(expected[i], nodeOut[i], 1e-3 * std::max(1.f, std::fabs(expected[i])));
+  }
+
+  int64_t prevEnd = 0;
+  for (int64_t node = 0; node < 2; node++) {
+    int64_t begin, end;
+    kernel::gatedMLPNodeRows(p.intermediateSize, 2, node, begin, end);
+    EXPECT_EQ(begin, prevEnd);
+    prevEnd = end;
+  }
+  EXPECT_EQ(prevEnd, p.intermediateSize);
+}
+
+TEST(TEST_kernel, vec_dot_half) {
+  auto a = randomVector(67, 23);
+  auto b = randomVector(67, 24);
+  std::vector<kernel::BF16> bBf16(b.size());
+  std::vector<kernel::FP16> bFp16(b.size());
+  float expectedBf16 = 0.f;
+  float expectedFp16 = 0.f;
+  for (size_t i = 0; i < b.size(); i++) {
+    bBf16[i] = kernel::fromFloat<kernel::BF16>(b[i]);
+    bFp16[i] = kernel::fromFloat<kernel::FP16>(b[i]);
+    expectedBf16 += a[i] * kernel::toFloat(bBf16[i]);
+    expectedFp16 += a[i] * kernel::toFloat(bFp16[i]);
+  }
+  EXPECT_NEAR(expectedBf16, kernel::vecDot(a.data(), bBf16.data(), a.size()), 1e-4);
+  EXPECT_NEAR(expectedFp16, kernel::vecDot(a.data(), bFp16.data(), a.size()), 1e-4);
+
+  auto yBf16 = a;
+  auto yFp16 = a;
+  kernel::vecAxpy(yBf16.data(), bBf16.data(), 0.5f, a.size());
+  kernel::vecAxpy(yFp16.data(), bFp16.data(), 0.5f, a.size());
+  for (size_t i = 0; i < a.size(); i++) {
+    EXPECT_FLOAT_EQ(a[i] + 0.5f * kernel::toFloat(bBf16[i]), yBf16[i]);
+    EXPECT_FLOAT_EQ(a[i] + 0.5f * kernel::toFloat(bFp16[i]), yFp16[i]);
+  }
+}
+
+template <int64_t N>
+static void checkVecFixed() {
+  auto a = randomVector(N, 25);
+  auto b = randomVector(N, 26);
+  EXPECT_NEAR(kernel::vecDot(a.data(), b.data(), N), kernel::vecDotFixed<N>(a.data(), b.data()), 1e-4);
+
+  auto y0 = a;
+  auto y1 = a;
+  kernel::vecAxpy(y0.data(), b.data(), 0.5f, N);
+  kernel::vecAxpyFixed<N>(y1.data(), b.data(), 0.5f);
+  kernel::vecScale(y0.data(), 1.5f, N);
+  kernel::vecScaleFixed<N>(y1.data(), 1.5f);
+  for (int64_t i = 0; i < N; i++) {
+    EXPECT_FLOAT_EQ(y0[i], y1[i]);
+  }
+}
+
+TEST(TEST_kernel, vec_fixed_length) {
+  checkVecFixed<24>();
+  checkVecFixed<96>();
+  checkVecFixed<128>();
+}
+
+TEST(TEST_kernel, numeric_fp16_round_trip) {
+  std::vector<float> values = {0.f, 1.f, -2.5f, 65504.f, 6.1035156e-05f, 5.9604645e-08f, 0.333251953125f};
+  for (auto v : values) {
+    EXPECT_EQ(v, kernel::fp16ToFloat(kernel::floatToFp16(v)));
+  }
+  EXPECT_TRUE(std::isinf(kernel::fp16ToFloat(kernel::floatToFp16(1e6f))));
+  EXPECT_EQ(kernel::bf16ToFloat(kernel::floatToBf16(1.5f)), 1.5f);
+}
+
+TEST(TEST_kernel, convert_dtypes) {
+  // vector body + tail, plus a size split across the thread pool
+  for (int64_t n : {int64_t(37), int64_t(200003)}) {
+    auto src = randomVector(n, 20);
+    src[0] = 0.f;
+    src[1] = -1e-7f;  // fp16 subnormal
+    src[2] = 70000.f;  // fp16 overflow
+    src[3] = 1.f + 1.f / 256.f;  // bf16 tie, rounds to even
+
+    std::vector<kernel::BF16> bf16(n);
+    std::vector<kernel::FP16> fp16(n);
+    std::vector<kernel::FP16> fp16FromBf16(n);
+    std::vector<float> back(n);
+    kernel::convert(src.data(), bf16.data(), n);
+    kernel::convert(src.data(), fp16.data(), n);
+    kernel::convert(bf16.data(), fp16FromBf16.data(), n);
+    for (int64_t i = 0; i < n; i++) {
+      ASSERT_EQ(kernel::floatToBf16(src[i]), bf16[i].bits) << i;
+      ASSERT_EQ(kernel::floatToFp16(src[i]), fp16[i].bits) << i;
+      ASSERT_EQ(kernel::floatToFp16(kernel::bf16ToFloat(bf16[i].bits)), fp16FromBf16[i].bits) << i;
+    }
+
+    kernel::convert(bf16.data(), back.data(), n);
+    for (int64_t i = 0; i < n; i++) {
+      ASSERT_EQ(kernel::bf16ToFloat(bf16[i].bits), back[i]) << i;
+    }
+    kernel::convert(fp16.data(), back.data(), n);
+    for (int64_t i = 0; i < n; i++) {
+      ASSERT_EQ(kernel::fp16ToFloat(fp16[i].bits), back[i]) << i;
+    }
+  }
+}
@@ -0,0 +1,64 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#include "test.h"
+#include "util/MemoryPlanner.h"
+
+using namespace tinygpt;
+
+static bool rangesOverlap(const MemoryRequest &a, int64_t offsetA, const MemoryRequest &b, int64_t offsetB) {
+  bool liveTogether = a.firstStep <= b.lastStep && b.firstStep <= a.lastStep;
+  bool memOverlap = offsetA < offsetB + b.size && offsetB < offsetA + a.size;
+  return liveTogether && memOverlap;
+}
+
+TEST(TEST_memory_planner, disjoint_lifetimes_share_memory) {
+  std::vector<MemoryRequest> requests = {{100, 0, 0}, {100, 1, 1}, {100, 2, 2}};
+  std::vector<int64_t> offsets;
+  EXPECT_EQ(planMemory(requests, offsets, 1), 100);
+  EXPECT_EQ(offsets, std::vector<int64_t>({0, 0, 0}));
+}
+
+TEST(TEST_memory_planner, overlapping_lifetimes) {
+  std::vector<MemoryRequest> requests = {{100, 0, 1}, {30, 1, 2}, {50, 0, 2}};
+  std::vector<int64_t> offsets;
+  EXPECT_EQ(planMemory(requests, offsets, 1), 180);
+  for (size_t i = 0; i < requests.size(); i++) {
+    for (size_t j = i + 1; j < requests.size(); j++) {
+      EXPECT_FALSE(rangesOverlap(requests[i], offsets[i], requests[j], offsets[j]));
+    }
+  }
+}
+
+TEST(TEST_memory_planner, fills_gaps_and_aligns) {
+  // the step 1 blocks reuse the range of the step 0 block below the long-lived one
+  std::vector<MemoryRequest> requests = {{200, 0, 0}, {64, 0, 1}, {64, 1, 1}, {60, 1, 1}, {0, 1, 1}};
+  std::vector<int64_t> offsets;
+  int64_t size = planMemory(requests, offsets, 32);
+  for (size_t i = 0; i < requests.size(); i++) {
+    EXPECT_EQ(offsets[i] % 32, 0);
+    for (size_t j = i + 1; j < requests.size(); j++) {
+      EXPECT_FALSE(rangesOverlap(requests[i], offsets[i], requests[j], offsets[j]));
+    }
+  }
+  EXPECT_EQ(offsets[1], 224);
+  EXPECT_EQ(offsets[2], 0);
+  EXPECT_EQ(offsets[3], 64);
+  EXPECT_EQ(size, 288);
+}
+
+TEST(TEST_memory_planner, decoder_layers) {
+  // per layer: norm out, queries, attention out, norm out, mlp out, each live until the end of the next layer
+  std::vector<MemoryRequest> requests;
+  for (int64_t layer = 0; layer < 32; layer++) {
+    for (int64_t size : {4096, 4096, 4096, 4096, 4096}) {
+      requests.push_back({size, layer, layer + 1});
+    }
+  }
+  std::vector<int64_t> offsets;
+  // two layers live at once, independent of the depth
+  EXPECT_EQ(planMemory(requests, offsets), 10 * 4096);
+}
@@ -4,7 +4,10 @@
  *
  */
 
+#include <sstream>
+
 #include "test.h"
+#include "tokenizer/StreamEncoder.h"
 #include "tokenizer/Tokenizer.h"
 
 using namespace tinygpt;
@@ -79,6 +82,83 @@ TEST(TEST_tokenizer, pretokenize_bytelevel) {
   EXPECT_EQ(expected, getStrings(actual));
 }
 
+TEST(TEST_tokenizer, pretokenize_split_builtin) {
+  auto text =
+      "I'M here\t\tnow,  you'll see 12345 apples!\n\n  \r\nHello\u3000world \u017Fs 'S\u00a0x \u0661\u0662 "
+      "\xF0\x9F\x98\x80\n";
+
+  using tokenizer::SplitMatcher;
+  using tokenizer::SplitPattern;
+  auto split = std::make_shared<tokenizer::Split>(SplitMatcher::patternString(SplitPattern::LLAMA3), Behavior::ISOLATED,
+                                                  false, SplitPattern::LLAMA3);
+  auto actual = split->preTokenize(text);
+  std::vector<std::string> expected = {"I",          "'M",          " here",   "\t",      "\tnow",    ",",
+                                       " ",          " you",        "'ll",     " see",    " ",        "123",
+                                       "45",         " apples",     "!\n\n",   "  \r\n",  "Hello",    "\u3000world",
+                                       " \u017Fs",   " '",          "S",       "\u00a0x", " ",        "\u0661\u0662",
+                                       " \xF0\x9F\x98\x80\n"};
+  EXPECT_EQ(expected, getStrings(actual));
+
+  // same matches as pcre2
+  for (auto pattern : {SplitPattern::GPT2, SplitPattern::LLAMA3, SplitPattern::QWEN2}) {
+    auto patternStr = SplitMatcher::patternString(pattern);
+    EXPECT_EQ(SplitMatcher::recognize(patternStr), pattern);
+    tokenizer::Regex regex(patternStr);
+    SplitMatcher matcher(pattern);
+    std::vector<tokenizer::Range> regexMatches;
+    std::vector<tokenizer::Range> builtinMatches;
+    regex.matchAll(regexMatches, text);
+    matcher.matchAll(builtinMatches, text);
+    EXPECT_EQ(regexMatches, builtinMatches);
+  }
+  EXPECT_EQ(SplitMatcher::recognize(","), SplitPattern::UNKNOWN);
+}
+
+TEST(TEST_tokenizer, pretokenize_sequence) {
+  std::string text = "Hello,,, world! This is a test.";
+
+  tokenizer::ComponentSequence sequence;
+  sequence.addComponent(std::make_unique<tokenizer::Split>(",", Behavior::REMOVED));
+  sequence.addComponent(std::make_unique<tokenizer::Split>(" ", Behavior::MERGED_WITH_NEXT));
+  auto actual = sequence.preTokenize(text);
+
+  // split stages only refine ranges over the input text
+  EXPECT_EQ(actual.backStr.data(), text.data());
+  std::vector<std::string> expected = {"Hello", " world!", " This", " is", " a", " test."};
+  EXPECT_EQ(expected, getStrings(actual));
+}
+
+TEST(TEST_tokenizer, added_tokens) {
+  auto splitAdded = [](const tokenizer::AddedTokens &added, std::string_view text) {
+    std::vector<tokenizer::AddedTokenPiece> pieces;
+    added.split(pieces, text);
+    std::vector<std::pair<std::string, int32_t>> ret;
+    for (auto &p : pieces) {
+      ret.emplace_back(text.substr(p.range.first, p.range.second - p.range.first), p.id);
+    }
+    return ret;
+  };
+  using Pieces = std::vector<std::pair<std::string, int32_t>>;
+
+  // leftmost-longest, first bytes found by memchr
+  tokenizer::AddedTokens added;
+  added.build({{"<|im_start|>", 1}, {"<|im_end|>", 2}, {"<|im", 3}, {"[INST]", 4}});
+  EXPECT_EQ(splitAdded(added, "<|im_start|>user a<b [INST]<|im<|im_end|>"),
+            (Pieces{{"<|im_start|>", 1}, {"user a<b ", -1}, {"[INST]", 4}, {"<|im", 3}, {"<|im_end|>", 2}}));
+  EXPECT_EQ(splitAdded(added, "no added tokens"), (Pieces{{"no added tokens", -1}}));
+
+  // lstrip / rstrip / single_word, more than two first bytes: found by table
+  added.build({{"<mask>", 1, false, true, false},
+               {"</s>", 2, false, false, true},
+               {"ab", 3, true},
+               {"b c", 4},
+               {"[SEP]", 5}});
+  EXPECT_EQ(splitAdded(added, "I  <mask></s> \n ab abc"),
+            (Pieces{{"I", -1}, {"  <mask>", 1}, {"</s> \n ", 2}, {"ab", 3}, {" abc", -1}}));
+  // a rejected single_word match is skipped as a whole, as in huggingface
+  EXPECT_EQ(splitAdded(added, "xab c[SEP]"), (Pieces{{"xab c", -1}, {"[SEP]", 5}}));
+}
+
 inline bool loadTokenizer(tokenizer::Tokenizer &tokenizer, const std::string &dir) {
   return tokenizer.initWithConfig(dir + "/tokenizer.json", dir + "/tokenizer_config.json");
 }
@@ -247,6 +327,24 @@ TEST(TEST_tokenizer, tokenizer_batch) {
   EXPECT_TRUE(decodeRet == std::vector({decodeText, decodeText, decodeText}));
 }
 
+TEST(TEST_tokenizer, tokenizer_batch_mixed_sizes) {
+  tokenizer::Tokenizer tokenizer;
+  bool initOk = loadTokenizer(tokenizer, "assets/tokenizer/gpt2");
+  EXPECT_TRUE(initOk);
+
+  // a few large inputs among many small ones, split into chunks of similar size
+  std::vector<std::string> texts;
+  for (auto i = 0; i < 200; i++) {
+    texts.push_back(i % 50 == 7 ? std::string(40000 + i, '=') : "hello world " + std::to_string(i));
+  }
+  auto ret = tokenizer.encodeBatch(texts, 4);
+  ASSERT_TRUE(ret.size() == texts.size());
+  for (auto i = 0; i < texts.size(); i++) {
+    EXPECT_TRUE(ret[i] == tokenizer.encode(texts[i]));
+  }
+  EXPECT_TRUE(tokenizer.decodeBatch(ret, 4) == texts);
+}
+
 TEST(TEST_tokenizer, tokenizer_long_text) {
   tokenizer::Tokenizer tokenizer;
   bool initOk = loadTokenizer(tokenizer, "assets/tokenizer/Llama-3.1-8B");
@@ -260,3 +358,118 @@ TEST(TEST_tokenizer, tokenizer_long_text) {
     EXPECT_TRUE(ids[i] == 70540);
   }
 }
+
+TEST(TEST_tokenizer, tokenizer_parallel_chunks) {
+  tokenizer::Tokenizer tokenizer;
+  bool initOk = loadTokenizer(tokenizer, "assets/tokenizer/Llama-3.1-8B");
+  EXPECT_TRUE(initOk);
+
+  std::string text;
+  for (auto i = 0; i < 5000; i++) {
+    text += "Line " + std::to_string(i) + ": The quick brown fox jumps over the lazy dog. 你好，世界！\n";
+  }
+  tokenizer.setParallelChunkSize(0);
+  auto expected = tokenizer.encode(text);
+  for (size_t chunkSize : {1, 4096, 100000}) {
+    tokenizer.setParallelChunkSize(chunkSize);
+    EXPECT_TRUE(tokenizer.encode(text) == expected);
+  }
+}
+
+TEST(TEST_tokenizer, tokenizer_gpt2_long_piece) {
+  tokenizer::Tokenizer tokenizer;
+  bool initOk = loadTokenizer(tokenizer, "assets/tokenizer/gpt2");
+  EXPECT_TRUE(initOk);
+
+  // one pre-tokenized piece, merged down to repeated tokens with a different tail
+  std::string text(100000, '=');
+  auto ids = tokenizer.encode(text);
+  EXPECT_TRUE(ids.size() == 1563);
+  for (auto i = 0; i < ids.size() - 1; i++) {
+    EXPECT_TRUE(ids[i] == 23926);
+  }
+  EXPECT_TRUE(ids.back() == 10052);
+  EXPECT_TRUE(tokenizer.decode(ids) == text);
+}
+
+TEST(TEST_tokenizer, tokenizer_stream_encoder) {
+  tokenizer::Tokenizer tokenizer;
+  bool initOk = loadTokenizer(tokenizer, "assets/tokenizer/gpt2");
+  EXPECT_TRUE(initOk);
+
+  std::string text;
+  for (auto i = 0; i < 2000; i++) {
+    text += "Line " + std::to_string(i) + ": hello world!\n";
+    if (i % 300 == 0) {
+      text += "<|endoftext|>  \n\n";
+    }
+  }
+  auto expected = tokenizer.encode(text);
+
+  // fed in pieces which split added tokens and utf-8 sequences
+  std::vector<int32_t> ids;
+  size_t numEmits = 0;
+  tokenizer::StreamEncoder encoder(
+      tokenizer,
+      [&](const int32_t *data, size_t n) {
+        ids.insert(ids.end(), data, data + n);
+        numEmits++;
+      },
+      true, 1024);
+  for (size_t pos = 0; pos < text.size(); pos += 333) {
+    encoder.feed(std::string_view(text).substr(pos, 333));
+  }
+  encoder.finish();
+  EXPECT_TRUE(ids == expected);
+  EXPECT_TRUE(numEmits > 10);
+
+  std::vector<int32_t> streamIds;
+  tokenizer::StreamEncoder streamEncoder(tokenizer, streamIds, false, 256);
+  std::istringstream stream(text);
+  EXPECT_TRUE(streamEncoder.feed(stream));
+  streamEncoder.finish();
+  EXPECT_TRUE(streamIds == tokenizer.encode(text, false));
+}
+
+TEST(TEST_tokenizer, tokenizer_gpt2_raw_bytes) {
+  tokenizer::Tokenizer tokenizer;
+  bool initOk = loadTokenizer(tokenizer, "assets/tokenizer/gpt2");
+  EXPECT_TRUE(initOk);
+
+  // vocab is kept in raw bytes, tokens are still found by their byte-level form
+  EXPECT_TRUE(tokenizer.token2Id("\u0120the") == 262);
+  // vocab form first: "é" is the byte 0xE9, not the two bytes of its utf-8 encoding
+  EXPECT_TRUE(tokenizer.token2Id("\u00e9") == 165);
+  EXPECT_TRUE(tokenizer.token2Id("\xe9") == 165);
+
+  std::string text("a\0b\xff\xfe c", 7);
+  auto ids = tokenizer.encode(text);
+  EXPECT_TRUE(ids == std::vector<int32_t>({64, 188, 65, 187, 186, 269}));
+  EXPECT_TRUE(tokenizer.decode(ids) == text);
+}
+
+TEST(TEST_tokenizer, bpe_cache) {
+  tokenizer::BPECache cache(tokenizer::BPECache::NUM_SHARDS);
+  std::vector<int32_t> ids;
+  EXPECT_FALSE(cache.get(" hello", ids));
+
+  std::vector<int32_t> helloIds = {31373};
+  cache.put(" hello", helloIds.data(), helloIds.size());
+  EXPECT_TRUE(cache.get(" hello", ids));
+  EXPECT_TRUE(cache.get(" hello", ids));
+  EXPECT_TRUE(ids == std::vector<int32_t>({31373, 31373}));
+
+  // pieces larger than a slot are not cached
+  std::string longPiece(tokenizer::BPECache::SLOT_BYTES, 'a');
+  cache.put(longPiece, helloIds.data(), helloIds.size());
+  EXPECT_FALSE(cache.get(longPiece, ids));
+
+  // eviction keeps the size within capacity
+  for (int32_t i = 0; i < 1000; i++) {
+    cache.put(std::to_string(i), &i, 1);
+  }
+  auto stats = cache.stats();
+  EXPECT_TRUE(stats.hits == 2);
+  EXPECT_TRUE(stats.misses == 2);
+  EXPECT_TRUE(stats.size <= tokenizer::BPECache::NUM_SHARDS);
+}
@@ -0,0 +1,93 @@
+/*
+ * TinyGPT
+ * @author 	: keith@robot9.me
+ *
+ */
+
+#include <filesystem>
+
+#include "Utils/Timer.h"
+#include "huggingface/ModelLoader.h"
+
+static void printUsage(const char* progName) {
+  LOGI("Usage: %s [options]", progName);
+  LOGI("Options:");
+  LOGI("  --model <path>        Path to HuggingFace model directory (required)");
+  LOGI("  --output <path>       Output artifact directory (required)");
+  LOGI("  --dtype <fp32|fp16|bf16>  Data type of the stored weights (default: bf16)");
+  LOGI("  --help                Show this help message");
+}
+
+int main(int argc, char** argv) {
+  std::string modelDir;
+  std::string outputDir;
+  std::string dtype = "bf16";
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--help" || arg == "-h") {
+      printUsage(argv[0]);
+      return 0;
+    }
+    if (arg == "--model" && i + 1 < argc) {
+      modelDir = argv[++i];
+    } else if (arg == "--output" && i + 1 < argc) {
+      outputDir = argv[++i];
+    } else if (arg == "--dtype" && i + 1 < argc) {
+      dtype = argv[++i];
+    } else {
+      LOGE("Unknown argument: %s", arg.c_str());
+      printUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (modelDir.empty() || outputDir.empty()) {
+    LOGE("Error: --model and --output are required");
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  tinytorch::DType modelDtype;
+  if (dtype == "fp32") {
+    modelDtype = tinytorch::DType::Float32;
+  } else if (dtype == "fp16") {
+    modelDtype = tinytorch::DType::Float16;
+  } else if (dtype == "bf16") {
+    modelDtype = tinytorch::DType::BFloat16;
+  } else {
+    LOGE("Unknown dtype: %s", dtype.c_str());
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  std::error_code ec;
+  std::filesystem::create_directories(outputDir, ec);
+  if (ec) {
+    LOGE("Create output directory failed: %s", outputDir.c_str());
+    return 1;
+  }
+  // the model files are mapped while the artifact is written, they must not be overwritten
+  if (std::filesystem::equivalent(modelDir, outputDir, ec)) {
+    LOGE("Error: --output must not be the --model directory");
+    return 1;
+  }
+
+  tinytorch::Timer timer;
+  timer.start();
+
+  // weights are converted to the target dtype while loaded on CPU, then written as they are laid out in memory
+  tinygpt::huggingface::ModelLoader loader;
+  if (!loader.load(modelDir, tinytorch::Device::cpu(), modelDtype)) {
+    LOGE("Load model failed: %s", modelDir.c_str());
+    return 1;
+  }
+  if (!loader.saveArtifact(outputDir)) {
+    LOGE("Save artifact failed: %s", outputDir.c_str());
+    return 1;
+  }
+
+  timer.mark();
+  LOGI("Convert done: %s, cost: %lld ms", outputDir.c_str(), timer.elapseMillis());
+  return 0;
+}